@@ -0,0 +1,416 @@
+//
+// approx.cc
+//
+// This implements the approximate word count dictionary with the type
+// `approx::dict*`: a Space-Saving summary of the most frequent words
+// backed by a Count-Min sketch, both of a fixed size. See "approx.hh".
+//
+// The functions it defines include
+//    * `approx::dict* approx::build(long)`: build a dictionary within a memory budget
+//    * `int approx::numTracked(approx::dict*)`: get the number of tracked words
+//    * `unsigned long long approx::totalCount(approx::dict*)`: get the total word count
+//    * `void approx::increment(approx::dict*,std::string_view)`: count a word
+//    * `unsigned long long approx::getCount(approx::dict*,std::string_view)`: estimate the count for a word
+//    * `unsigned long long approx::getError(approx::dict*,std::string_view)`: bound the error of that estimate
+//    * `unsigned long long approx::sketchError(approx::dict*)`: bound the error of the sketch
+//    * `approx::counter* approx::topK(approx::dict*,int)`: get the most frequent words
+//    * `void approx::destroy(approx::dict*)`: give back the dictionary's storage
+//
+
+#include <string>
+#include "approx.hh"
+#include "hash.hh"
+
+using hashing::hash64;
+using hashing::powerOfTwoAtLeast;
+
+namespace approx {
+
+  // The number of rows in the Count-Min sketch.
+  const int DEPTH = 4;
+
+  // The fewest counters, and the narrowest sketch rows, `build` makes.
+  const int MIN_SIZE = 16;
+
+  // * * * * * * * * * * * * * * * * * * * * * * *
+  //
+  // THE SPACE-SAVING SUMMARY
+  //
+  // The tracked words sit in `counters`, found by their hash through
+  // `index` and kept in a min-heap by count through `heap`.
+  //
+
+  // swapHeap(D,i,j):
+  //
+  // Exchanges the heap positions `i` and `j`, keeping each counter's
+  // `position` in step.
+  //
+  void swapHeap(dict* D, int i, int j) {
+    int a = D->heap[i];
+    D->heap[i] = D->heap[j];
+    D->heap[j] = a;
+    D->counters[D->heap[i]].position = i;
+    D->counters[D->heap[j]].position = j;
+  }
+
+  // siftDown(D,i):
+  //
+  // Moves the counter at heap position `i` down past any children with
+  // smaller counts. Counts only ever grow, so this is the only way a
+  // counter moves once it is placed.
+  //
+  void siftDown(dict* D, int i) {
+    while (true) {
+      int smallest = i;
+      int left = 2*i+1;
+      int right = left+1;
+      if (left < D->numTracked
+	  && D->counters[D->heap[left]].count < D->counters[D->heap[smallest]].count) {
+	smallest = left;
+      }
+      if (right < D->numTracked
+	  && D->counters[D->heap[right]].count < D->counters[D->heap[smallest]].count) {
+	smallest = right;
+      }
+      if (smallest == i) {
+	return;
+      }
+      swapHeap(D,i,smallest);
+      i = smallest;
+    }
+  }
+
+  // siftUp(D,i):
+  //
+  // Moves the counter at heap position `i` up past any parents with
+  // larger counts.
+  //
+  void siftUp(dict* D, int i) {
+    while (i > 0 && D->counters[D->heap[(i-1)/2]].count > D->counters[D->heap[i]].count) {
+      swapHeap(D,i,(i-1)/2);
+      i = (i-1)/2;
+    }
+  }
+
+  // findSlot(D,w,h):
+  //
+  // Returns the slot of `index` that holds the counter of word `w`
+  // (with hash `h`), or the empty slot where it would go.
+  //
+  int findSlot(dict* D, std::string_view w, unsigned long long h) {
+    int mask = D->indexSize-1;
+    int slot = h & mask;
+    while (D->index[slot] != -1) {
+      counter& c = D->counters[D->index[slot]];
+      if (c.hash == h && c.word == w) {
+	return slot;
+      }
+      slot = (slot+1) & mask;
+    }
+    return slot;
+  }
+
+  // unindex(D,slot):
+  //
+  // Empties the `slot` of `index`, then shifts back any entries after it
+  // that could no longer be reached past the gap.
+  //
+  void unindex(dict* D, int slot) {
+    int mask = D->indexSize-1;
+    int gap = slot;
+    int next = (gap+1) & mask;
+    while (D->index[next] != -1) {
+      int home = D->counters[D->index[next]].hash & mask;
+      //move it back only if its home isn't cyclically within (gap,next]
+      if (((next-home) & mask) >= ((next-gap) & mask)) {
+	D->index[gap] = D->index[next];
+	gap = next;
+      }
+      next = (next+1) & mask;
+    }
+    D->index[gap] = -1;
+  }
+
+  // * * * * * * * * * * * * * * * * * * * * * * *
+  //
+  // THE COUNT-MIN SKETCH
+  //
+
+  // column(D,h,row):
+  //
+  // Returns which counter of the given `row` of the sketch the hash `h`
+  // falls on. Each row remixes `h` with its own constant, and maps the
+  // result onto the row's width with a multiply rather than a division.
+  //
+  int column(dict* D, unsigned long long h, int row) {
+    unsigned long long r = hashing::mix(h ^ hashing::SECRET0,hashing::SECRET1 + row);
+    return (int)(((unsigned __int128)r * D->width) >> 64);
+  }
+
+  // sketchCount(D,h):
+  //
+  // Returns the sketch's estimate for the word with hash `h`: the
+  // smallest of its counters.
+  //
+  unsigned long long sketchCount(dict* D, unsigned long long h) {
+    unsigned long long least = D->sketch[column(D,h,0)];
+    for (int row=1; row<D->depth; row++) {
+      unsigned long long c = D->sketch[row*D->width + column(D,h,row)];
+      if (c < least) {
+	least = c;
+      }
+    }
+    return least;
+  }
+
+  // * * * * * * * * * * * * * * * * * * * * * * *
+  //
+  // THE PUBLIC INTERFACE
+  //
+
+  // build(budget):
+  //
+  // Build an approximate dictionary that uses about `budget` bytes,
+  // half of it on Space-Saving counters and half on the sketch.
+  //
+  dict* build(long budget) {
+    long perCounter = sizeof(counter) + 3*sizeof(int);
+    long numCounters = budget/2/perCounter;
+    long width = budget/2/(DEPTH*sizeof(unsigned long long));
+
+    dict* newD = new dict;
+    newD->numCounters = numCounters < MIN_SIZE ? MIN_SIZE : (int)numCounters;
+    newD->numTracked = 0;
+    newD->counters = new counter[newD->numCounters];
+    newD->heap = new int[newD->numCounters];
+    newD->indexSize = powerOfTwoAtLeast(2*newD->numCounters);
+    newD->index = new int[newD->indexSize];
+    for (int i=0; i<newD->indexSize; i++) {
+      newD->index[i] = -1;
+    }
+    newD->depth = DEPTH;
+    newD->width = width < MIN_SIZE ? MIN_SIZE : (int)width;
+    newD->sketch = new unsigned long long[newD->depth*newD->width]();
+    newD->numIncrements = 0;
+    return newD;
+  }
+
+  // numTracked(D):
+  //
+  // Gives back the number of words held by the Space-Saving counters.
+  //
+  int numTracked(dict* D) {
+    return D->numTracked;
+  }
+
+  // totalCount(D):
+  //
+  // Gives back the number of words counted into `D`.
+  //
+  unsigned long long totalCount(dict* D) {
+    return D->numIncrements;
+  }
+
+  // increment(D,w):
+  //
+  // Counts an occurrence of word `w`. It always lands in the sketch.
+  // In the summary, it bumps the word's counter if it has one, takes a
+  // free counter if there is one, and otherwise takes over the counter
+  // with the smallest count.
+  //
+  void increment(dict* D, std::string_view w) {
+    unsigned long long h = hash64(w.data(),w.size());
+    D->numIncrements++;
+    for (int row=0; row<D->depth; row++) {
+      D->sketch[row*D->width + column(D,h,row)]++;
+    }
+
+    int slot = findSlot(D,w,h);
+    if (D->index[slot] != -1) {
+      counter& c = D->counters[D->index[slot]];
+      c.count++;
+      siftDown(D,c.position);
+      return;
+    }
+
+    if (D->numTracked < D->numCounters) {
+      int i = D->numTracked++;
+      counter& c = D->counters[i];
+      c.word.assign(w.data(),w.size());
+      c.hash = h;
+      c.count = 1;
+      c.error = 0;
+      c.position = i;
+      D->heap[i] = i;
+      D->index[slot] = i;
+      siftUp(D,i);
+      return;
+    }
+
+    //evict the least counted word, and inherit its count as our error
+    int i = D->heap[0];
+    counter& c = D->counters[i];
+    unindex(D,findSlot(D,c.word,c.hash));
+    c.word.assign(w.data(),w.size());
+    c.hash = h;
+    c.error = c.count;
+    c.count++;
+    D->index[findSlot(D,c.word,h)] = i;
+    siftDown(D,0);
+  }
+
+  // getCount(D,w):
+  //
+  // Gives an upper bound on the number of times `w` was counted: the
+  // smaller of its sketch estimate and, if it's tracked, its counter.
+  // An untracked word was seen no more often than the least counted
+  // tracked word.
+  //
+  unsigned long long getCount(dict* D, std::string_view w) {
+    unsigned long long h = hash64(w.data(),w.size());
+    unsigned long long estimate = sketchCount(D,h);
+    int slot = findSlot(D,w,h);
+    unsigned long long bound;
+    if (D->index[slot] != -1) {
+      bound = D->counters[D->index[slot]].count;
+    } else if (D->numTracked < D->numCounters) {
+      bound = 0;
+    } else {
+      bound = D->counters[D->heap[0]].count;
+    }
+    return bound < estimate ? bound : estimate;
+  }
+
+  // getError(D,w):
+  //
+  // Gives how far `getCount(D,w)` might exceed the true count of `w`.
+  // Only a tracked word has a known lower bound on its count.
+  //
+  unsigned long long getError(dict* D, std::string_view w) {
+    unsigned long long estimate = getCount(D,w);
+    int slot = findSlot(D,w,hash64(w.data(),w.size()));
+    if (D->index[slot] == -1) {
+      return estimate;
+    }
+    counter& c = D->counters[D->index[slot]];
+    unsigned long long atLeast = c.count - c.error;
+    return estimate > atLeast ? estimate - atLeast : 0;
+  }
+
+  // sketchError(D):
+  //
+  // Gives the overcount e*N/width that any sketch estimate stays within
+  // with probability at least 1-e^-depth.
+  //
+  unsigned long long sketchError(dict* D) {
+    return (unsigned long long)(2.718281828459045 * D->numIncrements / D->width + 1);
+  }
+
+  // ranksAbove(a,b):
+  //
+  // Whether counter `a` ranks above counter `b`: it has a higher count,
+  // or the same count and a word earlier in alphabetical order.
+  //
+  bool ranksAbove(const counter* a, const counter* b) {
+    return a->count > b->count || (a->count == b->count && a->word < b->word);
+  }
+
+  // topK(D,k):
+  //
+  // Gives back a new array of the `k` tracked words with the highest
+  // counts, highest first, each with its count and possible overcount.
+  // Those counts are first tightened by the sketch, as in `getCount`.
+  // It then selects them with a min-heap of size `k`, as `freq::topK`
+  // does.
+  //
+  counter* topK(dict* D, int k) {
+    if (k > D->numTracked) {
+      k = D->numTracked;
+    }
+    counter* result = new counter[k];
+    if (k == 0) {
+      return result;
+    }
+    counter* tightened = new counter[D->numTracked];
+    for (int j=0; j<D->numTracked; j++) {
+      counter& c = tightened[j];
+      c = D->counters[j];
+      unsigned long long estimate = sketchCount(D,c.hash);
+      if (estimate < c.count) {
+	unsigned long long over = c.count-estimate;
+	c.error = c.error > over ? c.error-over : 0;
+	c.count = estimate;
+      }
+    }
+
+    const counter** best = new const counter*[k];
+    int size = 0;
+    for (int j=0; j<D->numTracked; j++) {
+      const counter* c = &tightened[j];
+      int i;
+      if (size < k) {
+	i = size++;
+	while (i > 0 && ranksAbove(best[(i-1)/2],c)) {
+	  best[i] = best[(i-1)/2];
+	  i = (i-1)/2;
+	}
+	best[i] = c;
+      } else if (ranksAbove(c,best[0])) {
+	i = 0;
+	while (true) {
+	  int child = 2*i+1;
+	  if (child >= k) {
+	    break;
+	  }
+	  if (child+1 < k && ranksAbove(best[child],best[child+1])) {
+	    child++;
+	  }
+	  if (!ranksAbove(c,best[child])) {
+	    break;
+	  }
+	  best[i] = best[child];
+	  i = child;
+	}
+	best[i] = c;
+      }
+    }
+
+    //pop the worst remaining off the heap into the back of the result
+    for (int last=k-1; last>=0; last--) {
+      result[last] = *best[0];
+      const counter* moved = best[last];
+      int i = 0;
+      while (true) {
+	int child = 2*i+1;
+	if (child >= last) {
+	  break;
+	}
+	if (child+1 < last && ranksAbove(best[child],best[child+1])) {
+	  child++;
+	}
+	if (!ranksAbove(moved,best[child])) {
+	  break;
+	}
+	best[i] = best[child];
+	i = child;
+      }
+      best[i] = moved;
+    }
+    delete [] best;
+    delete [] tightened;
+    return result;
+  }
+
+  // destroy(D):
+  //
+  // Deletes all the heap-allocated components of `D`.
+  //
+  void destroy(dict* D) {
+    delete [] D->counters;
+    delete [] D->heap;
+    delete [] D->index;
+    delete [] D->sketch;
+    delete D;
+  }
+
+} // end namespace approx
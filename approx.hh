@@ -0,0 +1,110 @@
+#ifndef _APPROX_H
+#define _APPROX_H
+
+// approx.hh
+//
+// This defines an approximate word count dictionary `approx::dict*`
+// that works within a fixed memory budget, however long its input
+// stream and however many distinct words it holds.
+//
+// It combines two summaries of the stream, splitting the budget
+// between them:
+//
+//   * a Space-Saving summary that tracks a fixed number of words.
+//     When a new word arrives and every counter is taken, the word
+//     with the smallest count gives up its counter, and the newcomer
+//     inherits that count as its possible overcount. Any word seen
+//     more than N/m times in a stream of N words (with m counters) is
+//     guaranteed to be tracked, so the top words are always there.
+//
+//   * a Count-Min sketch, a few rows of counters indexed by different
+//     hashes of the word. A word's estimate is the smallest of its
+//     counters. It never undercounts, and with probability at least
+//     1-e^-depth it overcounts by no more than e*N/width.
+//
+// Every count it reports is an upper bound on the true count, paired
+// with how much it might exceed it.
+//
+
+#include <string>
+#include <string_view>
+
+namespace approx {
+
+  // counter
+  //
+  // A word tracked by the Space-Saving summary, or a report of one.
+  //
+  struct counter {
+
+    std::string word;  // The word being counted.
+
+    unsigned long long count; // An upper bound on how many times it was seen.
+
+    unsigned long long error; // How far `count` might be over: the word was
+			      // seen at least count-error times.
+
+    unsigned long long hash; // The full hash of `word`.
+
+    int position;      // Where this counter sits in the `heap`.
+  };
+
+  // dict
+  //
+  // The approximate dictionary of word/count estimates.
+  //
+  struct dict {
+
+    counter* counters; // The Space-Saving counters. The first
+		       // `numTracked` of them are in use.
+
+    int numCounters;   // How many counters there are.
+
+    int numTracked;    // How many of them hold a word so far.
+
+    int* heap;         // The indices of the tracked counters, as a
+		       // min-heap ordered by count, so the counter to
+		       // give up is always heap[0].
+
+    int* index;        // An open-addressing table from a word's hash
+		       // to its counter, or -1 for an empty slot.
+
+    int indexSize;     // The length of `index`; a power of two.
+
+    unsigned long long* sketch; // The Count-Min sketch: `depth` rows of
+				// `width` counters each, one after the other.
+
+    int width;         // The counters in each row of `sketch`.
+
+    int depth;         // The number of rows of `sketch`.
+
+    unsigned long long numIncrements; // Total count over all words. Number of
+				      // `increment` calls.
+  };
+
+  //
+  // The public interface to approx::dict objects.
+  //
+  dict* build(long budget);                     // Constructs a new `approx::dict` using about
+                                                // `budget` bytes.
+
+  int numTracked(dict* D);                      // Returns how many words the summary tracks.
+  unsigned long long totalCount(dict* D);       // Returns the number of `increment` calls made on `D`.
+
+  void increment(dict* D, std::string_view k);  // Counts one more occurrence of word `k` in `D`.
+
+  unsigned long long getCount(dict* D,          // Gives an upper bound on the count of word `k`.
+			      std::string_view k);
+  unsigned long long getError(dict* D,          // Gives how far `getCount(D,k)` might be over.
+			      std::string_view k);
+  unsigned long long sketchError(dict* D);      // Gives the overcount the sketch stays within
+                                                // with probability 1-e^-depth.
+
+  counter* topK(dict* D, int k);                // Gives back a new array of the `k` words of `D` with
+                                                // the highest counts, highest first.
+
+  void destroy(dict* D);                        // Returns the storage of `D` back to the heap.
+
+}
+
+#endif // _APPROX_H
@@ -0,0 +1,119 @@
+//
+// arena.cc
+//
+// This implements the arena `arena::pool*` described in "arena.hh":
+// taking chunks as pieces are handed out, and giving them all back.
+//
+// The functions it defines include
+//    * `arena::pool* arena::build(mem::part)`: build an empty pool
+//    * `void* arena::grow(arena::pool*,long)`: take a chunk for a piece
+//    * `const char* arena::copy(arena::pool*,const char*,int)`: pack a copy of some characters
+//    * `long arena::size(arena::pool*)`: get the bytes of the pool's chunks
+//    * `void arena::destroy(arena::pool*)`: give back every chunk
+//
+// `arena::allocate`, which hands out most pieces, is inline, in
+// "arena.hh".
+//
+
+#include <cstdlib>
+#include <cstring>
+#include "arena.hh"
+#include "mem.hh"
+
+namespace arena {
+
+  // build(p):
+  //
+  // Build a pool with no chunks, whose chunks will be counted against
+  // the part `p`.
+  //
+  pool* build(mem::part p) {
+    pool* newP = new pool;
+    newP->last      = nullptr;
+    newP->next      = nullptr;
+    newP->end       = nullptr;
+    newP->chunkSize = FIRST_CHUNK;
+    newP->held      = 0;
+    newP->part      = p;
+    return newP;
+  }
+
+  // take(P,size):
+  //
+  // Returns a new chunk of `size` bytes, counted as held by `P`.
+  //
+  chunk* take(pool* P, long size) {
+    chunk* c = static_cast<chunk*>(std::malloc(sizeof(chunk) + size));
+    c->size = size;
+    P->held += sizeof(chunk) + size;
+    mem::allocated(P->part,sizeof(chunk) + size);
+    return c;
+  }
+
+  // grow(P,bytes):
+  //
+  // Hands out `bytes` bytes from a new chunk, when the newest chunk of
+  // `P` hasn't enough left. The new chunk becomes the one pieces come
+  // from, and the next will be twice its size. A piece bigger than a
+  // whole chunk gets a chunk of its own instead, tucked behind the
+  // newest one so that the rest of that is still used.
+  //
+  // Chunks come from `malloc`, whose storage suits any type, and their
+  // headers keep that, so a piece at the start of one is aligned.
+  //
+  void* grow(pool* P, long bytes) {
+    if (bytes > P->chunkSize && P->last != nullptr) {
+      chunk* c = take(P,bytes);
+      c->previous = P->last->previous;
+      P->last->previous = c;
+      return c+1;
+    }
+    long size = bytes > P->chunkSize ? bytes : P->chunkSize;
+    chunk* c = take(P,size);
+    c->previous = P->last;
+    P->last = c;
+    P->next = reinterpret_cast<char*>(c+1) + bytes;
+    P->end = reinterpret_cast<char*>(c+1) + size;
+    if (P->chunkSize < MAX_CHUNK) {
+      P->chunkSize *= 2;
+    }
+    return c+1;
+  }
+
+  // copy(P,chars,length):
+  //
+  // Hands back a copy, made in `P`, of the `length` characters at
+  // `chars`, with a zero after them.
+  //
+  const char* copy(pool* P, const char* chars, int length) {
+    char* into = static_cast<char*>(allocate(P,length+1,1));
+    std::memcpy(into,chars,length);
+    into[length] = '\0';
+    return into;
+  }
+
+  // size(P):
+  //
+  // Returns how many bytes the chunks of `P` take, headers and all.
+  //
+  long size(pool* P) {
+    return P->held;
+  }
+
+  // destroy(P):
+  //
+  // Frees every chunk of `P`, then `P` itself. Whatever pieces were
+  // handed out go with them.
+  //
+  void destroy(pool* P) {
+    chunk* c = P->last;
+    while (c != nullptr) {
+      chunk* previous = c->previous;
+      std::free(c);
+      c = previous;
+    }
+    mem::freed(P->part,P->held);
+    delete P;
+  }
+
+} // end namespace arena
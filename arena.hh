@@ -0,0 +1,95 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+// arena.hh
+//
+// This defines an arena `arena::pool*` that hands out storage for the
+// many small pieces of a dictionary, such as its entries or the
+// characters of its words, by bumping a pointer through big chunks
+// taken from the heap. The pieces end up packed side by side, with no
+// header of the allocator's own between them, and are all given back
+// at once, a chunk at a time, when the pool is destroyed.
+//
+// A piece can't be freed on its own. A structure that drops pieces
+// and wants their room back keeps its own list of them to reuse.
+//
+// Each chunk is counted against the `mem::part` the pool was built
+// for, as it is taken and as it is given back (see "mem.hh").
+//
+
+#include "mem.hh"
+
+namespace arena {
+
+  // chunk
+  //
+  // One piece of heap storage carved up by a pool. Its bytes follow
+  // this header.
+  //
+  struct chunk {
+
+    chunk* previous;   // The chunk taken before this one, or nullptr.
+
+    long size;         // How many bytes follow the header.
+  };
+
+  // pool
+  //
+  // The chunks of one arena, and how far into the newest one it has
+  // handed out.
+  //
+  struct pool {
+
+    chunk* last;       // The newest chunk, which pieces come from, or nullptr.
+
+    char* next;        // The first byte of it not yet handed out,
+
+    char* end;         // and the byte just past its end.
+
+    long chunkSize;    // The size of the next chunk. It doubles with each
+		       // chunk taken, up to MAX_CHUNK.
+
+    long held;         // The bytes of all the chunks together.
+
+    mem::part part;    // What its chunks are counted against.
+  };
+
+  // The sizes of the first chunk of a pool and of its biggest ones.
+  // Each chunk is twice the last, so a small dictionary stays small
+  // and a big one takes few chunks, leaving at most one chunk's worth
+  // unused at its end.
+  const long FIRST_CHUNK = 4096;
+  const long MAX_CHUNK = 65536;
+
+  //
+  // The public interface to arena::pool objects.
+  //
+  pool* build(mem::part p);                     // Constructs a pool with no chunks yet.
+
+  void* grow(pool* P, long bytes);              // Takes a new chunk and hands out `bytes` from it.
+
+  // allocate(P,bytes,align):
+  //
+  // Hands out `bytes` bytes from `P`, starting at a multiple of `align`,
+  // which is a power of two. This is inline, as most pieces fit in the
+  // chunk at hand, and then it costs a few additions.
+  //
+  inline void* allocate(pool* P, long bytes, long align) {
+    char* at = reinterpret_cast<char*>((reinterpret_cast<unsigned long>(P->next) + align-1) & ~(align-1));
+    if (P->last == nullptr || bytes > P->end - at) {
+      return grow(P,bytes);
+    }
+    P->next = at + bytes;
+    return at;
+  }
+
+  const char* copy(pool* P, const char* chars,  // Hands back a copy of the `length` characters at `chars`,
+		   int length);                 // followed by a zero, packed in with the others of `P`.
+
+  long size(pool* P);                           // Returns how many bytes the chunks of `P` take.
+
+  void destroy(pool* P);                        // Returns every chunk of `P`, and `P`, back to the heap.
+
+}
+
+#endif // _ARENA_H
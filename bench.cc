@@ -0,0 +1,1920 @@
+//
+// bench.cc
+//
+// Measure how quickly the data structures behind `stats` and `chats`
+// do their work on some texts.
+//
+// Compile with: make benchmark   (or build and run it with: make bench)
+//
+// Usage: ./benchmark [--json] [section] [textfile.txt | synthetic:MB ...]
+//
+// The texts default to the two long novels bundled with this project.
+// A text named `synthetic:MB`, such as `synthetic:1024`, is made up on
+// the spot instead: about MB megabytes of words drawn by Zipf's law
+// from a vocabulary of `SYNTHETIC_WORDS`, the same every time, so that
+// the structures can be tried on texts far bigger than the novels.
+// The sections are
+//
+//    * token: scanning the text into words with `token::next`, with
+//      each of the scanning kernels this CPU supports. First each
+//      kernel is checked against the scalar one, on the text and on
+//      random bytes: if any finds different words, the benchmark says
+//      so and fails, as `make bench-token` does.
+//
+//    * e2e: the whole of what `stats` and `chats` do with the text,
+//      from its characters: tokenizing it while counting its words
+//      into a `freq::dict`, then `freq::dumpAndDestroy`; and
+//      tokenizing it while training a `gram::dict` as `chats` does,
+//      freezing it, and generating text laid out in lines as `chat`
+//      does. Only these two sections look at nothing but the text,
+//      so they can run on gigabytes of it; the others first copy out
+//      every word, at about 40 bytes a word.
+//
+//    * latency: the spread of the time of single `freq::increment`,
+//      `freq::getCount`, `gram::add` and `gram::get` calls over the
+//      words of the text, in the mean, the median, the 99th and 99.9th
+//      percentiles and the worst case.
+//
+//    * freq: `freq::increment`, `freq::getCount`, `freq::topK` of the
+//      100 most frequent words, `freq::snapshot` and
+//      `freq::dumpAndDestroy`, for each engine of `freq::dict`, and
+//      again for each of a `freq::compact`, whose counts are 32 bits
+//      (the variants `chained32` and `flat32`), and
+//      `approx::increment` and `approx::topK` within a 64 KB budget,
+//      and `window::push` and `window::topK` over the last 10000
+//      words, against ranking the window's counts with `freq::topK`.
+//
+//    * rehash: the worst-case time of a single `freq::increment` or
+//      `gram::add` while a table grows to millions of distinct keys,
+//      rehashing all at once versus incrementally.
+//
+//    * shared: the throughput of `increment` from 1 up to 64
+//      threads at once, sharing one `freq::dict` behind a single
+//      lock versus one lock-striped `cfreq::dict`.
+//
+//    * gram: training a `gram::dict` the way `chats` does, building
+//      its alias tables with `gram::finish`, and generating text by
+//      word IDs with `gram::pick`, against the string interface
+//      `gram::get`, and generating from it once `gram::freeze` has
+//      laid it out compactly; then the same for `ngram::model`s of
+//      orders 2, 3 and 5; then generating a batch of texts at once
+//      with `gram::generate` on 1, 2 and 4 threads.
+//
+//    * snap: writing a snapshot of the counts with `snap::save`,
+//      opening and checking it, `snap::getCount` on the mapped file,
+//      and `snap::merge` of two copies of it, per distinct word; then
+//      writing a trained chat model with `model::save` and opening and
+//      checking it, per key, generating from the mapped file, and
+//      `model::addTo` a dictionary to train further, per key.
+//
+//    * hash: how evenly the distinct words and word pairs of the text
+//      spread over a chained table's buckets, under the original
+//      base-32 `hashValue` with prime table sizes and under
+//      `hashing::hash64` with power-of-two sizes.
+//
+//    * mem: the bytes each structure holds, as counted by "mem.hh",
+//      per distinct word of a `freq::dict` and a `freq::compact` of
+//      each engine, and per key of a trained `gram::dict` and of it
+//      frozen. For the bundled
+//      novels these are held to the `BUDGETS` below: if any structure
+//      takes more bytes than its budget, the benchmark says so and
+//      fails, as `make bench-mem` does. It also checks that counting
+//      or training on words already there allocates nothing at all:
+//      that `freq::increment` and `freq::getCount`, and `gram::add`
+//      given the words as strings, only look them up.
+//
+// Without a section, all of them are run. Each timing is the best of
+// several rounds, reported in nanoseconds per operation. After each
+// text, the peak resident memory of the process so far is reported.
+//
+// With `--json`, every result is printed instead as one JSON object a
+// line, with the same fields and the throughput in operations a
+// second, and each carries the peak resident memory when it was
+// taken, for other programs to read. `make bench-json` writes them
+// all to `bench.jsonl`.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <sys/resource.h>
+#include "freq.hh"
+#include "cfreq.hh"
+#include "approx.hh"
+#include "window.hh"
+#include "snap.hh"
+#include "gram.hh"
+#include "model.hh"
+#include "ngram.hh"
+#include "rng.hh"
+#include "token.hh"
+#include "hash.hh"
+#include "mem.hh"
+
+// The number of times each measurement is repeated.
+const int ROUNDS = 5;
+
+// Whether results are printed as JSON lines rather than a table.
+bool jsonLines = false;
+
+// corpus
+//
+// A text, and its words copied out of it so that most timings leave
+// out the tokenizer.
+//
+struct corpus {
+  const char* name;    // The file the words came from, or `synthetic:MB`.
+  char* text;          // The characters of the text,
+  long size;           // and how many there are.
+  std::string* words;  // All of its words, in order, or nullptr if they
+		       // weren't copied out.
+  int numWords;        // How many there are.
+};
+
+// The number of distinct words synthetic texts are drawn from, how
+// many words usually follow each, and the seed that draws them.
+const int SYNTHETIC_WORDS = 100000;
+const int SYNTHETIC_FOLLOWERS = 8;
+const unsigned long long SYNTHETIC_SEED = 221;
+
+// synthesize(megabytes,size):
+//
+// Returns a new text of about `megabytes` MB, setting `size` to its
+// length. It is made of SYNTHETIC_WORDS made-up words of 1 to 9
+// letters, the word of rank r drawn with a chance in proportion to
+// 1/r, as Zipf's law has it of real texts. So that word pairs repeat
+// as they do in real texts, rather than nearly every pair being new,
+// each word has SYNTHETIC_FOLLOWERS words drawn that way to follow it,
+// one of which comes next 31 times in 32. Each word is followed by a
+// stopper one time in 16, and the lines are 12 words long.
+//
+char* synthesize(long megabytes, long& size) {
+  rng::stream r;
+  rng::seed(r,SYNTHETIC_SEED);
+  std::string* spelled = new std::string[SYNTHETIC_WORDS];
+  gram::follower* ranks = new gram::follower[SYNTHETIC_WORDS];
+  long long total = 0;
+  for (int i=0; i<SYNTHETIC_WORDS; i++) {
+    int length = 1 + rng::below(rng::next(r),4) + rng::below(rng::next(r),6);
+    for (int j=0; j<length; j++) {
+      spelled[i] += (char)('a' + rng::below(rng::next(r),26));
+    }
+    ranks[i] = gram::follower{(unsigned)i,100000000/(i+1)};
+    total += ranks[i].count;
+  }
+  //the words are drawn with the alias tables that `chats` uses
+  gram::choice* table = new gram::choice[SYNTHETIC_WORDS];
+  gram::buildAlias(ranks,SYNTHETIC_WORDS,total,table);
+  unsigned* followers = new unsigned[(long)SYNTHETIC_WORDS*SYNTHETIC_FOLLOWERS];
+  for (long i=0; i<(long)SYNTHETIC_WORDS*SYNTHETIC_FOLLOWERS; i++) {
+    unsigned long long x = rng::next(r);
+    const gram::choice& c = table[rng::below(x,SYNTHETIC_WORDS)];
+    followers[i] = rng::fraction(x) < c.chance ? c.word : c.alias;
+  }
+
+  long capacity = megabytes << 20;
+  char* text = new char[capacity+16];
+  size = 0;
+  int onLine = 0;
+  unsigned last = 0;
+  while (size < capacity) {
+    unsigned long long x = rng::next(r);
+    if (rng::below(x >> 32,32) != 0) {
+      last = followers[(long)last*SYNTHETIC_FOLLOWERS + rng::below(x,SYNTHETIC_FOLLOWERS)];
+    } else {
+      x = rng::next(r);
+      const gram::choice& c = table[rng::below(x,SYNTHETIC_WORDS)];
+      last = rng::fraction(x) < c.chance ? c.word : c.alias;
+    }
+    const std::string& w = spelled[last];
+    std::memcpy(text+size,w.data(),w.size());
+    size += w.size();
+    if (rng::below(rng::next(r),16) == 0) {
+      text[size++] = ' ';
+      text[size++] = '.';
+    }
+    onLine = (onLine+1) % 12;
+    text[size++] = onLine == 0 ? '\n' : ' ';
+  }
+  delete [] followers;
+  delete [] table;
+  delete [] ranks;
+  delete [] spelled;
+  return text;
+}
+
+// readAll(filename,size):
+//
+// Returns a new array holding all of the file `filename`, setting
+// `size` to its length. Returns nullptr when it can't be read.
+//
+char* readAll(const char* filename, long& size) {
+  std::FILE* in = std::fopen(filename,"rb");
+  if (in == nullptr) {
+    return nullptr;
+  }
+  std::fseek(in,0,SEEK_END);
+  size = std::ftell(in);
+  std::fseek(in,0,SEEK_SET);
+  char* text = new char[size > 0 ? size : 1];
+  bool ok = size >= 0 && (long)std::fread(text,1,size,in) == size;
+  std::fclose(in);
+  if (!ok) {
+    delete [] text;
+    return nullptr;
+  }
+  return text;
+}
+
+// load(filename,withWords):
+//
+// Reads the file `filename`, or makes up a synthetic text if it is
+// named `synthetic:MB`, into a new corpus. Copies out its words too if
+// `withWords` is true. Returns nullptr when it can't be read.
+//
+corpus* load(const char* filename, bool withWords) {
+  corpus* C = new corpus;
+  C->name = filename;
+  if (std::strncmp(filename,"synthetic:",10) == 0 && std::atol(filename+10) > 0) {
+    C->text = synthesize(std::atol(filename+10),C->size);
+  } else {
+    C->text = readAll(filename,C->size);
+  }
+  if (C->text == nullptr) {
+    delete C;
+    return nullptr;
+  }
+  C->words = nullptr;
+  C->numWords = 0;
+  if (!withWords) {
+    return C;
+  }
+
+  int capacity = 1024;
+  C->words = new std::string[capacity];
+  token::stream* text = token::view(C->text,C->size);
+  token::word w;
+  while (token::next(text,w)) {
+    if (C->numWords == capacity) {
+      std::string* bigger = new std::string[2*capacity];
+      for (int i=0; i<capacity; i++) {
+	bigger[i].swap(C->words[i]);
+      }
+      delete [] C->words;
+      C->words = bigger;
+      capacity *= 2;
+    }
+    C->words[C->numWords++] = token::toString(w);
+  }
+  token::close(text);
+  return C;
+}
+
+// peakKB():
+//
+// Returns the most memory the process has had resident at once so
+// far, in kilobytes.
+//
+long peakKB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  return usage.ru_maxrss;
+}
+
+// quoted(s):
+//
+// Returns `s` as a JSON string, in quotes and with any quotes,
+// backslashes and control characters in it escaped.
+//
+std::string quoted(const char* s) {
+  std::string q = "\"";
+  for (const char* c=s; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      q += '\\';
+      q += *c;
+    } else if ((unsigned char)*c < ' ') {
+      char escaped[8];
+      std::snprintf(escaped,sizeof(escaped),"\\u%04x",*c);
+      q += escaped;
+    } else {
+      q += *c;
+    }
+  }
+  return q + "\"";
+}
+
+// startJson(section,C,variant,operation):
+//
+// Prints the fields that begin every JSON line of results, leaving the
+// object open for the rest.
+//
+void startJson(const char* section, corpus* C, const char* variant, const char* operation) {
+  std::cout << "{\"section\":" << quoted(section)
+	    << ",\"corpus\":" << quoted(C->name)
+	    << ",\"variant\":" << quoted(variant)
+	    << ",\"operation\":" << quoted(operation);
+}
+
+// seconds():
+//
+// Returns the time on a steady clock, in seconds.
+//
+double seconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// report(section,C,variant,operation,best,ops):
+//
+// Prints one line of results: the time per operation given the best
+// time of `ops` operations.
+//
+void report(const char* section, corpus* C, const char* variant,
+	    const char* operation, double best, long ops) {
+  if (jsonLines) {
+    startJson(section,C,variant,operation);
+    std::cout << std::fixed << std::setprecision(1)
+	      << ",\"ops\":" << ops
+	      << ",\"ns_per_op\":" << (1e9*best/ops)
+	      << ",\"ops_per_sec\":" << (ops/best)
+	      << ",\"peak_rss_kb\":" << peakKB() << "}" << std::endl;
+    return;
+  }
+  std::cout << std::left << std::setw(8) << section
+	    << std::setw(22) << C->name
+	    << std::setw(10) << variant
+	    << std::setw(16) << operation
+	    << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+	    << (1e9*best/ops) << " ns/op" << std::endl;
+}
+
+// benchFreq(C,kind,name):
+//
+// Times counting the words of `C` with a `freq::dict` built using
+// the engine `kind`, then looking each of them up, then ranking them,
+// then dumping the sorted summary. The counts are of the type `Count`,
+// so the same can be timed for a `freq::compact`.
+//
+template <class Count>
+void benchFreq(corpus* C, freq::engine kind, const char* name) {
+  double bestIncrement = 1e30, bestGetCount = 1e30, bestDump = 1e30;
+  double bestTopK = 1e30, bestSnapshot = 1e30;
+  int numKeys = 0;
+  long checksum = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    freq::basic_dict<Count>* D = freq::build<Count>(9,2,kind);
+
+    double start = seconds();
+    for (int i=0; i<C->numWords; i++) {
+      freq::increment(D,C->words[i]);
+    }
+    double middle = seconds();
+    for (int i=0; i<C->numWords; i++) {
+      checksum += freq::getCount(D,C->words[i]);
+    }
+    double end = seconds();
+    delete [] freq::topK(D,100);
+    double ranked = seconds();
+    delete [] freq::snapshot(D);
+    double snapped = seconds();
+
+    numKeys = freq::numKeys(D);
+    freq::entry* es = freq::dumpAndDestroy(D);
+    double dumped = seconds();
+    delete [] es;
+
+    bestIncrement = std::min(bestIncrement,middle-start);
+    bestGetCount  = std::min(bestGetCount,end-middle);
+    bestTopK      = std::min(bestTopK,ranked-end);
+    bestSnapshot  = std::min(bestSnapshot,snapped-ranked);
+    bestDump      = std::min(bestDump,dumped-snapped);
+  }
+  report("freq",C,name,"increment",bestIncrement,C->numWords);
+  report("freq",C,name,"getCount",bestGetCount,C->numWords);
+  report("freq",C,name,"topK(100)",bestTopK,numKeys);
+  report("freq",C,name,"snapshot",bestSnapshot,numKeys);
+  report("freq",C,name,"dumpAndDestroy",bestDump,numKeys);
+  if (checksum == 0) {
+    std::cout << "(no words counted)" << std::endl;
+  }
+}
+
+// The memory budget of the `approx::dict` being measured.
+const long APPROX_BUDGET = 64*1024;
+
+// benchApprox(C):
+//
+// Times counting the words of `C` into an `approx::dict`, then
+// ranking the 100 it counted most.
+//
+void benchApprox(corpus* C) {
+  double bestIncrement = 1e30, bestTopK = 1e30;
+  int numTracked = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    approx::dict* D = approx::build(APPROX_BUDGET);
+    double start = seconds();
+    for (int i=0; i<C->numWords; i++) {
+      approx::increment(D,C->words[i]);
+    }
+    double middle = seconds();
+    delete [] approx::topK(D,100);
+    double end = seconds();
+    numTracked = approx::numTracked(D);
+    approx::destroy(D);
+    bestIncrement = std::min(bestIncrement,middle-start);
+    bestTopK = std::min(bestTopK,end-middle);
+  }
+  report("freq",C,"approx","increment",bestIncrement,C->numWords);
+  report("freq",C,"approx","topK(100)",bestTopK,numTracked);
+}
+
+// The size of the window being measured, and how often it reports.
+const int WINDOW_SIZE = 10000;
+const int WINDOW_EVERY = 1000;
+
+// benchWindow(C):
+//
+// Times pushing the words of `C` through a `window::dict`, asking it
+// for its top 10 every `WINDOW_EVERY` words. Those reports are timed
+// against ranking all of the window's counts each time instead.
+//
+void benchWindow(corpus* C) {
+  double bestPush = 1e30, bestTopK = 1e30, bestRanked = 1e30;
+  int numReports = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    window::dict* W = window::build(WINDOW_SIZE,10);
+    double reporting = 0.0, ranking = 0.0;
+    numReports = 0;
+    double start = seconds();
+    for (int i=0; i<C->numWords; i++) {
+      window::push(W,C->words[i]);
+      if ((i+1) % WINDOW_EVERY == 0) {
+	double before = seconds();
+	delete [] window::topK(W);
+	double middle = seconds();
+	delete [] freq::topK(W->counts,10);
+	double after = seconds();
+	reporting += middle-before;
+	ranking += after-middle;
+	numReports++;
+      }
+    }
+    double pushing = seconds()-start-reporting-ranking;
+    window::destroy(W);
+    bestPush = std::min(bestPush,pushing);
+    bestTopK = std::min(bestTopK,reporting);
+    bestRanked = std::min(bestRanked,ranking);
+  }
+  report("freq",C,"window","push",bestPush,C->numWords);
+  report("freq",C,"window","topK(10)",bestTopK,numReports);
+  report("freq",C,"window","freq::topK(10)",bestRanked,numReports);
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// PER-OPERATION LATENCY
+//
+
+// The number of distinct keys inserted when measuring rehash stalls.
+const int LATENCY_KEYS = 2000000;
+
+// The number of old buckets moved per operation in incremental mode.
+const int REHASH_STEP = 8;
+
+// nanoseconds():
+//
+// Returns the time on a steady clock, in nanoseconds.
+//
+long nanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// reportLatency(section,C,variant,operation,ns,n):
+//
+// Prints the mean, median, 99th and 99.9th percentile and the maximum
+// of the `n` operation times in `ns`. Sorts `ns`.
+//
+void reportLatency(const char* section, corpus* C, const char* variant,
+		   const char* operation, long* ns, int n) {
+  double total = 0;
+  for (int i=0; i<n; i++) {
+    total += ns[i];
+  }
+  std::sort(ns,ns+n);
+  if (jsonLines) {
+    startJson(section,C,variant,operation);
+    std::cout << std::fixed << std::setprecision(1)
+	      << ",\"ops\":" << n
+	      << ",\"mean_ns\":" << total/n
+	      << ",\"p50_ns\":" << ns[n/2]
+	      << ",\"p99_ns\":" << ns[(long)n*99/100]
+	      << ",\"p999_ns\":" << ns[(long)n*999/1000]
+	      << ",\"max_ns\":" << ns[n-1]
+	      << ",\"peak_rss_kb\":" << peakKB() << "}" << std::endl;
+    return;
+  }
+  std::cout << std::left << std::setw(8) << section
+	    << std::setw(22) << C->name
+	    << std::setw(14) << variant
+	    << std::setw(10) << operation
+	    << std::right << std::fixed << std::setprecision(1)
+	    << " mean " << std::setw(7) << total/n
+	    << "  p50 " << std::setw(7) << ns[n/2]
+	    << "  p99 " << std::setw(7) << ns[(long)n*99/100]
+	    << "  p99.9 " << std::setw(7) << ns[(long)n*999/1000]
+	    << "  max " << std::setw(10) << ns[n-1] << " ns" << std::endl;
+}
+
+// manyKeys(C,howMany):
+//
+// Returns a new array of `howMany` distinct keys made by numbering
+// the words of `C`.
+//
+std::string* manyKeys(corpus* C, int howMany) {
+  std::string* keys = new std::string[howMany];
+  for (int i=0; i<howMany; i++) {
+    keys[i] = C->words[i % C->numWords] + std::to_string(i);
+  }
+  return keys;
+}
+
+// benchRehash(C):
+//
+// Times each of `LATENCY_KEYS` insertions of new keys into a chained
+// `freq::dict` and a `gram::dict`, first growing them all at once and
+// then incrementally.
+//
+void benchRehash(corpus* C) {
+  std::string* keys = manyKeys(C,LATENCY_KEYS);
+  long* ns = new long[LATENCY_KEYS];
+
+  for (int step=0; step<=REHASH_STEP; step+=REHASH_STEP) {
+    const char* variant = step == 0 ? "all-at-once" : "incremental";
+
+    freq::dict* D = freq::build(9,2);
+    freq::setRehashStep(D,step);
+    for (int i=0; i<LATENCY_KEYS; i++) {
+      long start = nanoseconds();
+      freq::increment(D,keys[i]);
+      ns[i] = nanoseconds()-start;
+    }
+    reportLatency("rehash",C,variant,"increment",ns,LATENCY_KEYS);
+    delete [] freq::dumpAndDestroy(D);
+
+    gram::dict* G = gram::build(9,2);
+    gram::setRehashStep(G,step);
+    for (int i=0; i<LATENCY_KEYS; i++) {
+      long start = nanoseconds();
+      gram::add(G,keys[i],C->words[i % C->numWords]);
+      ns[i] = nanoseconds()-start;
+    }
+    reportLatency("rehash",C,variant,"add",ns,LATENCY_KEYS);
+    gram::destroy(G);
+  }
+
+  delete [] ns;
+  delete [] keys;
+}
+
+// The most calls of each kind timed one by one.
+const int LATENCY_OPS = 1000000;
+
+// benchLatency(C):
+//
+// Times each of the first `LATENCY_OPS` words of `C` (or all of them)
+// one by one as it is counted by `freq::increment`, then looked up by
+// `freq::getCount`, in a flat `freq::dict`; then as it is added with
+// `gram::add` after the two words before it, and generated after them
+// by `gram::get` once the alias tables are built. Each time includes
+// that of reading the clock, some tens of nanoseconds.
+//
+void benchLatency(corpus* C) {
+  int n = std::min(C->numWords,LATENCY_OPS);
+  long* ns = new long[n];
+
+  freq::dict* D = freq::build(9,2,freq::FLAT);
+  for (int i=0; i<n; i++) {
+    long start = nanoseconds();
+    freq::increment(D,C->words[i]);
+    ns[i] = nanoseconds()-start;
+  }
+  reportLatency("latency",C,"flat","increment",ns,n);
+  long found = 0;
+  for (int i=0; i<n; i++) {
+    long start = nanoseconds();
+    found += freq::getCount(D,C->words[i]);
+    ns[i] = nanoseconds()-start;
+  }
+  reportLatency("latency",C,"flat","getCount",ns,n);
+  delete [] freq::dumpAndDestroy(D);
+
+  gram::dict* G = gram::build(9,2);
+  std::string w1 = ".";
+  std::string w2 = "";
+  for (int i=0; i<n; i++) {
+    long start = nanoseconds();
+    gram::add(G,w1,w2,C->words[i]);
+    ns[i] = nanoseconds()-start;
+    w1.swap(w2);
+    w2 = C->words[i];
+  }
+  reportLatency("latency",C,"strings","add",ns,n);
+  gram::finish(G);
+  rng::stream r;
+  rng::seed(r,0);
+  w1 = ".";
+  w2 = "";
+  for (int i=0; i<n; i++) {
+    long start = nanoseconds();
+    std::string next = gram::get(G,w1,w2,r);
+    ns[i] = nanoseconds()-start;
+    found += next.length();
+    w1.swap(w2);
+    w2 = C->words[i];
+  }
+  reportLatency("latency",C,"strings","get",ns,n);
+  gram::destroy(G);
+
+  if (found == 0) {
+    std::cout << "(no words found)" << std::endl;
+  }
+  delete [] ns;
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// SHARED COUNTING FROM MANY THREADS
+//
+
+// The most threads the concurrent benchmark runs, doubling from one.
+const int MAX_THREADS = 64;
+
+// The number of stripes in the `cfreq::dict` being measured.
+const int NUM_STRIPES = 64;
+
+// lockedDict
+//
+// The simplest way to share a `freq::dict`: one lock around all of it.
+//
+struct lockedDict {
+  std::mutex lock;
+  freq::dict* table;
+};
+
+// countSlice(C,L,S,from,to):
+//
+// Counts words `from` up to `to` of `C` into whichever one of `L` or
+// `S` isn't null. Run by each thread of `benchConcurrent`.
+//
+void countSlice(corpus* C, lockedDict* L, cfreq::dict* S, int from, int to) {
+  for (int i=from; i<to; i++) {
+    if (L != nullptr) {
+      std::lock_guard<std::mutex> hold(L->lock);
+      freq::increment(L->table,C->words[i]);
+    } else {
+      cfreq::increment(S,C->words[i]);
+    }
+  }
+}
+
+// benchConcurrent(C,striped):
+//
+// Times counting the words of `C` into one shared dictionary, split
+// into contiguous slices over 1, 2, 4, ... `MAX_THREADS` threads. The
+// words keep the order of the text, so the common ones are wanted by
+// every thread at once. Reports the wall time per word, i.e. the
+// inverse of the combined throughput.
+//
+void benchConcurrent(corpus* C, bool striped) {
+  const char* variant = striped ? "striped" : "locked";
+  std::thread* workers = new std::thread[MAX_THREADS];
+  for (int numThreads=1; numThreads<=MAX_THREADS; numThreads*=2) {
+    double best = 1e30;
+    for (int round=0; round<ROUNDS; round++) {
+      lockedDict* L = nullptr;
+      cfreq::dict* S = nullptr;
+      if (striped) {
+	S = cfreq::build(9,NUM_STRIPES);
+      } else {
+	L = new lockedDict;
+	L->table = freq::build(9,2,freq::FLAT);
+      }
+
+      double start = seconds();
+      for (int t=0; t<numThreads; t++) {
+	long from = (long)C->numWords*t/numThreads;
+	long to = (long)C->numWords*(t+1)/numThreads;
+	workers[t] = std::thread(countSlice,C,L,S,(int)from,(int)to);
+      }
+      for (int t=0; t<numThreads; t++) {
+	workers[t].join();
+      }
+      best = std::min(best,seconds()-start);
+
+      unsigned long long total = striped ? cfreq::totalCount(S) : freq::totalCount(L->table);
+      if (total != (unsigned long long)C->numWords) {
+	std::cout << "(lost counts: " << total << " of " << C->numWords << ")" << std::endl;
+      }
+      if (striped) {
+	cfreq::destroy(S);
+      } else {
+	freq::destroy(L->table);
+	delete L;
+      }
+    }
+    std::string operation = "increment x" + std::to_string(numThreads);
+    report("shared",C,variant,operation.c_str(),best,C->numWords);
+  }
+  delete [] workers;
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// GENERATING TEXT
+//
+
+// The number of words generated when timing `gram::pick` and `gram::get`.
+const int GENERATED = 1000000;
+
+// benchGram(C):
+//
+// Times training a `gram::dict` on `C` the way `chats` does, looking up
+// each word's ID once, then building its alias tables, then generating
+// `GENERATED` words from it, by word IDs and through the string
+// interface that looks the words up again for every word. Then times
+// freezing it and generating by word IDs from the frozen dictionary.
+//
+void benchGram(corpus* C) {
+  double bestTrain = 1e30, bestFinish = 1e30, bestPick = 1e30, bestGet = 1e30;
+  double bestFreeze = 1e30, bestFrozen = 1e30;
+  long letters = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    double start = seconds();
+    gram::dict* d = gram::build(9,2);
+    unsigned w1 = gram::wordId(d,".");
+    unsigned w2 = gram::wordId(d,"");
+    //the text wraps around, so that every context the generator can
+    //reach has a follower, even at the end
+    for (int i=0; i<C->numWords+2; i++) {
+      const std::string& text = C->words[i % C->numWords];
+      unsigned w = gram::wordId(d,text.data(),text.length());
+      gram::add(d,gram::key(w1,w2),w);
+      gram::add(d,gram::key(w1),w2);
+      w1 = w2;
+      w2 = w;
+    }
+    double trained = seconds();
+    gram::finish(d);
+    double finished = seconds();
+
+    rng::stream r;
+    rng::seed(r,round);
+    double before = seconds();
+    unsigned one = gram::pick(d,gram::key(gram::wordId(d,".")),r);
+    unsigned two = gram::pick(d,gram::key(gram::wordId(d,"."),one),r);
+    for (int i=0; i<GENERATED; i++) {
+      unsigned next = gram::pick(d,gram::key(one,two),r);
+      letters += gram::word(d,next).length();
+      one = two;
+      two = next;
+    }
+    double picked = seconds();
+
+    rng::seed(r,round);
+    std::string oneStr = gram::get(d,".",r);
+    std::string twoStr = gram::get(d,".",oneStr,r);
+    for (int i=0; i<GENERATED; i++) {
+      std::string next = gram::get(d,oneStr,twoStr,r);
+      letters += next.length();
+      oneStr.swap(twoStr);
+      twoStr.swap(next);
+    }
+    double got = seconds();
+
+    gram::frozen* f = gram::freeze(d);
+    double frozen = seconds();
+    rng::seed(r,round);
+    one = gram::pick(f,gram::key(gram::wordId(f,".")),r);
+    two = gram::pick(f,gram::key(gram::wordId(f,"."),one),r);
+    for (int i=0; i<GENERATED; i++) {
+      unsigned next = gram::pick(f,gram::key(one,two),r);
+      letters += gram::word(f,next).length();
+      one = two;
+      two = next;
+    }
+    double after = seconds();
+
+    gram::destroy(f);
+    bestTrain = std::min(bestTrain,trained-start);
+    bestFinish = std::min(bestFinish,finished-trained);
+    bestPick = std::min(bestPick,picked-before);
+    bestGet = std::min(bestGet,got-picked);
+    bestFreeze = std::min(bestFreeze,frozen-got);
+    bestFrozen = std::min(bestFrozen,after-frozen);
+  }
+  report("gram",C,"ids","train",bestTrain,C->numWords);
+  report("gram",C,"ids","finish",bestFinish,C->numWords);
+  report("gram",C,"ids","pick",bestPick,GENERATED);
+  report("gram",C,"strings","get",bestGet,GENERATED);
+  report("gram",C,"frozen","freeze",bestFreeze,C->numWords);
+  report("gram",C,"frozen","pick",bestFrozen,GENERATED);
+  if (letters == 0) {
+    std::cout << "(nothing generated)" << std::endl;
+  }
+}
+
+// benchOrder<N>(C):
+//
+// Times training an order-N `ngram::model` on `C`, freezing it, and
+// generating `GENERATED` words from it with `ngram::pick`.
+//
+template<int N>
+void benchOrder(corpus* C) {
+  double bestTrain = 1e30, bestFreeze = 1e30, bestPick = 1e30;
+  long letters = 0;
+  const char* variant[] = { "", "order 1", "order 2", "order 3", "order 4", "order 5" };
+  for (int round=0; round<ROUNDS; round++) {
+    double start = seconds();
+    ngram::model<N>* m = ngram::build<N>();
+    unsigned recent[N];
+    for (int i=0; i<N; i++) {
+      recent[i] = ngram::wordId(m,".");
+    }
+    for (int i=0; i<C->numWords; i++) {
+      const std::string& text = C->words[i];
+      unsigned w = ngram::wordId(m,text.data(),text.length());
+      ngram::add(m,recent,w);
+      for (int j=0; j+1<N-1; j++) {
+	recent[j] = recent[j+1];
+      }
+      if (N > 1) {
+	recent[N-2] = w;
+      }
+    }
+    double trained = seconds();
+    ngram::freeze(m);
+    double frozen = seconds();
+
+    rng::stream r;
+    rng::seed(r,round);
+    for (int i=0; i<N; i++) {
+      recent[i] = ngram::wordId(m,".");
+    }
+    for (int i=0; i<GENERATED; i++) {
+      unsigned next = ngram::pick(m,recent,r);
+      letters += ngram::word(m,next).length();
+      for (int j=0; j+1<N-1; j++) {
+	recent[j] = recent[j+1];
+      }
+      if (N > 1) {
+	recent[N-2] = next;
+      }
+    }
+    double picked = seconds();
+
+    ngram::destroy(m);
+    bestTrain = std::min(bestTrain,trained-start);
+    bestFreeze = std::min(bestFreeze,frozen-trained);
+    bestPick = std::min(bestPick,picked-frozen);
+  }
+  report("gram",C,variant[N],"train",bestTrain,C->numWords);
+  report("gram",C,variant[N],"freeze",bestFreeze,C->numWords);
+  report("gram",C,variant[N],"pick",bestPick,GENERATED);
+  if (letters == 0) {
+    std::cout << "(nothing generated)" << std::endl;
+  }
+}
+
+// The batch generated when timing `gram::generate`: this many texts of
+// `BATCH_LENGTH` words, on up to `BATCH_THREADS` threads.
+const int BATCH_TEXTS = 64;
+const int BATCH_LENGTH = 10000;
+const int BATCH_THREADS = 4;
+
+// trainFrozen(C):
+//
+// Returns a new frozen dictionary trained on `C` the way `benchGram`
+// trains one.
+//
+gram::frozen* trainFrozen(corpus* C) {
+  gram::dict* d = gram::build(9,2);
+  unsigned w1 = gram::wordId(d,".");
+  unsigned w2 = gram::wordId(d,"");
+  for (int i=0; i<C->numWords+2; i++) {
+    const std::string& text = C->words[i % C->numWords];
+    unsigned w = gram::wordId(d,text.data(),text.length());
+    gram::add(d,gram::key(w1,w2),w);
+    gram::add(d,gram::key(w1),w2);
+    w1 = w2;
+    w2 = w;
+  }
+  return gram::freeze(d);
+}
+
+// benchBatch(C):
+//
+// Times generating a batch of texts at once with `gram::generate` from
+// a frozen dictionary trained on `C`, on 1, 2, ... `BATCH_THREADS`
+// threads. Reports the wall time per word, i.e. the inverse of the
+// combined throughput.
+//
+void benchBatch(corpus* C) {
+  gram::frozen* f = trainFrozen(C);
+  for (int threads=1; threads<=BATCH_THREADS; threads*=2) {
+    double best = 1e30;
+    for (int round=0; round<ROUNDS; round++) {
+      double start = seconds();
+      unsigned* words = gram::generate(f,BATCH_TEXTS,BATCH_LENGTH,round,threads);
+      best = std::min(best,seconds()-start);
+      delete [] words;
+    }
+    char variant[32];
+    std::snprintf(variant,sizeof(variant),"%d thread%s",threads,threads > 1 ? "s" : "");
+    report("gram",C,variant,"generate",best,(long)BATCH_TEXTS*BATCH_LENGTH);
+  }
+  gram::destroy(f);
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// SNAPSHOT FILES
+//
+
+// The files the snapshot benchmarks write, and remove when done.
+const char* SNAP_FILE = "benchmark.snap";
+const char* MERGED_FILE = "benchmark-merged.snap";
+const char* MODEL_FILE = "benchmark.model";
+
+// benchSnap(C):
+//
+// Times saving the counts of `C` as a snapshot, opening and verifying
+// it, looking up every word of `C` in it, and merging two copies of it.
+//
+void benchSnap(corpus* C) {
+  freq::dict* D = freq::build(9,2,freq::FLAT);
+  for (int i=0; i<C->numWords; i++) {
+    freq::increment(D,C->words[i]);
+  }
+  int numKeys = freq::numKeys(D);
+  double bestSave = 1e30, bestOpen = 1e30, bestGetCount = 1e30, bestMerge = 1e30;
+  long checksum = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    double start = seconds();
+    snap::save(D,SNAP_FILE);
+    double saved = seconds();
+    snap::file* F = snap::open(SNAP_FILE);
+    if (F == nullptr || !snap::verify(F)) {
+      std::cout << "(could not read back " << SNAP_FILE << ")" << std::endl;
+      break;
+    }
+    double opened = seconds();
+    for (int i=0; i<C->numWords; i++) {
+      checksum += snap::getCount(F,C->words[i]);
+    }
+    double looked = seconds();
+    snap::close(F);
+    const char* inputs[] = { SNAP_FILE, SNAP_FILE };
+    double before = seconds();
+    snap::merge(inputs,2,MERGED_FILE);
+    double merged = seconds();
+
+    bestSave     = std::min(bestSave,saved-start);
+    bestOpen     = std::min(bestOpen,opened-saved);
+    bestGetCount = std::min(bestGetCount,looked-opened);
+    bestMerge    = std::min(bestMerge,merged-before);
+  }
+  report("snap",C,"file","save",bestSave,numKeys);
+  report("snap",C,"file","open+verify",bestOpen,numKeys);
+  report("snap",C,"file","getCount",bestGetCount,C->numWords);
+  report("snap",C,"file","merge(2)",bestMerge,2*numKeys);
+  if (checksum == 0) {
+    std::cout << "(no words found)" << std::endl;
+  }
+  std::remove(SNAP_FILE);
+  std::remove(MERGED_FILE);
+  freq::destroy(D);
+}
+
+// benchModel(C):
+//
+// Times saving a frozen dictionary trained on `C` as a model file, and
+// opening and verifying it, per key; then generating `GENERATED` words
+// by word IDs from the mapped model, as `chats --model` does; then
+// adding its counts back into a `gram::dict` to train further, per key.
+//
+void benchModel(corpus* C) {
+  gram::frozen* f = trainFrozen(C);
+  double bestSave = 1e30, bestOpen = 1e30, bestPick = 1e30, bestAdd = 1e30;
+  long letters = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    double start = seconds();
+    model::save(f,MODEL_FILE);
+    double saved = seconds();
+    model::file* M = model::open(MODEL_FILE);
+    if (M == nullptr || !model::verify(M)) {
+      std::cout << "(could not read back " << MODEL_FILE << ")" << std::endl;
+      break;
+    }
+    double opened = seconds();
+    gram::frozen* m = model::frozen(M);
+    rng::stream r;
+    rng::seed(r,round);
+    unsigned one = gram::pick(m,gram::key(gram::wordId(m,".")),r);
+    unsigned two = gram::pick(m,gram::key(gram::wordId(m,"."),one),r);
+    for (int i=0; i<GENERATED; i++) {
+      unsigned next = gram::pick(m,gram::key(one,two),r);
+      letters += gram::word(m,next).length();
+      one = two;
+      two = next;
+    }
+    double picked = seconds();
+    gram::dict* d = gram::build(9,2);
+    model::addTo(M,d);
+    double added = seconds();
+    gram::destroy(d);
+    model::close(M);
+
+    bestSave = std::min(bestSave,saved-start);
+    bestOpen = std::min(bestOpen,opened-saved);
+    bestPick = std::min(bestPick,picked-opened);
+    bestAdd  = std::min(bestAdd,added-picked);
+  }
+  report("snap",C,"model","save",bestSave,f->numEntries);
+  report("snap",C,"model","open+verify",bestOpen,f->numEntries);
+  report("snap",C,"model","pick",bestPick,GENERATED);
+  report("snap",C,"model","addTo",bestAdd,f->numEntries);
+  if (letters == 0) {
+    std::cout << "(nothing generated)" << std::endl;
+  }
+  std::remove(MODEL_FILE);
+  gram::destroy(f);
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// FROM THE TEXT ITSELF
+//
+
+// sameTokens(text,size,k):
+//
+// Scans a copy of the `size` bytes at `text` with the scalar kernel,
+// and another copy with the kernel `k`, and returns whether they give
+// the same words: starting at the same places, just as long, and
+// lowercased alike. Says where they first differ if they don't.
+//
+bool sameTokens(const char* text, long size, token::kernel k) {
+  char* mine = new char[size > 0 ? size : 1];
+  char* theirs = new char[size > 0 ? size : 1];
+  std::memcpy(mine,text,size);
+  std::memcpy(theirs,text,size);
+  token::stream* reference = token::view(mine,size);
+  reference->scanner = token::SCALAR;
+  token::stream* other = token::view(theirs,size);
+  other->scanner = k;
+  token::word w, v;
+  long numWords = 0;
+  bool same = true;
+  while (same) {
+    bool more = token::next(reference,w);
+    if (more != token::next(other,v)) {
+      same = false;
+    } else if (!more) {
+      break;
+    } else {
+      same = w.start-mine == v.start-theirs && token::toView(w) == token::toView(v);
+      numWords++;
+    }
+  }
+  if (!same) {
+    std::cerr << "The " << token::kernelName(k) << " kernel differs from the scalar one at word "
+	      << numWords << " of a text of " << size << " bytes." << std::endl;
+  }
+  token::close(reference);
+  token::close(other);
+  delete [] mine;
+  delete [] theirs;
+  return same;
+}
+
+// The number of random texts `kernelsAgreeOnRandom` tries, and the
+// seed that makes them.
+const int RANDOM_TEXTS = 2000;
+const unsigned long long RANDOM_SEED = 0x746f6b656eULL;
+
+// kernelsAgreeOnRandom():
+//
+// Checks every kernel the CPU supports against the scalar one on
+// random texts of up to a few hundred bytes, so that words and
+// stoppers fall at every offset of a register and across the ends of
+// the text, and on a few of a megabyte. Half their bytes are any byte
+// at all, and half are letters of either case, apostrophes, stoppers
+// and spaces, so that words are common. Returns whether all agree.
+//
+bool kernelsAgreeOnRandom() {
+  const char common[] = "abcxyzABCXYZ'.!? \n";
+  rng::stream r;
+  rng::seed(r,RANDOM_SEED);
+  bool agree = true;
+  for (int t=0; t<RANDOM_TEXTS && agree; t++) {
+    long size = t < RANDOM_TEXTS-4 ? rng::below(rng::next(r),300) : 1L << 20;
+    char* text = new char[size > 0 ? size : 1];
+    for (long i=0; i<size; i++) {
+      unsigned long long x = rng::next(r);
+      text[i] = (x & 1) ? (char)(x >> 8) : common[rng::below(x >> 8,sizeof(common)-1)];
+    }
+    for (int k=token::SCALAR+1; k<=token::bestKernel(); k++) {
+      agree = sameTokens(text,size,(token::kernel)k) && agree;
+    }
+    delete [] text;
+  }
+  return agree;
+}
+
+// benchToken(C):
+//
+// Times scanning the whole text of `C` into words with each kernel the
+// CPU supports, per word, after checking that each gives the same
+// words as the scalar kernel. Returns whether they all do.
+//
+bool benchToken(corpus* C) {
+  bool agree = true;
+  for (int k=token::SCALAR+1; k<=token::bestKernel(); k++) {
+    agree = sameTokens(C->text,C->size,(token::kernel)k) && agree;
+  }
+  for (int k=token::SCALAR; k<=token::bestKernel(); k++) {
+    double best = 1e30;
+    long numWords = 0;
+    long letters = 0;
+    for (int round=0; round<ROUNDS; round++) {
+      double start = seconds();
+      token::stream* text = token::view(C->text,C->size);
+      text->scanner = (token::kernel)k;
+      token::word w;
+      numWords = 0;
+      while (token::next(text,w)) {
+	numWords++;
+	letters += w.length;
+      }
+      token::close(text);
+      best = std::min(best,seconds()-start);
+    }
+    report("token",C,token::kernelName((token::kernel)k),"next",best,numWords > 0 ? numWords : 1);
+    if (letters == 0) {
+      std::cout << "(no words found)" << std::endl;
+    }
+  }
+  return agree;
+}
+
+// layOut(out,w,width):
+//
+// Adds the word `w` to the text `out` the way `chat` prints it, with
+// no space before a stopper and lines of no more than 60 characters,
+// `width` of which the last line has so far.
+//
+void layOut(std::string& out, const std::string& w, int& width) {
+  if (w == "." || w == "!" || w == ",") {
+    out += w;
+    width += w.length();
+    return;
+  }
+  if (width + 1 + (int)w.length() > 60) {
+    out += '\n';
+    width = 0;
+  }
+  out += ' ';
+  out += w;
+  width += 1 + w.length();
+}
+
+// trainText(C):
+//
+// Returns a new `gram::dict` trained on the text of `C`, tokenizing it
+// as it goes, just as `chats` trains one.
+//
+gram::dict* trainText(corpus* C) {
+  token::stream* text = token::view(C->text,C->size);
+  gram::dict* d = gram::build(9,2);
+  unsigned w1 = gram::wordId(d,".");
+  unsigned w2 = gram::wordId(d,"");
+  token::word w;
+  while (token::next(text,w)) {
+    unsigned id = gram::wordId(d,w.start,w.length);
+    gram::add(d,gram::key(w1,w2),id);
+    gram::add(d,gram::key(w1),w2);
+    w1 = w2;
+    w2 = id;
+  }
+  gram::add(d,gram::key(w1),w2);
+  gram::add(d,gram::key(w1,w2),gram::wordId(d,"."));
+  gram::add(d,gram::key(w2),gram::wordId(d,"."));
+  token::close(text);
+  return d;
+}
+
+// countText(C,kind):
+//
+// Returns a new `freq::dict` using the engine `kind` of the words of
+// the text of `C`, tokenizing it as it goes, just as `stats` counts
+// them. Given `Count`, it is a dictionary of that width instead.
+//
+template <class Count = std::uint64_t>
+freq::basic_dict<Count>* countText(corpus* C, freq::engine kind) {
+  token::stream* text = token::view(C->text,C->size);
+  freq::basic_dict<Count>* D = freq::build<Count>(9,2,kind);
+  token::word w;
+  while (token::next(text,w)) {
+    freq::increment(D,token::toView(w));
+  }
+  token::close(text);
+  return D;
+}
+
+// benchEndToEnd(C):
+//
+// Times what `stats` does with the text of `C`: tokenizing it while
+// counting its words into a flat `freq::dict`, then dumping the sorted
+// summary. Then what `chats` does: tokenizing it while training a
+// `gram::dict` by word IDs, freezing it, and generating `GENERATED`
+// words laid out in lines. All per word of the text, but generating,
+// which is per word generated.
+//
+void benchEndToEnd(corpus* C) {
+  double bestCount = 1e30, bestDump = 1e30;
+  double bestTrain = 1e30, bestFreeze = 1e30, bestChat = 1e30;
+  long numWords = 1;
+  long letters = 0;
+  for (int round=0; round<ROUNDS; round++) {
+    double start = seconds();
+    freq::dict* D = countText(C,freq::FLAT);
+    double counted = seconds();
+    numWords = std::max(1L,(long)freq::totalCount(D));
+    delete [] freq::dumpAndDestroy(D);
+    double dumped = seconds();
+
+    gram::dict* d = trainText(C);
+    double trained = seconds();
+    gram::frozen* f = gram::freeze(d);
+    double frozen = seconds();
+
+    rng::stream r;
+    rng::seed(r,round);
+    std::string out;
+    int width = 0;
+    unsigned one = gram::wordId(f,".");
+    unsigned two = one;
+    for (int i=0; i<GENERATED; i++) {
+      unsigned next = gram::pick(f,gram::key(one,two),r);
+      layOut(out,gram::word(f,next),width);
+      one = two;
+      two = next;
+    }
+    double chatted = seconds();
+    letters += out.length();
+    gram::destroy(f);
+
+    bestCount  = std::min(bestCount,counted-start);
+    bestDump   = std::min(bestDump,dumped-counted);
+    bestTrain  = std::min(bestTrain,trained-dumped);
+    bestFreeze = std::min(bestFreeze,frozen-trained);
+    bestChat   = std::min(bestChat,chatted-frozen);
+  }
+  report("e2e",C,"stats","count",bestCount,numWords);
+  report("e2e",C,"stats","dump",bestDump,numWords);
+  report("e2e",C,"stats","total",bestCount+bestDump,numWords);
+  report("e2e",C,"chats","train",bestTrain,numWords);
+  report("e2e",C,"chats","freeze",bestFreeze,numWords);
+  report("e2e",C,"chats","chat",bestChat,GENERATED);
+  if (letters == 0) {
+    std::cout << "(nothing generated)" << std::endl;
+  }
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// MEMORY
+//
+
+// How many times `operator new` was called while `countingNews` was
+// set. The benchmark replaces every form of the global `operator new`
+// and `operator delete`, for single objects and arrays, with ones that
+// count, to check that some calls allocate nothing; storage that
+// comes from `malloc` instead, as arena chunks do, shows up in the
+// accounts of "mem.hh".
+std::atomic<long> newsCounted(0);
+bool countingNews = false;
+
+// countedNew(bytes,align):
+//
+// Counts one call of `operator new`, if `countingNews`, and returns
+// `bytes` bytes from `malloc`, or from `aligned_alloc` for an `align`
+// beyond what `malloc` gives. Returns nullptr if there are none, for
+// the caller to throw or not.
+//
+void* countedNew(std::size_t bytes, std::size_t align) {
+  if (countingNews) {
+    newsCounted.fetch_add(1,std::memory_order_relaxed);
+  }
+  if (bytes == 0) {
+    bytes = 1;
+  }
+  if (align <= alignof(std::max_align_t)) {
+    return std::malloc(bytes);
+  }
+  return std::aligned_alloc(align,(bytes+align-1)/align*align);
+}
+
+void* countedNewOrThrow(std::size_t bytes, std::size_t align) {
+  void* p = countedNew(bytes,align);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(std::size_t bytes) {
+  return countedNewOrThrow(bytes,0);
+}
+
+void* operator new[](std::size_t bytes) {
+  return countedNewOrThrow(bytes,0);
+}
+
+void* operator new(std::size_t bytes, std::align_val_t align) {
+  return countedNewOrThrow(bytes,(std::size_t)align);
+}
+
+void* operator new[](std::size_t bytes, std::align_val_t align) {
+  return countedNewOrThrow(bytes,(std::size_t)align);
+}
+
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept {
+  return countedNew(bytes,0);
+}
+
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept {
+  return countedNew(bytes,0);
+}
+
+void* operator new(std::size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return countedNew(bytes,(std::size_t)align);
+}
+
+void* operator new[](std::size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return countedNew(bytes,(std::size_t)align);
+}
+
+//all of it comes from `malloc` or `aligned_alloc`, so `free` gives it back
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+// budget
+//
+// The most bytes a structure may hold per distinct word, or key, when
+// built from one of the bundled texts.
+//
+struct budget {
+  const char* corpus;   // The text,
+  const char* variant;  // the structure,
+  double bytes;         // and its bytes per word or key.
+};
+
+// The budgets are what each structure took when its layout last
+// changed, plus 1%. A change that takes less should lower them.
+const budget BUDGETS[] = {
+  { "hundred_years.txt", "flat",      84.0 },
+  { "hundred_years.txt", "flat32",    71.3 },
+  { "hundred_years.txt", "chained",   66.2 },
+  { "hundred_years.txt", "chained32", 59.8 },
+  { "hundred_years.txt", "trained",   73.3 },
+  { "hundred_years.txt", "frozen",    71.5 },
+  { "cien_anos.txt",     "flat",     107.8 },
+  { "cien_anos.txt",     "flat32",    90.1 },
+  { "cien_anos.txt",     "chained",   65.5 },
+  { "cien_anos.txt",     "chained32", 56.8 },
+  { "cien_anos.txt",     "trained",   70.2 },
+  { "cien_anos.txt",     "frozen",    65.6 },
+};
+
+// reportBytes(C,variant,per,n):
+//
+// Prints the bytes the structure `variant` built from `C` holds now
+// and held at most, as counted since `mem::track`, per each of its `n`
+// words or keys, named by `per`. Returns false if that is over the
+// structure's budget for `C`, if it has one.
+//
+bool reportBytes(corpus* C, const char* variant, const char* per, long n) {
+  n = std::max(1L,n);
+  double bytes = (double)mem::liveTotal/n;
+  double most = 0;
+  for (const budget& b : BUDGETS) {
+    if (std::strcmp(b.corpus,C->name) == 0 && std::strcmp(b.variant,variant) == 0) {
+      most = b.bytes;
+    }
+  }
+  bool within = most == 0 || bytes <= most;
+  if (jsonLines) {
+    startJson("mem",C,variant,per);
+    std::cout << std::fixed << std::setprecision(1)
+	      << ",\"count\":" << n
+	      << ",\"bytes\":" << mem::liveTotal
+	      << ",\"peak_bytes\":" << mem::peakTotal
+	      << ",\"bytes_per\":" << bytes
+	      << ",\"peak_bytes_per\":" << (double)mem::peakTotal/n;
+    if (most > 0) {
+      std::cout << ",\"budget\":" << most << ",\"within\":" << (within ? "true" : "false");
+    }
+    std::cout << "}" << std::endl;
+    return within;
+  }
+  std::cout << std::left << std::setw(8) << "mem"
+	    << std::setw(22) << C->name
+	    << std::setw(10) << variant
+	    << std::setw(16) << per
+	    << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+	    << bytes << " bytes, at most " << (double)mem::peakTotal/n;
+  if (most > 0) {
+    std::cout << (within ? "  (budget " : "  OVER BUDGET of ") << most << (within ? ")" : "");
+  }
+  std::cout << std::endl;
+  return within;
+}
+
+// reportAllocations(C,variant,operation,calls,news,bytes):
+//
+// Prints how many times `calls` calls of `operation` on the structure
+// `variant`, built from `C` and holding every word they are given,
+// called `operator new`, and by how many bytes its accounts grew.
+// Returns whether both are zero, as they should be.
+//
+bool reportAllocations(corpus* C, const char* variant, const char* operation,
+		       long calls, long news, long bytes) {
+  bool none = news == 0 && bytes == 0;
+  if (jsonLines) {
+    startJson("mem",C,variant,operation);
+    std::cout << ",\"count\":" << calls
+	      << ",\"allocations\":" << news
+	      << ",\"bytes\":" << bytes
+	      << ",\"within\":" << (none ? "true" : "false") << "}" << std::endl;
+    return none;
+  }
+  std::cout << std::left << std::setw(8) << "mem"
+	    << std::setw(22) << C->name
+	    << std::setw(10) << variant
+	    << std::setw(16) << operation
+	    << std::right << std::setw(10) << news << " allocations, "
+	    << bytes << " bytes over " << calls << " calls"
+	    << (none ? "" : "  SHOULD BE NONE") << std::endl;
+  return none;
+}
+
+// recountText(text,D):
+//
+// Counts each word of the stream `text` once more in `D`, straight
+// from the text, and takes it away again, so the counts of `D` stay as
+// they were. Returns how many words there were.
+//
+long recountText(token::stream* text, freq::dict* D) {
+  long calls = 0;
+  token::word w;
+  while (token::next(text,w)) {
+    freq::increment(D,token::toView(w));
+    freq::decrement(D,token::toView(w));
+    calls++;
+  }
+  return calls;
+}
+
+// allocationsOnRepeats(C,kind):
+//
+// Counts the words of the text of `C` into a `freq::dict` using the
+// engine `kind`, then counts each of them again, and looks each one
+// up, straight from the text, checking that no storage is allocated
+// for words already there. Returns whether none is.
+//
+// A count can still outgrow the histogram of counts, which then
+// doubles, so the words are recounted once before the check, and each
+// is taken away again after it is counted, so that no count goes any
+// higher than that.
+//
+bool allocationsOnRepeats(corpus* C, freq::engine kind) {
+  const char* variant = kind == freq::FLAT ? "flat" : "chained";
+  mem::track();
+  freq::dict* D = countText(C,kind);
+  token::stream* text = token::view(C->text,C->size);
+  recountText(text,D);
+  token::close(text);
+  text = token::view(C->text,C->size);
+  long live = mem::liveTotal;
+  newsCounted = 0;
+  countingNews = true;
+  long calls = recountText(text,D);
+  countingNews = false;
+  bool none = reportAllocations(C,variant,"increment again",calls,newsCounted,mem::liveTotal-live);
+  token::close(text);
+
+  text = token::view(C->text,C->size);
+  token::word w;
+  long found = 0;
+  live = mem::liveTotal;
+  newsCounted = 0;
+  countingNews = true;
+  while (token::next(text,w)) {
+    found += freq::getCount(D,token::toView(w));
+  }
+  countingNews = false;
+  none = reportAllocations(C,variant,"getCount",calls,newsCounted,mem::liveTotal-live) && none;
+  token::close(text);
+  freq::destroy(D);
+  return none && found > 0;
+}
+
+// allocationsOnRetraining(C):
+//
+// Trains a `gram::dict` on the text of `C`, then trains it on the text
+// again with `gram::add` given the words as strings, straight from the
+// text, checking that no storage is allocated the second time. The
+// words are views into the text of `C`, which stays where it is, so
+// the two before each word are still there to be given with it.
+//
+bool allocationsOnRetraining(corpus* C) {
+  mem::track();
+  gram::dict* d = trainText(C);
+  token::stream* text = token::view(C->text,C->size);
+  long calls = 0;
+  long live = mem::liveTotal;
+  std::string_view w1 = ".";
+  std::string_view w2 = "";
+  newsCounted = 0;
+  countingNews = true;
+  token::word w;
+  while (token::next(text,w)) {
+    std::string_view fw = token::toView(w);
+    gram::add(d,w1,w2,fw);
+    gram::add(d,w1,w2);
+    calls += 2;
+    w1 = w2;
+    w2 = fw;
+  }
+  countingNews = false;
+  bool none = reportAllocations(C,"trained","add again",calls,newsCounted,mem::liveTotal-live);
+  token::close(text);
+  gram::destroy(d);
+  return none;
+}
+
+// benchMemory(C):
+//
+// Counts the bytes held by a `freq::dict` of each engine, counting the
+// words of the text of `C` as `stats` does, per distinct word; then by
+// a `gram::dict` trained on it as `chats` does, and by that dictionary
+// frozen, per key. Then checks that counting and training on words
+// already there allocates nothing. Returns false if any structure is
+// over its budget, or anything was allocated.
+//
+bool benchMemory(corpus* C) {
+  bool within = true;
+  for (int k=0; k<2; k++) {
+    freq::engine kind = k == 0 ? freq::FLAT : freq::CHAINED;
+    mem::track();
+    freq::dict* D = countText(C,kind);
+    within = reportBytes(C,k == 0 ? "flat" : "chained","per word",freq::numKeys(D)) && within;
+    freq::destroy(D);
+    mem::track();
+    freq::compact* E = countText<std::uint32_t>(C,kind);
+    within = reportBytes(C,k == 0 ? "flat32" : "chained32","per word",freq::numKeys(E)) && within;
+    freq::destroy(E);
+  }
+  mem::track();
+  gram::dict* d = trainText(C);
+  within = reportBytes(C,"trained","per key",d->numEntries) && within;
+  gram::frozen* f = gram::freeze(d);
+  within = reportBytes(C,"frozen","per key",f->numEntries) && within;
+  gram::destroy(f);
+  within = allocationsOnRepeats(C,freq::FLAT) && within;
+  within = allocationsOnRepeats(C,freq::CHAINED) && within;
+  within = allocationsOnRetraining(C) && within;
+  mem::stop();
+  return within;
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// THE ORIGINAL HASH FUNCTION, KEPT FOR COMPARISON
+//
+
+// legacyIsPrime(n), legacyPrimeAtLeast(n):
+//
+// Return whether `n` is prime, and the smallest prime no smaller
+// than `n`.
+//
+bool legacyIsPrime(int n) {
+  if ((n <= 2) || (n % 2 == 0)) {
+    return (n == 2);
+  }
+  for (int d = 3; d*d <= n; d += 2) {
+    if (n % d == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int legacyPrimeAtLeast(int n) {
+  if (n <= 2) {
+    return 2;
+  }
+  int p = 3;
+  while (p < n || !legacyIsPrime(p)) {
+    p += 2;
+  }
+  return p;
+}
+
+// legacyHashValue(key,modulus):
+//
+// The base-32 Horner's method hash the tables used to use. Only
+// letters, the stoppers, the contraction mark and space are told
+// apart; every other byte counts as 0.
+//
+int legacyHashValue(const std::string& key, int modulus) {
+  int hashValue = 0;
+  for (char c: key) {
+    int value = 0;
+    if (c >= 'a' && c <= 'z') {
+      value = c - 'a' + 1;
+    } else if (c == '.') {
+      value = 27;
+    } else if (c == '!') {
+      value = 28;
+    } else if (c == '?') {
+      value = 29;
+    } else if (c == '\'') {
+      value = 30;
+    } else if (c == ' ') {
+      value = 31;
+    }
+    hashValue = (32*hashValue + value) % modulus;
+  }
+  return hashValue;
+}
+
+// distinctKeys(C,pairs,numKeys):
+//
+// Returns a new array of the distinct words of `C`, or of the
+// distinct pairs of adjacent words joined by a space, as `gram` keys
+// them. Sets `numKeys` to its length.
+//
+std::string* distinctKeys(corpus* C, bool pairs, int& numKeys) {
+  freq::dict* D = freq::build(9,2,freq::FLAT);
+  for (int i=0; i<C->numWords; i++) {
+    if (pairs && i > 0) {
+      freq::increment(D,C->words[i-1]+" "+C->words[i]);
+    } else if (!pairs) {
+      freq::increment(D,C->words[i]);
+    }
+  }
+  numKeys = freq::numKeys(D);
+  freq::entry* es = freq::dumpAndDestroy(D);
+  std::string* keys = new std::string[numKeys];
+  for (int i=0; i<numKeys; i++) {
+    keys[i].swap(es[i].word);
+  }
+  delete [] es;
+  return keys;
+}
+
+// reportSpread(C,keys,numKeys,scheme,numBuckets,index):
+//
+// Prints how the keys fall into `numBuckets` buckets given the bucket
+// `index` of each: the share of empty buckets, the longest chain, the
+// average number of keys compared by a successful search next to what
+// a perfectly random hash would give, and a histogram of chain lengths.
+//
+void reportSpread(corpus* C, const char* keyKind, int numKeys, const char* scheme,
+		  int numBuckets, const int* index) {
+  int* chain = new int[numBuckets]();
+  for (int i=0; i<numKeys; i++) {
+    chain[index[i]]++;
+  }
+  const int LONGEST = 8;
+  long histogram[LONGEST+1] = {0};
+  long comparisons = 0;
+  int longest = 0;
+  for (int b=0; b<numBuckets; b++) {
+    histogram[std::min(chain[b],LONGEST)]++;
+    comparisons += (long)chain[b]*(chain[b]+1)/2;
+    longest = std::max(longest,chain[b]);
+  }
+  delete [] chain;
+
+  if (jsonLines) {
+    startJson("hash",C,keyKind,scheme);
+    std::cout << std::fixed << std::setprecision(3)
+	      << ",\"keys\":" << numKeys
+	      << ",\"buckets\":" << numBuckets
+	      << ",\"empty_share\":" << (double)histogram[0]/numBuckets
+	      << ",\"longest\":" << longest
+	      << ",\"compares\":" << (double)comparisons/numKeys
+	      << ",\"random_compares\":" << 1.0 + (numKeys-1)/(2.0*numBuckets)
+	      << ",\"chains\":[";
+    for (int k=0; k<=LONGEST; k++) {
+      std::cout << (k > 0 ? "," : "") << histogram[k];
+    }
+    std::cout << "]}" << std::endl;
+    return;
+  }
+  std::cout << std::left << std::setw(8) << "hash"
+	    << std::setw(22) << C->name
+	    << std::setw(8) << keyKind
+	    << std::setw(8) << scheme
+	    << std::right << std::setw(8) << numKeys << " keys "
+	    << std::setw(7) << numBuckets << " buckets  "
+	    << std::fixed << std::setprecision(1)
+	    << std::setw(5) << (100.0*histogram[0]/numBuckets) << "% empty  longest "
+	    << std::setw(3) << longest << "  compares "
+	    << std::setprecision(2) << (double)comparisons/numKeys
+	    << " (random " << 1.0 + (numKeys-1)/(2.0*numBuckets) << ")  chains";
+  for (int k=0; k<=LONGEST; k++) {
+    std::cout << " " << histogram[k];
+  }
+  std::cout << std::endl;
+}
+
+// benchHash(C,pairs):
+//
+// Compares the spread of the original hash and `hashing::hash64` over
+// the distinct words (or word pairs) of `C`. Each table is sized the
+// way its `build` and `rehash` would leave it with a load factor of 2,
+// starting from an initial size of 9.
+//
+void benchHash(corpus* C, bool pairs) {
+  int numKeys;
+  std::string* keys = distinctKeys(C,pairs,numKeys);
+  const char* keyKind = pairs ? "pairs" : "words";
+  int* index = new int[numKeys];
+
+  int primeSize = legacyPrimeAtLeast(9);
+  while (numKeys/primeSize > 2) {
+    primeSize = legacyPrimeAtLeast(2*primeSize);
+  }
+  for (int i=0; i<numKeys; i++) {
+    index[i] = legacyHashValue(keys[i],primeSize);
+  }
+  reportSpread(C,keyKind,numKeys,"base32",primeSize,index);
+
+  int twoSize = hashing::powerOfTwoAtLeast(9);
+  while (numKeys/twoSize > 2) {
+    twoSize *= 2;
+  }
+  unsigned long long* full = new unsigned long long[numKeys];
+  for (int i=0; i<numKeys; i++) {
+    full[i] = hashing::hash64(keys[i]);
+    index[i] = full[i] & (twoSize-1);
+  }
+  reportSpread(C,keyKind,numKeys,"hash64",twoSize,index);
+
+  //distinct keys should essentially never share a full 64-bit hash
+  std::sort(full,full+numKeys);
+  int same = 0;
+  for (int i=1; i<numKeys; i++) {
+    same += (full[i] == full[i-1]);
+  }
+  if (jsonLines) {
+    startJson("hash",C,keyKind,"hash64");
+    std::cout << ",\"full_collisions\":" << same << "}" << std::endl;
+  } else {
+    std::cout << std::left << std::setw(8) << "hash" << std::setw(22) << C->name
+	      << std::setw(8) << keyKind << std::setw(8) << "hash64"
+	      << same << " full 64-bit collisions" << std::endl;
+  }
+
+  delete [] full;
+  delete [] index;
+  delete [] keys;
+}
+
+// main()
+//
+// Loads each text and runs the chosen benchmark sections on it.
+//
+int main(int argc, char **argv) {
+  int first = 1;
+  if (argc > first && std::strcmp(argv[first],"--json") == 0) {
+    jsonLines = true;
+    first++;
+  }
+  const char* section = "all";
+  if (argc > first && std::strchr(argv[first],'.') == nullptr && std::strchr(argv[first],':') == nullptr) {
+    section = argv[first];
+    first++;
+  }
+  const char* defaults[] = { "hundred_years.txt", "cien_anos.txt" };
+  const char** filenames = defaults;
+  int numFiles = 2;
+  if (argc > first) {
+    filenames = const_cast<const char**>(argv+first);
+    numFiles = argc-first;
+  }
+  bool all = std::strcmp(section,"all") == 0;
+  bool textOnly = std::strcmp(section,"token") == 0 || std::strcmp(section,"e2e") == 0
+    || std::strcmp(section,"mem") == 0;
+  bool withinBudget = true;
+  bool kernelsAgree = true;
+  if (all || std::strcmp(section,"token") == 0) {
+    kernelsAgree = kernelsAgreeOnRandom();
+  }
+
+  for (int f=0; f<numFiles; f++) {
+    corpus* C = load(filenames[f],!textOnly);
+    if (C == nullptr) {
+      std::cerr << "Could not open " << filenames[f] << "." << std::endl;
+      return 1;
+    }
+    if (all || std::strcmp(section,"token") == 0) {
+      kernelsAgree = benchToken(C) && kernelsAgree;
+    }
+    if (all || std::strcmp(section,"e2e") == 0) {
+      benchEndToEnd(C);
+    }
+    if (all || std::strcmp(section,"freq") == 0) {
+      benchFreq<std::uint64_t>(C,freq::CHAINED,"chained");
+      benchFreq<std::uint64_t>(C,freq::FLAT,"flat");
+      benchFreq<std::uint32_t>(C,freq::CHAINED,"chained32");
+      benchFreq<std::uint32_t>(C,freq::FLAT,"flat32");
+      benchApprox(C);
+      benchWindow(C);
+    }
+    if (all || std::strcmp(section,"rehash") == 0) {
+      benchRehash(C);
+    }
+    if (all || std::strcmp(section,"latency") == 0) {
+      benchLatency(C);
+    }
+    if (all || std::strcmp(section,"shared") == 0) {
+      benchConcurrent(C,false);
+      benchConcurrent(C,true);
+    }
+    if (all || std::strcmp(section,"gram") == 0) {
+      benchGram(C);
+      benchOrder<2>(C);
+      benchOrder<3>(C);
+      benchOrder<5>(C);
+      benchBatch(C);
+    }
+    if (all || std::strcmp(section,"snap") == 0) {
+      benchSnap(C);
+      benchModel(C);
+    }
+    if (all || std::strcmp(section,"hash") == 0) {
+      benchHash(C,false);
+      benchHash(C,true);
+    }
+    if (all || std::strcmp(section,"mem") == 0) {
+      withinBudget = benchMemory(C) && withinBudget;
+    }
+    if (jsonLines) {
+      startJson("rss",C,"process","peak");
+      std::cout << ",\"peak_rss_kb\":" << peakKB() << "}" << std::endl;
+    } else {
+      std::cout << std::left << std::setw(8) << "rss"
+		<< std::setw(22) << C->name
+		<< std::setw(10) << "process"
+		<< std::setw(16) << "peak"
+		<< std::right << std::setw(10) << peakKB() << " KB" << std::endl;
+    }
+    delete [] C->words;
+    delete [] C->text;
+    delete C;
+  }
+  if (!kernelsAgree) {
+    std::cerr << "Some scanning kernel finds different words than the scalar one." << std::endl;
+    return 1;
+  }
+  if (!withinBudget) {
+    std::cerr << "Some structure takes more bytes than its budget, or allocated where it shouldn't." << std::endl;
+    return 1;
+  }
+}
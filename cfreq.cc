@@ -0,0 +1,134 @@
+//
+// cfreq.cc
+//
+// This implements the concurrent word count dictionary `cfreq::dict*`
+// as an array of lock-striped `freq::dict` tables. See "cfreq.hh".
+//
+// The functions it defines include
+//    * `cfreq::dict* cfreq::build(int,int)`: build a concurrent word count dictionary
+//    * `unsigned long long cfreq::totalCount(cfreq::dict*)`: get the total word count
+//    * `int cfreq::numKeys(cfreq::dict*)`: get number of words
+//    * `void cfreq::increment(cfreq::dict*,std::string_view)`: bump a word's count
+//    * `unsigned long long cfreq::getCount(cfreq::dict*,std::string_view)`: get the count for a word
+//    * `freq::dict* cfreq::collect(cfreq::dict*)`: gather the counts into one `freq::dict`
+//    * `void cfreq::destroy(cfreq::dict*)`: give back the dictionary's storage
+//
+
+#include <string>
+#include <mutex>
+#include "cfreq.hh"
+#include "freq.hh"
+#include "hash.hh"
+
+namespace cfreq {
+
+  // stripeOf(D,h):
+  //
+  // Returns the stripe of `D` that a word with the hash `h` belongs to.
+  // It is chosen by the top bits of the hash, while the stripe's own
+  // table uses the bottom bits, so the two choices don't interfere,
+  // and the stripe's table is handed the same hash rather than
+  // computing it again.
+  //
+  stripe& stripeOf(dict* D, unsigned long long h) {
+    return D->stripes[D->stripeShift < 64 ? h >> D->stripeShift : 0];
+  }
+
+  // build(initialSize,numStripes):
+  //
+  // Build a concurrent word count dictionary that is roughly the given
+  // size, split into about `numStripes` stripes (rounded up to a power
+  // of two). More stripes mean less waiting between threads.
+  //
+  dict* build(int initialSize, int numStripes) {
+    dict* newD = new dict;
+    newD->numStripes = hashing::powerOfTwoAtLeast(numStripes < 1 ? 1 : numStripes);
+    newD->stripeShift = 64;
+    for (int n = newD->numStripes; n > 1; n /= 2) {
+      newD->stripeShift--;
+    }
+    newD->stripes = new stripe[newD->numStripes];
+    for (int i=0; i<newD->numStripes; i++) {
+      newD->stripes[i].table = freq::build(initialSize/newD->numStripes+1,2,freq::FLAT);
+    }
+    return newD;
+  }
+
+  // numKeys(D):
+  //
+  // Gives back the number of entries stored in the dictionary `D`,
+  // adding up the stripes one at a time.
+  //
+  int numKeys(dict* D) {
+    int total = 0;
+    for (int i=0; i<D->numStripes; i++) {
+      std::lock_guard<std::mutex> hold(D->stripes[i].lock);
+      total += freq::numKeys(D->stripes[i].table);
+    }
+    return total;
+  }
+
+  // totalCount(D):
+  //
+  // Gives back the total of the counts of all the entries in `D`.
+  //
+  unsigned long long totalCount(dict* D) {
+    unsigned long long total = 0;
+    for (int i=0; i<D->numStripes; i++) {
+      std::lock_guard<std::mutex> hold(D->stripes[i].lock);
+      total += freq::totalCount(D->stripes[i].table);
+    }
+    return total;
+  }
+
+  // increment(D,w):
+  //
+  // Adds one to the count associated with word `w` in `D`, possibly
+  // creating a new entry. Only the stripe of `w` is locked.
+  //
+  void increment(dict* D, std::string_view w) {
+    unsigned long long h = hashing::hash64(w.data(),w.size());
+    stripe& s = stripeOf(D,h);
+    std::lock_guard<std::mutex> hold(s.lock);
+    freq::incrementHashed(s.table,w,h);
+  }
+
+  // getCount(D,w):
+  //
+  // Gets the count associated with the word `w` in `D`.
+  //
+  unsigned long long getCount(dict* D, std::string_view w) {
+    unsigned long long h = hashing::hash64(w.data(),w.size());
+    stripe& s = stripeOf(D,h);
+    std::lock_guard<std::mutex> hold(s.lock);
+    return freq::getCountHashed(s.table,w,h);
+  }
+
+  // collect(D):
+  //
+  // Return a new `freq::dict` with the counts of every word in `D`.
+  // Each stripe is locked while it is copied.
+  //
+  freq::dict* collect(dict* D) {
+    freq::dict* all = freq::build(numKeys(D)+1,2,freq::FLAT);
+    for (int i=0; i<D->numStripes; i++) {
+      std::lock_guard<std::mutex> hold(D->stripes[i].lock);
+      freq::merge(all,D->stripes[i].table);
+    }
+    return all;
+  }
+
+  // destroy(D):
+  //
+  // Deletes all the heap-allocated components of `D`. No other thread
+  // may be using it.
+  //
+  void destroy(dict* D) {
+    for (int i=0; i<D->numStripes; i++) {
+      freq::destroy(D->stripes[i].table);
+    }
+    delete [] D->stripes;
+    delete D;
+  }
+
+} // end namespace cfreq
@@ -0,0 +1,75 @@
+#ifndef _CFREQ_H
+#define _CFREQ_H
+
+// cfreq.hh
+//
+// This defines a concurrent word count dictionary `cfreq::dict*`,
+// which many threads can `increment` at the same time.
+//
+// It is split into stripes. Each stripe is an ordinary `freq::dict`
+// guarded by its own lock, and a word always belongs to the stripe
+// picked by the top bits of its hash. Threads counting different
+// words rarely want the same stripe, so they seldom wait on each
+// other, and each stripe grows its own table under its own lock, so
+// resizing never stops the others. Nothing else is shared between
+// stripes, not even a running total, since one counter bumped by
+// every thread would be as contended as a single lock.
+//
+
+#include <string>
+#include <string_view>
+#include <mutex>
+#include "freq.hh"
+
+namespace cfreq {
+
+  // stripe
+  //
+  // One lock and the part of the dictionary it guards. Padded so
+  // that neighbouring stripes never share a cache line.
+  //
+  struct stripe {
+
+    std::mutex lock;    // Held while `table` is read or changed.
+
+    freq::dict* table;  // The words whose hashes pick this stripe.
+
+    char padding[128 - sizeof(std::mutex) - sizeof(freq::dict*)];
+  };
+
+  // dict
+  //
+  // The concurrent dictionary of word/count entries.
+  //
+  struct dict {
+
+    stripe* stripes;    // The array of stripes.
+
+    int numStripes;     // How many there are; a power of two.
+
+    int stripeShift;    // How far to shift a hash right to get the
+			// index of its stripe.
+  };
+
+  //
+  // The public interface to cfreq::dict objects. All but `build` and
+  // `destroy` may be called from any number of threads at once.
+  //
+  dict* build(int initialSize, int numStripes); // Constructs and returns a new `cfreq::dict`.
+
+  int numKeys(dict* D);                         // Returns the number of entries in `D`.
+  unsigned long long totalCount(dict* D);       // Returns the number of `increment` calls made on `D`.
+
+  void increment(dict* D, std::string_view k);  // Updates the count of a word `k` in `D`.
+
+  unsigned long long getCount(dict* D,          // Gets the count of word `k` in `D`.
+			      std::string_view k);
+
+  freq::dict* collect(dict* D);                 // Gives back a new `freq::dict` holding all the counts
+                                                // of `D`, e.g. for `freq::topK`.
+
+  void destroy(dict* D);                        // Returns the storage of `D` back to the heap.
+
+}
+
+#endif // _CFREQ_H
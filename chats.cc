@@ -1,106 +1,239 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <ctime>
+#include <fstream>
 #include "gram.hh"
+#include "ngram.hh"
+#include "model.hh"
+#include "rng.hh"
+#include "token.hh"
+#include "meter.hh"
+#include "mem.hh"
 
-// next_word_in(line):
+// The highest order of model that `-n` can ask for.
+const int MAX_ORDER = 5;
+
+// The size of the blocks of STDIN split among threads by `-j`.
+const long PARALLEL_BLOCK = 64L << 20;
+
+// train_chat(text):
 //
-// Process the characters of the std::string object 'line', seeking
-// the next contiguous sequence of letters within that string.
+// Returns a new dictionary of word/bigram followers built using the
+// structure of the words in `text`.
 //
-// Once it has processed that next word, it modifies 'line' to exclude
-// the prefix of processed characters from it, and returns that next
-// word as a string. The word will be a string of lowercase alphabetic
-// characters.
+gram::dict* train_chat(token::stream* text) {
+  gram::dict *d = gram::build(9,2); //we give our hashtable a load factor of 2
+  // Words are handled by their IDs, each looked up once as it is read.
+  unsigned w1 = gram::wordId(d,".");
+  unsigned w2 = gram::wordId(d,"");
+  unsigned w;
+  // Read until the end of text entry.
+  token::word next;
+  while (token::next(text,next)) {
+    w = gram::wordId(d,next.start,next.length);
+    gram::add(d,gram::key(w1,w2),w); // Add a follower `w` for the bigram words `w1` and `w2`.
+    gram::add(d,gram::key(w1),w2);   // Add a follower `w2` for the word `w1`.
+    w1 = w2;
+    w2 = w;
+  }
+  gram::add(d,gram::key(w1),w2);                      // Add the last word as a follower.
+  gram::add(d,gram::key(w1,w2),gram::wordId(d,"."));  // Include the last word as preceding a stopper `.`.
+  gram::add(d,gram::key(w2),gram::wordId(d,"."));     // And on its own, so that every word has a follower.
+  return d;
+}
+
+// piece
 //
-// It returns the empty string once the line has been fully processed.
+// One thread's share of a block of text, and what it leaves for the
+// main thread to stitch to the pieces on either side.
 //
-std::string next_word_in(std::string &line) {
-  std::string word = "";
-  int i;
-  for (i=0; i < line.size(); i++) {
-    char c = line[i];
+struct piece {
+  gram::dict* shard;   // The dictionary the thread trains, kept across blocks.
+  char* text;          // The characters of the piece,
+  long size;           // and how many there are.
+  long numWords;       // How many words the piece has.
+  unsigned first[2];   // The IDs in `shard` of its first two words,
+  unsigned last[2];    // and of its last two.
+};
 
-    // Make letters lowercase.
-    if ('A' <= c && c <= 'Z') {
-      c = c+32;
+// train_piece(p):
+//
+// Trains the shard of piece `p` on every word of it but the first two.
+// Those need the two words before the piece, so they are left to
+// `stitch`.
+//
+void train_piece(piece* p) {
+  token::stream* text = token::view(p->text,p->size);
+  unsigned w1 = vocab::NONE;
+  unsigned w2 = vocab::NONE;
+  p->numWords = 0;
+  token::word next;
+  while (token::next(text,next)) {
+    unsigned w = gram::wordId(p->shard,next.start,next.length);
+    if (p->numWords < 2) {
+      p->first[p->numWords] = w;
+    } else {
+      gram::add(p->shard,gram::key(w1,w2),w);
+      gram::add(p->shard,gram::key(w1),w2);
     }
+    w1 = w2;
+    w2 = w;
+    p->numWords++;
+  }
+  p->last[0] = w1;
+  p->last[1] = w2;
+  token::close(text);
+}
 
-    // Include letters or contraction marks as part of a word.
-    if (('a' <= c && c <= 'z') || c == '\'') {
-      word += c;
+// stitch(d,w1,w2,p):
+//
+// Adds to `d` the first two words of piece `p`, as following the two
+// words `w1` and `w2` before it, then moves those on to the last two
+// words of the piece. The words are IDs in `d`.
+//
+void stitch(gram::dict* d, unsigned& w1, unsigned& w2, piece* p) {
+  for (int i=0; i<2 && i<p->numWords; i++) {
+    unsigned w = gram::wordId(d,gram::word(p->shard,p->first[i]));
+    gram::add(d,gram::key(w1,w2),w);
+    gram::add(d,gram::key(w1),w2);
+    w1 = w2;
+    w2 = w;
+  }
+  if (p->numWords > 2) {
+    w1 = gram::wordId(d,gram::word(p->shard,p->last[0]));
+    w2 = gram::wordId(d,gram::word(p->shard,p->last[1]));
+  }
+}
 
-    // If we hit a "stopper", emit it as a word.   
-    } else if (c == '.' || c == '!' || c == '?') {
-      if (word.size() > 0) {
-	line.erase(0,i);
-	return word;
-      } else {
-	word += c;
-	line.erase(0,1);
-	return word;
-      }
+// train_parallel(text,numThreads):
+//
+// Returns the same dictionary as `train_chat`, trained by `numThreads`
+// threads. Each block of the text is cut into one piece per thread at
+// word boundaries, and every thread keeps its own dictionary across
+// blocks. The two words that start each piece are added by this thread
+// once the block is done, into the first dictionary, with the two
+// words before them; then the others are merged into it.
+//
+gram::dict* train_parallel(token::stream* text, int numThreads) {
+  piece* pieces = new piece[numThreads];
+  for (int t=0; t<numThreads; t++) {
+    pieces[t].shard = gram::build(9,2);
+  }
+  std::thread* workers = new std::thread[numThreads];
+  gram::dict* d = pieces[0].shard;
+  unsigned w1 = gram::wordId(d,".");
+  unsigned w2 = gram::wordId(d,"");
 
-    // If we hit any non-letter, emit a word.
-    } else {
-      if (word.size() > 0) {
-	line.erase(0,i);
-	return word;
+  char* block;
+  long size;
+  while (token::nextBlock(text,PARALLEL_BLOCK,block,size)) {
+    long start = 0;
+    for (int t=0; t<numThreads; t++) {
+      long end = size;
+      if (t < numThreads-1) {
+	end = token::boundaryAfter(block,size,size/numThreads*(t+1));
+	end = end < start ? start : end;
       }
+      pieces[t].text = block+start;
+      pieces[t].size = end-start;
+      workers[t] = std::thread(train_piece,&pieces[t]);
+      start = end;
+    }
+    for (int t=0; t<numThreads; t++) {
+      workers[t].join();
     }
+    for (int t=0; t<numThreads; t++) {
+      stitch(d,w1,w2,&pieces[t]);
+    }
+  }
+  gram::add(d,gram::key(w1),w2);
+  gram::add(d,gram::key(w1,w2),gram::wordId(d,"."));
+  gram::add(d,gram::key(w2),gram::wordId(d,"."));
+
+  //fold the other shards into the first
+  for (int t=1; t<numThreads; t++) {
+    gram::merge(d,pieces[t].shard);
+    meter::add(d->counted,pieces[t].shard->counted);
+    gram::destroy(pieces[t].shard);
   }
-  // End of the line, emit that ending word.
-  line.erase(0,i);
-  return word;
+  delete [] workers;
+  delete [] pieces;
+  return d;
 }
 
-// train_chat():
+// train_order<N>(text):
 //
-// Returns a new dictionary of word/bigram followers built using the
-// structure of the text from `std::cin`.
+// Returns a new order-N model of the words in `text`, each picked by
+// the N-1 words before it. The text is taken to start after stoppers.
 //
-gram::dict* train_chat(void) {
-  gram::dict *d = gram::build(9,2); //we give our hashtable a load factor of 2
-  std::string line;
-  std::string w1 = ".";
-  std::string w2 = next_word_in(line);
-  std::string w  = "";
-  // Read until the end of text entry.
-  while (std::cin || line != "") {
-    if (line == "") {
-      std::getline(std::cin,line);
+template<int N>
+ngram::model<N>* train_order(token::stream* text) {
+  ngram::model<N>* m = ngram::build<N>();
+  unsigned recent[N];   // The last N-1 words, oldest first.
+  for (int i=0; i<N; i++) {
+    recent[i] = ngram::wordId(m,".");
+  }
+  token::word next;
+  while (token::next(text,next)) {
+    unsigned w = ngram::wordId(m,next.start,next.length);
+    ngram::add(m,recent,w);
+    for (int i=0; i+1<N-1; i++) {
+      recent[i] = recent[i+1];
     }
-    w = next_word_in(line);
-    if (w != "") {
-      gram::add(d,w1,w2,w); // Add a follower `w` for the bigram words `w1` and `w2`.
-      gram::add(d,w1,w2);   // Add a follower `w` for the word `w2`.
-      w1 = w2;
-      w2 = w;
+    if (N > 1) {
+      recent[N-2] = w;
     }
   }
-  gram::add(d,w1,w2);       // Add the last word as a follower.
-  gram::add(d,w1,w2,".");   // Include the last word as preceding a stopper `.`.
-  return d;
+  ngram::add(m,recent,ngram::wordId(m,"."));  // The text ends with a stopper `.`.
+  ngram::freeze(m);
+  return m;
+}
+
+// follow(d,recent,r):
+//
+// Picks a word to follow the last words `recent`, oldest first: the
+// last two for the trained word/bigram dictionary, or the last N-1
+// for a model of order N. Draws from the random stream `r`.
+//
+unsigned follow(gram::frozen* d, const unsigned* recent, rng::stream& r) {
+  return gram::pick(d,gram::key(recent[0],recent[1]),r);
+}
+
+template<int N>
+unsigned follow(ngram::model<N>* d, const unsigned* recent, rng::stream& r) {
+  return ngram::pick(d,recent,r);
 }
 
-// chat(d, lineWidth, numLines):
+// chat<N>(d, lineWidth, numLines, r):
 //
-// Using the text-trained word/bigram dictionary of followers,
-// generate a random text with `numLines`, where each line is
-// no longer than `lineWidth` characters.
+// Using the text-trained followers of the last N-1 words, either in the
+// word/bigram dictionary frozen once training was done (for N=3) or in
+// an order-N model, generate a random text with `numLines`, where each
+// line is no longer than `lineWidth` characters, drawing from the
+// random stream `r`.
 //
-void chat(gram::dict* d, int lineWidth, int numLines) {
+template<int N, typename Model>
+void chat(Model* d, int lineWidth, int numLines, rng::stream& r) {
   
   //varibles to keep track of line width and # of lines
   int currentLineWidth = 0;
   int currentNumLines = 0;
 
-  //our two strings to build the trigrams with
-  std::string oneStr = get(d, ".");
-  std::string twoStr = get(d,".",oneStr);
+  //the last words, as IDs, to pick the next from; only their strings are
+  //looked at, to print them. the text starts as if after stoppers
+  unsigned recent[N];
+  for(int i = 0; i < N; i++){
+    recent[i] = wordId(d,".");
+  }
+  unsigned one = follow(d,recent,r);
   
 
   
   while(currentNumLines < numLines){
     do{
+      const std::string& oneStr = word(d,one);
 
       currentLineWidth+=oneStr.length();
 
@@ -120,11 +253,15 @@ void chat(gram::dict* d, int lineWidth, int numLines) {
 	currentLineWidth++;
       }
 
-      //we them make a new word from the previous two words
-      std::string temp = twoStr;
-      twoStr = get(d,oneStr,twoStr);
-      oneStr = temp;
-    }while(currentLineWidth+oneStr.length() < lineWidth);
+      //we them make a new word from the previous words
+      for(int i = 0; i+1 < N-1; i++){
+	recent[i] = recent[i+1];
+      }
+      if(N > 1){
+	recent[N-2] = one;
+      }
+      one = follow(d,recent,r);
+    }while(currentLineWidth+(int)word(d,one).length() < lineWidth);
       
     currentLineWidth = 0;
     if(currentNumLines < numLines-1){
@@ -136,28 +273,371 @@ void chat(gram::dict* d, int lineWidth, int numLines) {
   std::cout << "."<<std::endl;
 }
 
+// chat_order<N>(text,r):
+//
+// Trains an order-N model on `text`, closing it, and generates from it.
+//
+template<int N>
+void chat_order(token::stream* text, rng::stream& r) {
+  ngram::model<N>* m = train_order<N>(text);
+  token::close(text);
+  chat<N>(m,60,20,r);
+  ngram::destroy(m);
+}
+
+// chat_batch(d,numTexts,length,seed,numThreads):
+//
+// Generates `numTexts` texts of `length` words from `d` at once, with
+// `numThreads` threads, and prints each on a line of its own, its words
+// separated by spaces. The empty word that training puts before the
+// first word of the text is left out.
+//
+void chat_batch(gram::frozen* d, int numTexts, int length, unsigned long long seed, int numThreads) {
+  unsigned* words = gram::generate(d,numTexts,length,seed,numThreads);
+  for (int t=0; t<numTexts; t++) {
+    bool first = true;
+    for (int i=0; i<length; i++) {
+      const std::string& w = gram::word(d,words[(long)t*length+i]);
+      if (w.length() > 0) {
+	std::cout << (first ? "" : " ") << w;
+	first = false;
+      }
+    }
+    std::cout << "\n";
+  }
+  std::cout.flush();
+  delete [] words;
+}
+
+// loadModels(names,numNames):
+//
+// Returns a new dictionary holding the summed follower counts of the
+// model files named by `names`, ready to be trained further. Returns
+// nullptr, after saying why, if any of them can't be read.
+//
+gram::dict* loadModels(const char** names, int numNames) {
+  gram::dict* d = gram::build(9,2);
+  for (int i=0; i<numNames; i++) {
+    model::file* M = model::open(names[i]);
+    if (M == nullptr || !model::verify(M)) {
+      std::cerr << names[i] << " is not a readable model file." << std::endl;
+      if (M != nullptr) {
+	model::close(M);
+      }
+      gram::destroy(d);
+      return nullptr;
+    }
+    model::addTo(M,d);
+    model::close(M);
+  }
+  return d;
+}
+
+// timeTokenizing(text):
+//
+// Returns how long the tokenizer alone takes to scan the mapped text
+// of `text`, in nanoseconds, leaving `text` where it was.
+//
+long long timeTokenizing(token::stream* text) {
+  long long started = meter::now();
+  token::stream* S = token::view(text->buffer,text->size);
+  token::word w;
+  while (token::next(S,w)) {
+  }
+  token::close(S);
+  return meter::now() - started;
+}
+
+// reportStats(R,jsonTo):
+//
+// Writes the readings `R` to STDERR, and as JSON to the file `jsonTo`
+// unless it is nullptr, then deletes `R`. Returns false, after saying
+// why, if the file can't be written.
+//
+bool reportStats(meter::readings* R, const char* jsonTo) {
+  std::cerr << std::endl;
+  meter::print(R,std::cerr);
+  bool written = true;
+  if (jsonTo != nullptr) {
+    std::ofstream out(jsonTo);
+    meter::printJson(R,out);
+    written = out.good();
+    if (!written) {
+      std::cerr << "Could not write the readings to " << jsonTo << "." << std::endl;
+    }
+  }
+  meter::destroy(R);
+  return written;
+}
+
 // main()
 //
-// Processes std::cin as a sequence of words, training a 
-// random process based on its bigrams and trigrams, 
-// as specified in a `gram::dict`.  
+// Processes std::cin (or the file named on the command line) as a
+// sequence of words, training a random process based on its bigrams
+// and trigrams, as specified in a `gram::dict`.
+//
+// Generates a random text using that process' `gram::dict`, frozen
+// into a compact `gram::frozen` first.
+//
+// Usage: ./chats [-j N | -n N] [--seed S] [--texts M --words L] [--model model.bin ...]
+//                [--save model.bin] [--stats] [--stats-json stats.json] [--mem-report]
+//                [textfile.txt]
+//
+// With `-j N`, the dictionary is trained by N threads. With `-n N`,
+// each word is picked by the N-1 words before it instead, using an
+// `ngram::model<N>`, for N from 1 to MAX_ORDER.
+//
+// The random choices are seeded by `--seed S`, so that the same seed
+// gives the same text; otherwise by the time. With `--texts M`, M texts
+// of `--words L` words each (100 by default) are generated at once, by
+// as many threads as `-j` asks for, and printed one per line.
+//
+// With `--save model.bin`, the trained dictionary is also written to a
+// model file (see "model.hh"), and with `--model model.bin`, the text
+// is generated from that file instead of training on a text first.
+//
+// A model can be updated: given with a text, or with `--save`, or with
+// more models, the follower counts of every `--model` are added up and
+// the text, if any, is trained on top of them, as `-` for STDIN. So
+//
+//    ./chats --model old.bin --save new.bin more.txt
+//
+// trains only on `more.txt`. Or `./chats --save delta.bin more.txt`
+// keeps the new text's model apart, and `./chats --model old.bin
+// --model delta.bin --save new.bin` folds it in later.
+//
+// With `--stats`, once the text is generated, it also reports to
+// STDERR how long each phase took, and the shape of the hash tables of
+// the dictionary, as trained and as frozen (see "meter.hh"). With
+// `--stats-json FILE` the same goes to FILE as JSON. The phases are
+// reading the text or models, tokenizing, training, freezing and
+// generating. For a named file, tokenizing is timed by a pass of the
+// tokenizer alone before the training, which is timed less that.
 //
-// Generates a random text using that process' `gram::dict`
+// With `--mem-report` it also reports to STDERR how many bytes each
+// part of the dictionaries holds once the text is generated and held
+// at most, as kept by "mem.hh", the bytes per key of the frozen
+// dictionary, and the process's peak resident memory.
 //
 int main(int argc, char **argv) {
 
   //
-  // Build a dictionary of word/bigram followers based on the text entered.
-  std::cout << "READING text from STDIN. Hit ctrl-d when done entering text.\n";
+  // Read the options, then open the text, either the named file or STDIN.
+  int order = 0;
+  int numThreads = 1;
+  unsigned long long seed = std::time(0);
+  int numTexts = 0;
+  int length = 100;
+  const char* saveTo = nullptr;
+  bool showStats = false;
+  const char* statsTo = nullptr;
+  bool memReport = false;
+  const char** modelNames = new const char*[argc];
+  int numModels = 0;
+  const char* filename = nullptr;
+  for (int i=1; i<argc; i++) {
+    if (std::strcmp(argv[i],"-j") == 0 && i+1 < argc) {
+      numThreads = std::atoi(argv[++i]);
+      if (numThreads < 1) {
+	std::cerr << "The number of threads given with -j must be at least 1." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"-n") == 0 && i+1 < argc) {
+      order = std::atoi(argv[++i]);
+      if (order < 1 || order > MAX_ORDER) {
+	std::cerr << "The order given with -n must be from 1 to " << MAX_ORDER << "." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--seed") == 0 && i+1 < argc) {
+      seed = std::strtoull(argv[++i],nullptr,10);
+    } else if (std::strcmp(argv[i],"--texts") == 0 && i+1 < argc) {
+      numTexts = std::atoi(argv[++i]);
+      if (numTexts < 1) {
+	std::cerr << "The number of texts given with --texts must be at least 1." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--words") == 0 && i+1 < argc) {
+      length = std::atoi(argv[++i]);
+      if (length < 1) {
+	std::cerr << "The length given with --words must be at least 1 word." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--save") == 0 && i+1 < argc) {
+      saveTo = argv[++i];
+    } else if (std::strcmp(argv[i],"--model") == 0 && i+1 < argc) {
+      modelNames[numModels++] = argv[++i];
+    } else if (std::strcmp(argv[i],"--stats") == 0) {
+      showStats = true;
+    } else if (std::strcmp(argv[i],"--stats-json") == 0 && i+1 < argc) {
+      showStats = true;
+      statsTo = argv[++i];
+    } else if (std::strcmp(argv[i],"--mem-report") == 0) {
+      memReport = true;
+    } else {
+      filename = argv[i];
+    }
+  }
+  if (numThreads > 1 && order > 0) {
+    std::cerr << "Only one of -j and -n can be used at a time." << std::endl;
+    return 1;
+  }
+  if (numTexts > 0 && order > 0) {
+    std::cerr << "Batches of texts with --texts come only from the word/bigram dictionary, without -n." << std::endl;
+    return 1;
+  }
+  if ((saveTo != nullptr || numModels > 0) && order > 0) {
+    std::cerr << "Only the word/bigram dictionary, without -n, is kept in model files." << std::endl;
+    return 1;
+  }
+  if ((showStats || memReport) && order > 0) {
+    std::cerr << "Only the word/bigram dictionary, without -n, is reported on by --stats and --mem-report." << std::endl;
+    return 1;
+  }
+  if (memReport) {
+    mem::track();
+  }
+  rng::stream r;
+  rng::seed(r,seed);
+  meter::readings* R = showStats ? meter::build() : nullptr;
+  long long started = meter::now();
 
-  gram::dict* d = train_chat();
+  //
+  // Generate from a saved model as it is, if given just that.
+  if (numModels == 1 && filename == nullptr && saveTo == nullptr) {
+    model::file* M = model::open(modelNames[0]);
+    if (M == nullptr || !model::verify(M)) {
+      std::cerr << modelNames[0] << " is not a readable model file." << std::endl;
+      if (M != nullptr) {
+	model::close(M);
+      }
+      delete [] modelNames;
+      meter::destroy(R);
+      return 1;
+    }
+    delete [] modelNames;
+    if (R != nullptr) {
+      meter::phase(R,"read",meter::now()-started);
+      started = meter::now();
+    }
+    if (numTexts > 0) {
+      chat_batch(model::frozen(M),numTexts,length,seed,numThreads);
+    } else {
+      chat<3>(model::frozen(M),60,20,r);
+    }
+    bool written = true;
+    if (R != nullptr) {
+      meter::phase(R,"generate",meter::now()-started);
+      gram::measure(model::frozen(M),meter::addTable(R,"frozen"));
+      written = reportStats(R,statsTo);
+    }
+    if (memReport) {
+      std::cerr << std::endl;
+      mem::report(std::cerr,"key",model::frozen(M)->numEntries);
+    }
+    model::close(M);
+    return written ? 0 : 1;
+  }
+
+  //
+  // Otherwise start from the counts of the models given, if any.
+  gram::dict* trained = nullptr;
+  if (numModels > 0) {
+    trained = loadModels(modelNames,numModels);
+    if (trained == nullptr) {
+      delete [] modelNames;
+      meter::destroy(R);
+      return 1;
+    }
+  }
+  delete [] modelNames;
+
+  //
+  // Build a dictionary of word/bigram followers based on the text entered,
+  // unless there are only models to add up.
+  if (trained == nullptr || filename != nullptr) {
+    token::stream* text = token::open(filename);
+    if (text == nullptr) {
+      std::cerr << "Could not open " << filename << "." << std::endl;
+      if (trained != nullptr) {
+	gram::destroy(trained);
+      }
+      meter::destroy(R);
+      return 1;
+    }
+    if (text->mapped) {
+      std::cout << "READING text from " << filename << ".\n";
+    } else {
+      std::cout << "READING text from STDIN. Hit ctrl-d when done entering text.\n";
+    }
+    long long tokenizing = 0;
+    if (R != nullptr) {
+      meter::phase(R,"read",meter::now()-started);
+      if (text->mapped) {
+	tokenizing = timeTokenizing(text);
+	meter::phase(R,"tokenize",tokenizing);
+      }
+      started = meter::now();
+    }
+
+    switch (order) {
+    case 1: chat_order<1>(text,r); return 0;
+    case 2: chat_order<2>(text,r); return 0;
+    case 3: chat_order<3>(text,r); return 0;
+    case 4: chat_order<4>(text,r); return 0;
+    case 5: chat_order<5>(text,r); return 0;
+    }
+
+    gram::dict* more = numThreads > 1 ? train_parallel(text,numThreads) : train_chat(text);
+    token::close(text);
+    if (trained == nullptr) {
+      trained = more;
+    } else {
+      //the new text's counts go on top of the models'
+      gram::merge(trained,more);
+      meter::add(trained->counted,more->counted);
+      gram::destroy(more);
+    }
+    if (R != nullptr) {
+      long long training = meter::now()-started-tokenizing;
+      meter::phase(R,"train",training > 0 ? training : 0);
+    }
+  } else if (R != nullptr) {
+    meter::phase(R,"read",meter::now()-started);
+  }
 
+  if (R != nullptr) {
+    gram::measure(trained,meter::addTable(R,"grams"));
+    started = meter::now();
+  }
+  gram::frozen* d = gram::freeze(trained);
+  if (R != nullptr) {
+    meter::phase(R,"freeze",meter::now()-started);
+  }
+  if (saveTo != nullptr && !model::save(d,saveTo)) {
+    std::cerr << "Could not write the model to " << saveTo << "." << std::endl;
+    gram::destroy(d);
+    meter::destroy(R);
+    return 1;
+  }
 
-  chat(d,60,20);
+  started = meter::now();
+  if (numTexts > 0) {
+    chat_batch(d,numTexts,length,seed,numThreads);
+  } else {
+    chat<3>(d,60,20,r);
+  }
+  bool written = true;
+  if (R != nullptr) {
+    meter::phase(R,"generate",meter::now()-started);
+    gram::measure(d,meter::addTable(R,"frozen"));
+    written = reportStats(R,statsTo);
+  }
+  if (memReport) {
+    std::cerr << std::endl;
+    mem::report(std::cerr,"key",d->numEntries);
+  }
 
   //reallocates the dict
   gram::destroy(d);
+  return written ? 0 : 1;
 }
-
-    
-
@@ -10,115 +10,444 @@
 // It is described more within the README for this project.
 //
 // The functions it defines include
-//    * `int hashValue(std::string,int)`: give the hash location for a key
 //    * `freq::dict* freq::build(int,int)`: build a word count dictionary 
-//    * `int freq::totalCount(freq::dict*)`: get the total word count
+//    * `unsigned long long freq::totalCount(freq::dict*)`: get the total word count
 //    * `int freq::numKeys(freq::dict*)`: get number of words
-//    * `void freq::increment(freq::dict*,std::string)`: bump a word's count 
-//    * `int freq::getCount(freq::dict*,std::string)`: get the count for a word
+//    * `void freq::increment(freq::dict*,std::string_view)`: bump a word's count 
+//    * `void freq::decrement(freq::dict*,std::string_view)`: lower a word's count, removing it at zero
+//    * `Count freq::getCount(freq::dict*,std::string_view)`: get the count for a word
+//    * `void freq::incrementHashed(freq::dict*,std::string_view,unsigned long long)`: bump a word's count, given its hash
+//    * `Count freq::getCountHashed(freq::dict*,std::string_view,unsigned long long)`: get the count for a word, given its hash
 //    * `freq::entry* freq::dumpAndDestroy(freq::dict*)`: get the word counts, sorted by frequency
 //    * `void freq::rehash(freq::dict*)`: expand the hash table
+//    * `void freq::setRehashStep(freq::dict*,int)`: expand the table a little at a time
+//    * `freq::entry* freq::topK(freq::dict*,int)`: get the most frequent words
+//    * `freq::entry* freq::snapshot(freq::dict*)`: get all the word counts, sorted by frequency
+//    * `int freq::numWithCount(freq::dict*,unsigned long long)`: get the number of words with a given count
+//    * `Count freq::highestCount(freq::dict*)`: get the largest count
+//    * `void freq::merge(freq::dict*,freq::dict*)`: add one dictionary's counts into another
+//    * `void freq::measure(freq::dict*,meter::table*)`: get the shape of the hash table
+//    * `void freq::destroy(freq::dict*)`: give back the dictionary's storage
 //
-// The top four are implemented already, the other four need to be written.
+// Each is a template over the type `Count` of the counts, and is
+// compiled, at the end of this file, for a `freq::dict` and for a
+// `freq::compact`.
+//
+// Keys are hashed with `hashing::hash64` from "hash.hh". Every entry
+// keeps its key's full hash, so tables are sized to powers of two and
+// a key's bucket is just the low bits of that hash.
+//
+// Each of these also serves the FLAT engine, handing off to the
+// `flat*` versions defined in their own section below.
+//
+// The characters of a dictionary's words are copied once, when each
+// word is added, into its string pool, and the entries of the chained
+// engine come from its arena of nodes; see "arena.hh". A word removed
+// by `decrement` leaves its characters in the pool, and its node on a
+// list to be used again, until the dictionary is destroyed, which
+// frees every one of them at once.
+//
+// Every allocation and free of a dictionary's storage is counted
+// against its part in "mem.hh".
 //
 
 #include <string>
+#include <string_view>
 #include <iostream>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
 #include "freq.hh"
+#include "hash.hh"
+#include "meter.hh"
+#include "mem.hh"
+#include "arena.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+using hashing::hash64;
+using hashing::powerOfTwoAtLeast;
 
 
 // * * * * * * * * * * * * * * * * * * * * * * *
 //
-// HELPER FUNCTIONS FOR CHOOSING HASH TABLE SIZE
+// THE COUNT HISTOGRAM
 //
-
-// isPrime(n)
+// Each dictionary keeps `countHist`, where `countHist[c]` is how many
+// of its words have a count of exactly `c`. Keeping it up to date
+// costs two array updates per `increment`, and in return it answers
+// `numWithCount` at once and lays out the counting sort behind
+// `snapshot`.
 //
-// Return whether or not the given integer `n` is prime.
+// The histogram only reaches as far as HIST_LIMIT, so that a word
+// counted billions of times doesn't make it billions long. The words
+// past it are just counted, in `numHigh`; when one of them loses the
+// largest count, the next largest is only looked for once it is asked
+// for.
 //
-bool isPrime(int n) {
-  // Handle the obvious cases, including even ones.
-  if ((n <= 2) || (n % 2 == 0)) {
-    return (n == 2);
-  }
-  // Try several odd divisors.
-  int d = 3;
-  while (d*d <= n) {
-    if (n % d == 0) {
-      // It has a divisor. It's not prime.
-      return false;
+namespace freq {
+
+  // recount(D,from,to):
+  //
+  // Records in the histogram of `D` that one word's count changed from
+  // `from` to `to`. A count of 0 stands for a word not in `D`.
+  //
+  template <class Count>
+  void recount(basic_dict<Count>* D, Count from, Count to) {
+    if (to >= (Count)D->histSize && to < (Count)HIST_LIMIT) {
+      int newSize = 2*D->histSize;
+      while ((Count)newSize <= to) {
+	newSize *= 2;
+      }
+      int* bigger = new int[newSize]();
+      mem::allocated(mem::FREQ_COUNTS,newSize*sizeof(int));
+      for (int c=0; c<D->histSize; c++) {
+	bigger[c] = D->countHist[c];
+      }
+      delete [] D->countHist;
+      mem::freed(mem::FREQ_COUNTS,D->histSize*sizeof(int));
+      D->countHist = bigger;
+      D->histSize = newSize;
+    }
+    if (from < HIST_LIMIT) {
+      D->countHist[from]--;
+    } else {
+      D->numHigh--;
+    }
+    if (to < HIST_LIMIT) {
+      D->countHist[to]++;
+    } else {
+      D->numHigh++;
+    }
+    if (D->maxStale) {
+      return;
+    }
+    if (to > D->maxCount) {
+      D->maxCount = to;
+      return;
+    }
+    if (from != D->maxCount || to == from) {
+      return;
     }
-    d += 2;
-  }
-  // No divisors. It's prime.
-  return true;
-}
 
-// primeAtLeast(n)
-//
-// Return the smallest prime number no smaller
-// than `n`.
-//
-int primeAtLeast(int n) {
-  if (n <= 2) {
-    return 2;
+    //the largest count went down: past the histogram, another word might
+    //have it too, so it's found later; otherwise the histogram tells
+    if (D->numHigh > 0) {
+      D->maxStale = true;
+      return;
+    }
+    if (D->maxCount >= (Count)D->histSize) {
+      D->maxCount = D->histSize-1;
+    }
+    while (D->maxCount > 0 && D->countHist[D->maxCount] == 0) {
+      D->maxCount--;
+    }
   }
-  int p = 3;
-  while (p < n || !isPrime(p)) {
-    p += 2;
+
+  // room(count,by):
+  //
+  // Gives back as much of `by` as can be added to `count` without
+  // passing the largest value a `Count` holds. A count that gets there
+  // stays there, rather than wrapping around to a small one; only a
+  // `freq::compact`, counting past about four billion, ever does.
+  //
+  template <class Count>
+  inline Count room(Count count, Count by) {
+    Count most = std::numeric_limits<Count>::max();
+    return by > most-count ? most-count : by;
   }
-  return p;
-}
 
-// * * * * * * * * * * * * * * * * * * * * * * *
-//
-// HELPER FUNCTIONS FOR COMPUTING THE HASH VALUE
-//
+} // end namespace freq
 
-// charToInt(c):
+// * * * * * * * * * * * * * * * * * * * * * * *
 //
-// Returns an integer between 0 and 31 for the given character. Pays
-// attention only to letters, the contraction quote, "stopper" marks,
-// and space.
+// THE STRING POOL
 //
+// Entries don't own their words. Each word is copied into the pool of
+// its dictionary when it is first added, and entries point there.
 //
-int charToInt(char c) {
-  if (c >= 'a' && c <= 'z') {
-    return c - 'a' + 1;
-  } else if (c == '.') {
-    return 27;
-  } else if (c == '!') {
-    return 28;
-  } else if (c == '?') {
-    return 29;
-  } else if (c == '\'') {
-    return 30;
-  } else if (c == ' ') {
-    return 31;
-  } else {
-    return 0;
-  }
-}
-
-// hashValue(key,tableWidth):
+namespace freq {
+
+  // sameWord(e,w,length):
+  //
+  // Whether the entry `e` is for the word made of the `length`
+  // characters at `w`.
+  //
+  template <class Count>
+  inline bool sameWord(const node<Count>& e, const char* w, int length) {
+    return e.length == length && std::memcmp(e.word,w,length) == 0;
+  }
+
+  // placeWord(D,e,w,length):
+  //
+  // Makes the entry `e` of `D` the entry for the word made of the
+  // `length` characters at `w`, copying them into the pool of `D`.
+  //
+  template <class Count>
+  void placeWord(basic_dict<Count>* D, node<Count>& e, const char* w, int length) {
+    e.word = arena::copy(D->words,w,length);
+    e.length = length;
+  }
+
+  // compareWords(a,b):
+  //
+  // Returns a number below zero, zero, or above zero, as the word of
+  // `a` comes before that of `b` in alphabetical order, is the same,
+  // or comes after, as `std::string` compares them.
+  //
+  template <class Count>
+  int compareWords(const node<Count>* a, const node<Count>* b) {
+    int order = std::memcmp(a->word,b->word,a->length < b->length ? a->length : b->length);
+    return order != 0 ? order : a->length - b->length;
+  }
+
+} // end namespace freq
+
+// * * * * * * * * * * * * * * * * * * * * * * *
 //
-// Returns an integer from 0 to tableWidth-1 for the given string
-// `key`. This serves as a hash function for a table of size
-// `tableWidth`.  
+// THE FLAT ENGINE
 //
-// This method treats the string as a base-32 encoding of the integer
-// it computes, modulo `tableWidth`. It relies on `charToInt` defined
-// just above.
+// The table is an array of `numBuckets` entries split into groups of
+// 16, alongside an array of control bytes. A slot's control byte is
+// EMPTY or the low 7 bits of its key's cached hash, so a whole group can be
+// checked against a key with one SIMD comparison, and only slots whose
+// bits match ever have their words compared. The rest of the hash
+// picks the first group to look in; after that, groups are visited
+// with triangular steps, which reach every group of a power-of-two
+// table. Probing for a key stops at the first group with an EMPTY
+// slot. A removed entry leaves a DELETED slot behind instead, which
+// probes pass over and new entries may reuse; once EMPTY slots run
+// low the table is rebuilt without them.
 //
-int hashValue(std::string key, int modulus) {
-  int hashValue = 0;
-  for (char c: key) {
-    // Horner's method for computing the value.
-    hashValue = (32*hashValue + charToInt(c)) % modulus;
+namespace freq {
+
+  const unsigned char EMPTY = 0x80; // The control byte of an unused slot.
+  const unsigned char DELETED = 0xFE; // The control byte of a removed entry's slot.
+  const int GROUP = 16;             // The number of slots probed at once.
+
+  // matchGroup(control,tag):
+  //
+  // Returns a mask with bit `i` set when the `i`th control byte of the
+  // group starting at `control` equals `tag`.
+  //
+  inline unsigned matchGroup(const unsigned char* control, unsigned char tag) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group,_mm_set1_epi8((char)tag)));
+#else
+    unsigned mask = 0;
+    for (int i=0; i<GROUP; i++) {
+      if (control[i] == tag) {
+	mask |= 1u << i;
+      }
+    }
+    return mask;
+#endif
+  }
+
+  // flatSlots(howMany):
+  //
+  // Round `howMany` up to a power of two that is a whole number of groups.
+  //
+  int flatSlots(int howMany) {
+    return powerOfTwoAtLeast(howMany < GROUP ? GROUP : howMany);
+  }
+
+  // flatAllocate(D,howMany):
+  //
+  // Give `D` fresh, all-EMPTY arrays of `howMany` slots.
+  //
+  template <class Count>
+  void flatAllocate(basic_dict<Count>* D, int howMany) {
+    D->numBuckets = howMany;
+    D->slots      = new node<Count>[howMany];
+    D->control    = new unsigned char[howMany];
+    mem::allocated(mem::FREQ_ENTRIES,howMany*sizeof(node<Count>));
+    mem::allocated(mem::FREQ_TABLE,howMany);
+    for (int i=0; i<howMany; i++) {
+      D->control[i] = EMPTY;
+    }
+  }
+
+  // isFull(c):
+  //
+  // Whether a slot with control byte `c` holds an entry. EMPTY and
+  // DELETED both have their high bit set; tags never do.
+  //
+  inline bool isFull(unsigned char c) {
+    return (c & 0x80) == 0;
+  }
+
+  // flatFind(D,w,length,h,found):
+  //
+  // Probe `D` for the word of `length` characters at `w`, having hash `h`. Returns the slot
+  // holding it and sets `found`, or else returns the slot where it
+  // belongs: the first DELETED one passed, or else the EMPTY one
+  // that ended the search.
+  //
+  template <class Count>
+  int flatFind(basic_dict<Count>* D, const char* w, int length, unsigned long long h, bool& found) {
+    unsigned char tag = h & 0x7F;
+    int groupMask = D->numBuckets/GROUP - 1;
+    int group = (h >> 7) & groupMask;
+    int reusable = -1;
+    for (int step = 1; ; step++) {
+      const unsigned char* control = D->control + group*GROUP;
+
+      //compare the words only in slots whose tags match
+      unsigned mask = matchGroup(control,tag);
+      while (mask != 0) {
+	int slot = group*GROUP + __builtin_ctz(mask);
+	if (D->slots[slot].hash == h && sameWord(D->slots[slot],w,length)) {
+	  meter::looked(D->counted,step);
+	  found = true;
+	  return slot;
+	}
+	mask &= mask - 1;
+      }
+
+      //an EMPTY slot means the word isn't in the table
+      unsigned empties = matchGroup(control,EMPTY);
+      if (reusable == -1 && D->numDeleted > 0) {
+	unsigned deleted = matchGroup(control,DELETED);
+	if (deleted != 0) {
+	  reusable = group*GROUP + __builtin_ctz(deleted);
+	}
+      }
+      if (empties != 0) {
+	meter::looked(D->counted,step);
+	found = false;
+	return reusable != -1 ? reusable : group*GROUP + __builtin_ctz(empties);
+      }
+      group = (group + step) & groupMask;
+    }
+  }
+
+  // flatEmptySlot(D,h):
+  //
+  // Returns the first EMPTY slot along the probe sequence for the
+  // hash `h`. Used when moving entries already known to be distinct.
+  //
+  template <class Count>
+  int flatEmptySlot(basic_dict<Count>* D, unsigned long long h) {
+    int groupMask = D->numBuckets/GROUP - 1;
+    int group = (h >> 7) & groupMask;
+    for (int step = 1; ; step++) {
+      unsigned empties = matchGroup(D->control + group*GROUP,EMPTY);
+      if (empties != 0) {
+	return group*GROUP + __builtin_ctz(empties);
+      }
+      group = (group + step) & groupMask;
+    }
+  }
+
+  // flatRehash(D):
+  //
+  // Moves every entry of `D` to its place in a new array of slots,
+  // leaving the DELETED ones behind. The array doubles, unless so many
+  // slots were DELETED that the entries fit comfortably as they are.
+  //
+  template <class Count>
+  void flatRehash(basic_dict<Count>* D) {
+    long long started = meter::stamp();
+    int oldNumSlots = D->numBuckets;
+    node<Count>* oldSlots = D->slots;
+    unsigned char* oldControl = D->control;
+
+    if (2LL*D->numEntries >= oldNumSlots && oldNumSlots >= MAX_BUCKETS) {
+      throw std::length_error("freq::dict: a FLAT table can't hold any more words");
+    }
+    flatAllocate(D,2LL*D->numEntries < oldNumSlots ? oldNumSlots : 2*oldNumSlots);
+    D->numDeleted = 0;
+    for (int i=0; i<oldNumSlots; i++) {
+      if (isFull(oldControl[i])) {
+	unsigned long long h = oldSlots[i].hash;
+	int slot = flatEmptySlot(D,h);
+	D->slots[slot] = oldSlots[i];
+	D->control[slot] = h & 0x7F;
+      }
+    }
+    delete [] oldSlots;
+    delete [] oldControl;
+    mem::freed(mem::FREQ_ENTRIES,oldNumSlots*sizeof(node<Count>));
+    mem::freed(mem::FREQ_TABLE,oldNumSlots);
+    meter::rehashed(D->counted,started);
+  }
+
+  // flatGetCount(D,w,length,h):
+  //
+  // The FLAT version of `getCount`.
+  //
+  template <class Count>
+  Count flatGetCount(basic_dict<Count>* D, const char* w, int length, unsigned long long h) {
+    bool found;
+    int slot = flatFind(D,w,length,h,found);
+    return found ? D->slots[slot].count : 0;
   }
-  return hashValue;
-}
 
+  // flatAdd(D,w,length,h,by):
+  //
+  // The FLAT version of `addHashed`. Grows the table before its
+  // entries and DELETED slots would take up more than 7/8 of it.
+  //
+  template <class Count>
+  void flatAdd(basic_dict<Count>* D, const char* w, int length, unsigned long long h, Count by) {
+    bool found;
+    int slot = flatFind(D,w,length,h,found);
+    if (found) {
+      by = room(D->slots[slot].count,by);
+      D->numIncrements += by;
+      D->slots[slot].count += by;
+      recount<Count>(D,D->slots[slot].count-by,D->slots[slot].count);
+      return;
+    }
+    if (D->control[slot] == DELETED) {
+      D->numDeleted--;
+    } else if (8LL*(D->numEntries+D->numDeleted+1) > 7LL*D->numBuckets) {
+      flatRehash(D);
+      slot = flatEmptySlot(D,h);
+    }
+    placeWord(D,D->slots[slot],w,length);
+    D->slots[slot].count = by;
+    D->slots[slot].hash  = h;
+    D->slots[slot].next  = nullptr;
+    D->control[slot] = h & 0x7F;
+    D->numEntries++;
+    D->numIncrements += by;
+    recount<Count>(D,0,by);
+  }
+
+  // flatSubtract(D,w,length,h,by):
+  //
+  // The FLAT version of `subtractHashed`. An entry whose count drops
+  // to zero has its slot marked DELETED.
+  //
+  template <class Count>
+  void flatSubtract(basic_dict<Count>* D, const char* w, int length, unsigned long long h, Count by) {
+    bool found;
+    int slot = flatFind(D,w,length,h,found);
+    if (!found) {
+      return;
+    }
+    node<Count>& e = D->slots[slot];
+    by = by < e.count ? by : e.count;
+    D->numIncrements -= by;
+    e.count -= by;
+    recount<Count>(D,e.count+by,e.count);
+    if (e.count == 0) {
+      D->control[slot] = DELETED;
+      D->numEntries--;
+      D->numDeleted++;
+    }
+  }
+
+} // end namespace freq
 
 // * * * * * * * * * * * * * * * * * * * * * * *
 //
@@ -126,24 +455,91 @@ int hashValue(std::string key, int modulus) {
 //
 namespace freq {
 
-//    * `int hashValue(std::string,int)`: give the hash location for a key
-//    * `freq::dict* freq::build(int,int)`: build a word count dictionary 
-//    * `int freq::totalCount(freq::dict*)`: get the total word count
-//    * `int freq::numKeys(freq::dict*)`: get number of words
-//    * `void freq::increment(freq::dict*,std::string)`: bump a word's count 
-//    * `int freq::getCount(freq::dict*,std::string)`: get the count for a word
-//    * `freq::entry* freq::dumpAndDestroy(freq::dict*)`: get the word counts, sorted by frequency
-//    * `void freq::rehash(freq::dict*)`: expand the hash table
   // buildBuckets(howMany):
   //
-  // Return an array of buckets of length `howMany`.
+  // Return an array of buckets of length `howMany`, all empty. The
+  // array comes zeroed from `calloc`, which hands back fresh pages for
+  // large tables without touching them, so building even a huge table
+  // doesn't stall.
   //
-  bucket* buildBuckets(int howMany) {
-    bucket* bs = new bucket[howMany];
-    for (int i=0; i<howMany; i++) {
-      bs[i].first = nullptr;
+  template <class Count>
+  bucket<Count>* buildBuckets(int howMany) {
+    mem::allocated(mem::FREQ_TABLE,howMany*sizeof(bucket<Count>));
+    return static_cast<bucket<Count>*>(std::calloc(howMany,sizeof(bucket<Count>)));
+  }
+
+  // moveChain(currentEntry,buckets,numBuckets):
+  //
+  // Places each entry of the list starting at `currentEntry` at the
+  // front of its bucket in the table `buckets`, which has `numBuckets`
+  // buckets, using the hash cached in each entry.
+  //
+  template <class Count>
+  void moveChain(node<Count>* currentEntry, bucket<Count>* buckets, int numBuckets) {
+    while(currentEntry!=nullptr){
+      node<Count>* nextEntry = currentEntry->next;
+      int newBucketIndex = currentEntry->hash & (numBuckets-1);
+      currentEntry->next = buckets[newBucketIndex].first;
+      buckets[newBucketIndex].first = currentEntry;
+      currentEntry = nextEntry;
     }
-    return bs;
+  }
+
+  // migrate(D,howMany):
+  //
+  // Moves up to `howMany` more of the old buckets of `D` into its new
+  // table. Once the last of them has moved, the old table is freed.
+  //
+  template <class Count>
+  void migrate(basic_dict<Count>* D, int howMany) {
+    while (howMany > 0 && D->migrated < D->oldNumBuckets) {
+      moveChain(D->oldBuckets[D->migrated].first,D->buckets,D->numBuckets);
+      D->migrated++;
+      howMany--;
+    }
+    if (D->migrated == D->oldNumBuckets) {
+      std::free(D->oldBuckets);
+      mem::freed(mem::FREQ_TABLE,D->oldNumBuckets*sizeof(bucket<Count>));
+      D->oldBuckets    = nullptr;
+      D->oldNumBuckets = 0;
+      D->migrated      = 0;
+    }
+  }
+
+  // findEntry(D,w,length,h):
+  //
+  // Returns the entry of `D` for the word of `length` characters at
+  // `w`, whose hash is `h`, or nullptr if there is none. While an incremental rehash is going on,
+  // a word whose old bucket hasn't moved yet is found there.
+  //
+  template <class Count>
+  node<Count>* findEntry(basic_dict<Count>* D, const char* w, int length, unsigned long long h) {
+    long compared = 0;
+    node<Count>* currentEntry = D->buckets[h & (D->numBuckets-1)].first;
+    while(currentEntry!=nullptr){
+      compared++;
+      if(currentEntry->hash == h && sameWord(*currentEntry,w,length)){
+	meter::looked(D->counted,compared);
+	return currentEntry;
+      }
+      currentEntry = currentEntry->next;
+    }
+    if (D->oldBuckets != nullptr) {
+      int oldIndex = h & (D->oldNumBuckets-1);
+      if (oldIndex >= D->migrated) {
+	currentEntry = D->oldBuckets[oldIndex].first;
+	while(currentEntry!=nullptr){
+	  compared++;
+	  if(currentEntry->hash == h && sameWord(*currentEntry,w,length)){
+	    meter::looked(D->counted,compared);
+	    return currentEntry;
+	  }
+	  currentEntry = currentEntry->next;
+	}
+      }
+    }
+    meter::looked(D->counted,compared);
+    return nullptr;
   }
 
   // build(initialSize,loadFactor):
@@ -151,13 +547,47 @@ namespace freq {
   // Build a word count dictionary that is roughly the given size, and
   // maintains the given load factor in its hash table.
   //
-  dict* build(int initialSize, int loadFactor) {
-    dict* newD = new dict;
+  template <class Count>
+  basic_dict<Count>* build(int initialSize, int loadFactor) {
+    return build<Count>(initialSize,loadFactor,CHAINED);
+  }
+
+  // build(initialSize,loadFactor,kind):
+  //
+  // Build a word count dictionary as above, whose table is organized
+  // by the engine `kind`.
+  //
+  template <class Count>
+  basic_dict<Count>* build(int initialSize, int loadFactor, engine kind) {
+    basic_dict<Count>* newD = new basic_dict<Count>;
+    newD->kind          = kind;
     newD->numIncrements = 0;
     newD->numEntries    = 0;
+    newD->numDeleted    = 0;
     newD->loadFactor    = loadFactor; 
-    newD->numBuckets    = primeAtLeast(initialSize);
-    newD->buckets       = buildBuckets(newD->numBuckets);
+    newD->buckets       = nullptr;
+    newD->oldBuckets    = nullptr;
+    newD->oldNumBuckets = 0;
+    newD->migrated      = 0;
+    newD->rehashStep    = 0;
+    newD->slots         = nullptr;
+    newD->control       = nullptr;
+    newD->words         = arena::build(mem::FREQ_WORDS);
+    newD->nodes         = arena::build(mem::FREQ_ENTRIES);
+    newD->spare         = nullptr;
+    newD->histSize      = 16;
+    newD->countHist     = new int[newD->histSize]();
+    mem::allocated(mem::FREQ_COUNTS,newD->histSize*sizeof(int));
+    newD->numHigh       = 0;
+    newD->maxCount      = 0;
+    newD->maxStale      = false;
+    meter::reset(newD->counted);
+    if (kind == FLAT) {
+      flatAllocate(newD,flatSlots(initialSize < MAX_BUCKETS ? initialSize : MAX_BUCKETS));
+    } else {
+      newD->numBuckets  = powerOfTwoAtLeast(initialSize < MAX_BUCKETS ? initialSize : MAX_BUCKETS);
+      newD->buckets     = buildBuckets<Count>(newD->numBuckets);
+    }
     return newD;
   }
 
@@ -165,7 +595,8 @@ namespace freq {
   //
   // Gives back the number of entries stored in the dictionary `D`.
   //
-  int numKeys(dict* D) {
+  template <class Count>
+  int numKeys(basic_dict<Count>* D) {
     return D->numEntries;
   }
 
@@ -173,7 +604,8 @@ namespace freq {
   //
   // Gives back the total of the counts of all the entries in `D`.
   //
-  int totalCount(dict* D) {
+  template <class Count>
+  unsigned long long totalCount(basic_dict<Count>* D) {
     return D->numIncrements;
   }
 
@@ -182,151 +614,591 @@ namespace freq {
   //
   // Gets the count associated with the word `w` in `D`.
   //
-  int getCount(dict* D, std::string w) {
+  template <class Count>
+  Count getCount(basic_dict<Count>* D, std::string_view w) {
+    return getCountHashed(D,w,hash64(w.data(),w.size()));
+  }
 
-    int bucketIndex = hashValue(w,D->numBuckets);
-    entry* currentEntry=D->buckets[bucketIndex].first;
-    if(currentEntry==nullptr){
+  // getCountHashed(D,w,h):
+  //
+  // The same as `getCount(D,w)`, given the hash `h` of `w`, for a
+  // caller that already needed it.
+  //
+  template <class Count>
+  Count getCountHashed(basic_dict<Count>* D, std::string_view w, unsigned long long h) {
+
+    if (D->kind == FLAT) {
+      return flatGetCount(D,w.data(),w.size(),h);
+    }
+    node<Count>* e = findEntry(D,w.data(),w.size(),h);
+    if (e == nullptr) {
       return 0;
     }
+    return e->count;
+  }
 
-    do{
-      if(currentEntry->word == w){
-        return currentEntry->count;
-      }
-      currentEntry = currentEntry->next;
-    }while(currentEntry!=nullptr);
-    return 0;
+  // setRehashStep(D,step):
+  //
+  // Chooses how `D` grows its table. With a `step` of zero, `rehash`
+  // moves every entry at once. Otherwise the old and new tables are
+  // kept side by side and each `increment` moves `step` more of the
+  // old buckets, so no single call pays for the whole move.
+  //
+  template <class Count>
+  void setRehashStep(basic_dict<Count>* D, int step) {
+    D->rehashStep = step;
   }
 
   // rehash(D):
   //
-  // Roughly doubles the hash table of `D` and places its entries into
-  // that new structure.
+  // Doubles the hash table of `D` and places its entries into that new
+  // structure, using the hash cached in each entry. Incrementally
+  // rehashed dictionaries only start that move here.
   //
-  void rehash(dict* D) {
+  template <class Count>
+  void rehash(basic_dict<Count>* D) {
+    long long started = meter::stamp();
 
-    //we want to keep track of the old stuff to put them into the new buckets
-    int oldNumBuckets = D->numBuckets;
-    bucket* oldTable = D->buckets;
+    //any earlier move gets finished first
+    if (D->oldBuckets != nullptr) {
+      migrate(D,D->oldNumBuckets);
+    }
+
+    //we keep track of the old buckets to move them into the new ones
+    D->oldBuckets    = D->buckets;
+    D->oldNumBuckets = D->numBuckets;
+    D->migrated      = 0;
 
     //creates the new buckets and updates numBuckets
-    D->numBuckets = primeAtLeast(2*D->numBuckets);
-    D->buckets = buildBuckets(D->numBuckets);
-
-    //iterates through the old buckets
-    for(int i = 0 ; i < oldNumBuckets; i++){
-      entry* currentEntry = oldTable[i].first;
-      while(currentEntry!=nullptr){
-
-	//we get the newBucket index and see if that bucket is empty
-	entry* nextEntry = currentEntry->next;
-	int newBucketIndex = hashValue(currentEntry->word,D->numBuckets);
-
-	//if it is empty, we just put the old entry at the beginning 
-	if(D->buckets[newBucketIndex].first ==nullptr){
-	  D->buckets[newBucketIndex].first = currentEntry;
-	  currentEntry->next= nullptr;
-	}
-	//if it isn't empty, we stitch the old entry at the beginning of the list
-	else{
-	  currentEntry->next = D->buckets[newBucketIndex].first;
-	  D->buckets[newBucketIndex].first = currentEntry;
-	}
-	currentEntry= nextEntry;
+    D->numBuckets = 2*D->numBuckets;
+    D->buckets = buildBuckets<Count>(D->numBuckets);
 
-      }
-      
+    //without a step, everything moves now
+    if (D->rehashStep == 0) {
+      migrate(D,D->oldNumBuckets);
+    }
+    meter::rehashed(D->counted,started);
+  }
+
+  // addHashed(D,w,length,h,by):
+  //
+  // Adds `by` to the count associated with the word of `length`
+  // characters at `w`, whose hash is `h`, in `D`, possibly creating a
+  // new entry.
+  //
+  template <class Count>
+  void addHashed(basic_dict<Count>* D, const char* w, int length, unsigned long long h, Count by) {
+
+    if (D->kind == FLAT) {
+      flatAdd(D,w,length,h,by);
+      return;
+    }
+
+    //move a few more buckets along if we are rehashing incrementally
+    if (D->oldBuckets != nullptr) {
+      migrate(D,D->rehashStep);
+    }
+
+    //if we are over the load factor, we rehash, unless the table can't
+    //grow any more
+    if((D->numEntries+1LL)/D->numBuckets > D->loadFactor && D->numBuckets < MAX_BUCKETS){
+      rehash(D);
+    }
+
+    //if we find the entry, we increment its count
+    node<Count>* currentEntry = findEntry(D,w,length,h);
+    if (currentEntry != nullptr) {
+      by = room(currentEntry->count,by);
+      D->numIncrements += by;
+      currentEntry->count += by;
+      recount<Count>(D,currentEntry->count-by,currentEntry->count);
+      return;
+    }
+
+    //otherwise we put a new entry at the front of its bucket's list,
+    //reusing one that was removed if there is one
+    if (D->numEntries == std::numeric_limits<int>::max()) {
+      throw std::length_error("freq::dict: a CHAINED table can't hold any more words");
     }
-    //reallocates space from the old table
-    delete [] oldTable;
+    int bucketIndex = h & (D->numBuckets-1);
+    node<Count>* newEntry = D->spare;
+    if (newEntry != nullptr) {
+      D->spare = newEntry->next;
+    } else {
+      newEntry = static_cast<node<Count>*>(arena::allocate(D->nodes,sizeof(node<Count>),alignof(node<Count>)));
+    }
+    placeWord(D,*newEntry,w,length);
+    newEntry->count = by;
+    newEntry->hash = h;
+    newEntry->next = D->buckets[bucketIndex].first;
+    D->buckets[bucketIndex].first = newEntry;
+    D->numEntries++;
+    D->numIncrements += by;
+    recount<Count>(D,0,by);
   }
 
   // increment(D,w):
   //
   // Adds one to the count associated with word `w` in `D`, possibly
-  // creating a new entry.
-  //
-  void increment(dict* D, std::string w) {
-
-    //if we are over the load factor, we rehash
-   if((D->numEntries+1)/D->numBuckets > D->loadFactor){
-     rehash(D);
-   }
-
-   //we increment increments, and find the index of our bucket
-    D->numIncrements++;
-    int bucketIndex = hashValue(w,D->numBuckets);
-
-    //we create a new entry in case we need it
-    entry* currentEntry=D->buckets[bucketIndex].first;
-    entry* newEntry = new entry;
-    newEntry->word = w;
-    newEntry->count = 1;
-
-    //if the bucket is empty, we put the new entry there
-    if(currentEntry==nullptr){
-      D->buckets[bucketIndex].first = newEntry;
-      newEntry->next = nullptr;
-      D->numEntries++;
-    }
-    //if the bucket isn't empty
-    else{
-      entry* prevEntry = nullptr;
-      do{
-	//if we find the entry, we increment it's count
-	if(currentEntry->word == w){
-	  currentEntry->count++;
-	  delete newEntry;
-	  return;
-	  
+  // creating a new entry. The word is looked up where it is, and its
+  // characters are copied into `D` only if it is new.
+  //
+  template <class Count>
+  void increment(basic_dict<Count>* D, std::string_view w) {
+    addHashed<Count>(D,w.data(),w.size(),hash64(w.data(),w.size()),1);
+  }
+
+  // incrementHashed(D,w,h):
+  //
+  // The same as `increment(D,w)`, given the hash `h` of `w`, for a
+  // caller that already needed it.
+  //
+  template <class Count>
+  void incrementHashed(basic_dict<Count>* D, std::string_view w, unsigned long long h) {
+    addHashed<Count>(D,w.data(),w.size(),h,1);
+  }
+
+  // increment(D,w,by):
+  //
+  // Adds `by` to the count associated with word `w` in `D`, as though
+  // `increment(D,w)` were called `by` times.
+  //
+  template <class Count>
+  void increment(basic_dict<Count>* D, std::string_view w, unsigned long long by) {
+    addHashed(D,w.data(),w.size(),hash64(w.data(),w.size()),(Count)std::min<unsigned long long>(by,std::numeric_limits<Count>::max()));
+  }
+
+  // unlink(b,e):
+  //
+  // Takes the entry `e` out of the list of bucket `b`, if it's there.
+  // Returns whether it was.
+  //
+  template <class Count>
+  bool unlink(bucket<Count>& b, node<Count>* e) {
+    node<Count>** link = &b.first;
+    while (*link != nullptr) {
+      if (*link == e) {
+	*link = e->next;
+	return true;
+      }
+      link = &(*link)->next;
+    }
+    return false;
+  }
+
+  // subtractHashed(D,w,length,h,by):
+  //
+  // Takes `by` from the count associated with the word of `length`
+  // characters at `w`, whose hash is `h`, in `D`, but not below zero.
+  // A word whose count reaches zero is removed, and its entry kept
+  // to be used again.
+  //
+  template <class Count>
+  void subtractHashed(basic_dict<Count>* D, const char* w, int length, unsigned long long h, Count by) {
+
+    if (D->kind == FLAT) {
+      flatSubtract(D,w,length,h,by);
+      return;
+    }
+
+    node<Count>* e = findEntry(D,w,length,h);
+    if (e == nullptr) {
+      return;
+    }
+    by = by < e->count ? by : e->count;
+    D->numIncrements -= by;
+    e->count -= by;
+    recount<Count>(D,e->count+by,e->count);
+    if (e->count == 0) {
+      //it's in the new table, or else in its unmigrated old bucket
+      if (!unlink(D->buckets[h & (D->numBuckets-1)],e)) {
+	unlink(D->oldBuckets[h & (D->oldNumBuckets-1)],e);
+      }
+      e->next = D->spare;
+      D->spare = e;
+      D->numEntries--;
+    }
+  }
+
+  // decrement(D,w):
+  //
+  // Takes one from the count associated with word `w` in `D`, undoing
+  // one `increment(D,w)`. The word is removed once its count is zero.
+  // A word not in `D` is left alone.
+  //
+  template <class Count>
+  void decrement(basic_dict<Count>* D, std::string_view w) {
+    subtractHashed<Count>(D,w.data(),w.size(),hash64(w.data(),w.size()),1);
+  }
+
+  // decrement(D,w,by):
+  //
+  // Takes `by` from the count associated with word `w` in `D`, as
+  // though `decrement(D,w)` were called `by` times.
+  //
+  template <class Count>
+  void decrement(basic_dict<Count>* D, std::string_view w, unsigned long long by) {
+    subtractHashed(D,w.data(),w.size(),hash64(w.data(),w.size()),(Count)std::min<unsigned long long>(by,std::numeric_limits<Count>::max()));
+  }
+
+  // eachEntry(D,visit):
+  //
+  // Calls `visit` on a pointer to every entry of `D`, whichever engine
+  // it uses. Each chained entry is done with before it is visited, so
+  // `visit` may relink it.
+  //
+  template <class Count, class Visitor>
+  void eachEntry(basic_dict<Count>* D, Visitor visit) {
+    if (D->kind == FLAT) {
+      for (int i=0; i<D->numBuckets; i++) {
+	if (isFull(D->control[i])) {
+	  visit(&D->slots[i]);
 	}
-	prevEntry = currentEntry;
-	currentEntry = currentEntry->next;
-      }while(currentEntry!=nullptr);
+      }
+      return;
+    }
+    for (int i=0; i<D->numBuckets; i++) {
+      node<Count>* e = D->buckets[i].first;
+      while (e != nullptr) {
+	node<Count>* nextEntry = e->next;
+	visit(e);
+	e = nextEntry;
+      }
+    }
+    for (int i=D->migrated; i<D->oldNumBuckets; i++) {
+      node<Count>* e = D->oldBuckets[i].first;
+      while (e != nullptr) {
+	node<Count>* nextEntry = e->next;
+	visit(e);
+	e = nextEntry;
+      }
+    }
+  }
 
-      //otherwise we just add the new entry at the end of this bucket's list
-      prevEntry->next = newEntry;
-      newEntry->next =nullptr;
-      D->numEntries++;
+  // copyEntry(into,from):
+  //
+  // Copies the word and count of the entry `from` into `into`.
+  //
+  template <class Count>
+  void copyEntry(entry& into, const node<Count>* from) {
+    into.word.assign(from->word,from->length);
+    into.count = from->count;
+  }
+
+  // ranksAbove(a,b):
+  //
+  // Whether entry `a` ranks above entry `b`: it has a higher count, or
+  // the same count and a word earlier in alphabetical order.
+  //
+  template <class Count>
+  bool ranksAbove(const node<Count>* a, const node<Count>* b) {
+    return a->count > b->count || (a->count == b->count && compareWords(a,b) < 0);
+  }
+
+  // numWithCount(D,c):
+  //
+  // Gives back how many words of `D` have a count of exactly `c`.
+  //
+  template <class Count>
+  int numWithCount(basic_dict<Count>* D, unsigned long long c) {
+    if (c >= HIST_LIMIT) {
+      int n = 0;
+      eachEntry(D,[&](const node<Count>* e) {
+	if (e->count == c) {
+	  n++;
+	}
+      });
+      return n;
     }
+    if (c == 0 || c >= (unsigned long long)D->histSize) {
+      return 0;
+    }
+    return D->countHist[c];
   }
 
-  // dumpAndDestroy(D):
+  // highestCount(D):
   //
-  // Return an array of all the entries stored in `D`, sorted from
-  // most to least frequent.
+  // Gives back the largest count of any word in `D`. Should that have
+  // been lost by a word counted past the histogram, it is found again
+  // by looking through the entries.
   //
-  // Deletes all the heap-allocated components of `D`.
+  template <class Count>
+  Count highestCount(basic_dict<Count>* D) {
+    if (D->maxStale) {
+      D->maxCount = 0;
+      eachEntry(D,[&](const node<Count>* e) {
+	if (e->count > D->maxCount) {
+	  D->maxCount = e->count;
+	}
+      });
+      D->maxStale = false;
+    }
+    return D->maxCount;
+  }
+
+  // topK(D,k):
   //
-  entry* dumpAndDestroy(dict* D) {
-    //we iterate through the entries 
+  // Return a new array of the `k` top-ranked entries of `D` (or all of
+  // them, if it has fewer), sorted from most to least frequent. Words
+  // with equal counts come in alphabetical order.
+  //
+  // Keeps a heap of the best `k` seen so far, with the lowest-ranked
+  // of them at its root, so this takes O(n log k) time. `D` is left
+  // unchanged.
+  //
+  template <class Count>
+  entry* topK(basic_dict<Count>* D, int k) {
+    if (k > D->numEntries) {
+      k = D->numEntries;
+    }
+    if (k <= 0) {
+      return new entry[0];
+    }
+    const node<Count>** heap = new const node<Count>*[k];
+    int size = 0;
+
+    eachEntry(D,[&](const node<Count>* e) {
+      int i;
+      if (size < k) {
+	//still filling the heap: sift the new entry up
+	i = size++;
+	while (i > 0 && ranksAbove(heap[(i-1)/2],e)) {
+	  heap[i] = heap[(i-1)/2];
+	  i = (i-1)/2;
+	}
+	heap[i] = e;
+      } else if (ranksAbove(e,heap[0])) {
+	//it beats the worst of the best: sift it down from the root
+	i = 0;
+	while (true) {
+	  int child = 2*i+1;
+	  if (child >= k) {
+	    break;
+	  }
+	  if (child+1 < k && ranksAbove(heap[child],heap[child+1])) {
+	    child++;
+	  }
+	  if (!ranksAbove(e,heap[child])) {
+	    break;
+	  }
+	  heap[i] = heap[child];
+	  i = child;
+	}
+	heap[i] = e;
+      }
+    });
+
+    //empty the heap from the back of the array, worst first
+    entry* es = new entry[k];
+    while (size > 0) {
+      const node<Count>* worst = heap[0];
+      const node<Count>* last = heap[--size];
+      int i = 0;
+      while (true) {
+	int child = 2*i+1;
+	if (child >= size) {
+	  break;
+	}
+	if (child+1 < size && ranksAbove(heap[child],heap[child+1])) {
+	  child++;
+	}
+	if (!ranksAbove(last,heap[child])) {
+	  break;
+	}
+	heap[i] = heap[child];
+	i = child;
+      }
+      heap[i] = last;
+      copyEntry(es[size],worst);
+    }
+    delete [] heap;
+    return es;
+  }
+
+  // snapshot(D):
+  //
+  // Return a new array of all the entries of `D`, sorted from most to
+  // least frequent, leaving `D` unchanged.
+  //
+  // This is a counting sort: the histogram of counts tells where the
+  // block of words with each count starts, so every entry is copied
+  // straight to its place. It takes O(n + highestCount) time. Words
+  // with equal counts come in the order they sit in the table.
+  //
+  // The few words counted past the histogram go first, sorted among
+  // themselves.
+  //
+  template <class Count>
+  entry* snapshot(basic_dict<Count>* D) {
+    Count most = highestCount(D);
+    int top = most < (Count)D->histSize ? (int)most : D->histSize-1;
+    int* next = new int[top+1];
+    int place = D->numHigh;
+    for (int c = top; c > 0; c--) {
+      next[c] = place;
+      place += D->countHist[c];
+    }
     entry* es = new entry[D->numEntries];
-    int nextOpenSpot = 0;
-    entry* currentEntry;
-    for(int i = 0; i< D->numBuckets ; i++){
-      currentEntry=D->buckets[i].first;
-      while(currentEntry!=nullptr){
-	es[nextOpenSpot] = *currentEntry;
-	int iterator = nextOpenSpot;
-	//here we use a simplified version of insetion sort so that the array is in desending order (with respect to count)
-	while(iterator >0 and es[iterator-1].count < es[iterator].count){
-	  //swaps the entry we just added and the one before it	  
-	  entry placeHolder = es[iterator-1];
-	  es[iterator-1] = es[iterator];
-	  es[iterator] = placeHolder;
-	  iterator--;
+    int high = 0;
+    eachEntry(D,[&](const node<Count>* e) {
+      if (e->count < HIST_LIMIT) {
+	copyEntry(es[next[e->count]++],e);
+      } else {
+	copyEntry(es[high++],e);
+      }
+    });
+    std::stable_sort(es,es+high,[](const entry& a, const entry& b) {
+      return a.count > b.count;
+    });
+    delete [] next;
+    return es;
+  }
+
+  // merge(into,from):
+  //
+  // Adds the count of every word of `from` into `into`, as though all
+  // the `increment` calls made on `from` had been made on `into`.
+  // Reuses the cached hashes, so no word is hashed again. `from` is
+  // left unchanged.
+  //
+  template <class Count>
+  void merge(basic_dict<Count>* into, basic_dict<Count>* from) {
+    eachEntry(from,[&](const node<Count>* e) {
+      addHashed(into,e->word,e->length,e->hash,e->count);
+    });
+  }
+
+  // measure(D,T):
+  //
+  // Fills in the table readings `T` with the shape of the hash table of
+  // `D`, and with what `D` has counted so far.
+  //
+  // A chained bucket holds the entries of its list, and finding the
+  // entry `i` places along it takes `i` comparisons. The old buckets
+  // not yet moved by an incremental rehash count as buckets too. For
+  // the FLAT engine each group of 16 slots counts as a bucket, and
+  // finding an entry takes one comparison for each group its probe
+  // visits, its own group included.
+  //
+  template <class Count>
+  void measure(basic_dict<Count>* D, meter::table* T) {
+    T->numEntries = D->numEntries;
+    T->counts = true;
+    T->counted = D->counted;
+    if (D->kind == FLAT) {
+      int groupMask = D->numBuckets/GROUP - 1;
+      T->numBuckets = D->numBuckets/GROUP;
+      for (int group=0; group<=groupMask; group++) {
+	int full = 0;
+	for (int i=group*GROUP; i<(group+1)*GROUP; i++) {
+	  if (!isFull(D->control[i])) {
+	    continue;
+	  }
+	  full++;
+	  //follow its probe from its first group to where it sits
+	  int at = (D->slots[i].hash >> 7) & groupMask;
+	  long compared = 1;
+	  for (int step = 1; at != group; step++) {
+	    at = (at + step) & groupMask;
+	    compared++;
+	  }
+	  meter::tally(T->chains,compared);
+	  T->sumChains += compared;
+	  T->longest = compared > T->longest ? compared : T->longest;
 	}
-	nextOpenSpot++;
-	entry* toBeDeleted = currentEntry;
-	currentEntry= currentEntry->next;
-	delete toBeDeleted;
+	meter::tally(T->occupancy,full);
       }
+      return;
+    }
+    T->numBuckets = D->numBuckets + D->oldNumBuckets - D->migrated;
+    for (int which=0; which<2; which++) {
+      bucket<Count>* buckets = which == 0 ? D->buckets : D->oldBuckets;
+      int from = which == 0 ? 0 : D->migrated;
+      int to = which == 0 ? D->numBuckets : D->oldNumBuckets;
+      for (int b=from; b<to; b++) {
+	long length = 0;
+	for (node<Count>* e = buckets[b].first; e != nullptr; e = e->next) {
+	  length++;
+	  meter::tally(T->chains,length);
+	  T->sumChains += length;
+	}
+	meter::tally(T->occupancy,length);
+	T->longest = length > T->longest ? length : T->longest;
+      }
+    }
+  }
+
+  // destroy(D):
+  //
+  // Deletes all the heap-allocated components of `D`. The entries and
+  // words go with the chunks of their pools, so none is visited.
+  //
+  template <class Count>
+  void destroy(basic_dict<Count>* D) {
+    if (D->kind == FLAT) {
+      delete [] D->slots;
+      delete [] D->control;
+      mem::freed(mem::FREQ_ENTRIES,D->numBuckets*sizeof(node<Count>));
+      mem::freed(mem::FREQ_TABLE,D->numBuckets);
+    } else {
+      std::free(D->buckets);
+      std::free(D->oldBuckets);
+      mem::freed(mem::FREQ_TABLE,(D->numBuckets+D->oldNumBuckets)*sizeof(bucket<Count>));
     }
-    //reallocate space
-    delete [] D->buckets;
+    arena::destroy(D->words);
+    arena::destroy(D->nodes);
+    delete [] D->countHist;
+    mem::freed(mem::FREQ_COUNTS,D->histSize*sizeof(int));
     delete D;
+  }
+
+  // dumpAndDestroy(D):
+  //
+  // Return an array of all the entries stored in `D`, sorted from
+  // most to least frequent.
+  //
+  // Deletes all the heap-allocated components of `D`.
+  //
+  template <class Count>
+  entry* dumpAndDestroy(basic_dict<Count>* D) {
+    entry* es = snapshot(D);
+    destroy(D);
     return es;
   }
-} // end namespace freq
 
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// THE TWO WIDTHS
+//
+// The templates above are compiled here for the two types of count
+// named in "freq.hh", so that the rest of the program only needs the
+// header.
+//
+#define FREQ_WIDTH(Count) \
+  template basic_dict<Count>* build<Count>(int, int); \
+  template basic_dict<Count>* build<Count>(int, int, engine); \
+  template int numKeys(basic_dict<Count>*); \
+  template unsigned long long totalCount(basic_dict<Count>*); \
+  template void increment(basic_dict<Count>*, std::string_view); \
+  template void increment(basic_dict<Count>*, std::string_view, unsigned long long); \
+  template void incrementHashed(basic_dict<Count>*, std::string_view, unsigned long long); \
+  template void decrement(basic_dict<Count>*, std::string_view); \
+  template void decrement(basic_dict<Count>*, std::string_view, unsigned long long); \
+  template void merge(basic_dict<Count>*, basic_dict<Count>*); \
+  template Count getCount(basic_dict<Count>*, std::string_view); \
+  template Count getCountHashed(basic_dict<Count>*, std::string_view, unsigned long long); \
+  template void setRehashStep(basic_dict<Count>*, int); \
+  template entry* topK(basic_dict<Count>*, int); \
+  template entry* snapshot(basic_dict<Count>*); \
+  template int numWithCount(basic_dict<Count>*, unsigned long long); \
+  template Count highestCount(basic_dict<Count>*); \
+  template void measure(basic_dict<Count>*, meter::table*); \
+  template void destroy(basic_dict<Count>*); \
+  template entry* dumpAndDestroy(basic_dict<Count>*);
+
+  FREQ_WIDTH(std::uint32_t)
+  FREQ_WIDTH(std::uint64_t)
+
+#undef FREQ_WIDTH
+
+} // end namespace freq
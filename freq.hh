@@ -5,26 +5,72 @@
 //
 // This defines the data structure for Project 1 of the Spring 2020
 // offering of CSCI 221, along with its public interface of functions.
-// 
+//
 // This defines a bucket hash table as a type `freq::dict*` that stores
 // a collection of words and their integer counts.
 //
+// The table can be built with one of two engines behind the same
+// interface: the original chained buckets of `entry` nodes, or a flat
+// open-addressing array of entries whose probing is steered by a
+// parallel array of one-byte control tags, checked 16 at a time.
+//
+// The words themselves are packed into a string pool, and the chained
+// engine's entries into an arena, both from "arena.hh", so that a
+// whole dictionary is given back with a few frees.
+//
+// The type of each word's count is a template parameter `Count` of
+// `freq::basic_dict`, chosen when the dictionary is built. A
+// `freq::dict` counts with 64 bits, so no count wraps around however
+// long the text; a `freq::compact` counts with 32 bits, which makes
+// each entry 8 bytes smaller, for counts known to stay below about
+// four billion. A count that would pass the largest its type holds
+// stops there instead of wrapping around. Either way the total of all
+// the counts is kept in 64 bits. The functions are compiled for these two widths only.
+//
 // It is described more within the README.
 //
 
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "meter.hh"
+#include "arena.hh"
+
 namespace freq {
 
   // entry
   //
-  // A linked list node for word/count entries in the dictionary.
+  // A word and its count, as given back by `topK`, `snapshot` and
+  // `dumpAndDestroy`. It holds its own copy of the word, and its count
+  // in 64 bits whatever the width of the dictionary it came from.
   //
   struct entry {
 
     std::string word;  // The word that serves as the key for this entry.
 
-    int count;         // The integer count associated with that word.
+    unsigned long long count; // The count associated with that word.
+  };
+
+  // node
+  //
+  // A linked list node for word/count entries in the dictionary, or a
+  // slot of its FLAT table. The word is not its own but the dictionary's,
+  // kept in its string pool.
+  //
+  template <class Count>
+  struct node {
+
+    const char* word;  // The characters of the word that serves as the key,
+		       // followed by a zero.
+
+    int length;        // How many characters the word has.
+
+    Count count;       // The count associated with that word.
 
-    struct entry* next;
+    unsigned long long hash; // The full hash of `word`, kept so that it
+			     // is never recomputed.
+
+    struct node* next;
   };
 
   // bucket
@@ -32,48 +78,188 @@ namespace freq {
   // A bucket serving as the collection of entries that map to a
   // certain location within a bucket hash table.
   //
+  template <class Count>
   struct bucket {
 
-    entry* first;  // It's just a pointer to the first entry in the
-		   // bucket list.
+    node<Count>* first; // It's just a pointer to the first entry in the
+			// bucket list.
   };
 
-  // dict
+  // engine
+  //
+  // The ways a `freq::dict` can organize its hash table.
+  //
+  enum engine {
+    CHAINED,  // An array of buckets, each a linked list of entries.
+    FLAT      // One array of entries with open addressing. Each slot
+	      // has a control byte: EMPTY, or 7 bits of the key's hash.
+  };
+
+  // The largest count the histogram of counts has a place for. Words
+  // counted more often are few, and are ranked by sorting them.
+  const int HIST_LIMIT = 1 << 20;
+
+  // The most buckets, or FLAT slots, a table can have. Its sizes are
+  // `int`s, so it can't double past this. A CHAINED table that big
+  // goes on with longer chains, up to the most words an `int` counts;
+  // a FLAT one can hold 7/8 of its slots. Past that, adding a word
+  // throws `std::length_error`.
+  const int MAX_BUCKETS = 1 << 30;
+
+  // basic_dict
   //
   // The unordered dictionary of word/count entries, organized as a
-  // bucket hash table.
+  // bucket hash table, whose counts are of the type `Count`.
   //
-  struct dict {
+  template <class Count>
+  struct basic_dict {
+
+    engine kind;       // Which of the two tables below is in use.
+
+    bucket<Count>* buckets; // An array of buckets, indexed by the hash function.
+			    // Used by the CHAINED engine.
+
+    bucket<Count>* oldBuckets; // While the CHAINED table is being rehashed
+			       // incrementally, the smaller table its entries
+			       // are moving out of. Otherwise nullptr.
+
+    int oldNumBuckets; // The size of `oldBuckets`.
 
-    bucket* buckets;   // An array of buckets, indexed by the hash function.
+    int migrated;      // How many of `oldBuckets` have been moved so far.
+		       // Searches only look at the ones after these.
 
-    int numIncrements; // Total count over all entries. Number of `increment` calls.
+    int rehashStep;    // How many old buckets each `increment` moves. When
+		       // zero, `rehash` moves them all at once.
 
-    int numBuckets;    // The array is indexed from 0 to numBuckets.
+    int* countHist;    // The frequency of each count: countHist[c] is how
+		       // many entries have a count of exactly c, for counts
+		       // below HIST_LIMIT.
+
+    int histSize;      // The length of the `countHist` array. It grows as
+		       // the counts do, up to HIST_LIMIT.
+
+    int numHigh;       // How many entries have a count of HIST_LIMIT or more.
+
+    Count maxCount;    // The largest count of any entry,
+
+    bool maxStale;     // unless this is set: a word with a count past the
+		       // histogram lost the largest count, and the next
+		       // largest hasn't been looked for yet.
+
+    node<Count>* slots; // An array of numBuckets entries, probed in groups
+			// of 16. Used by the FLAT engine.
+
+    unsigned char* control; // The control byte of each slot. Used by the
+			    // FLAT engine.
+
+    unsigned long long numIncrements; // Total count over all entries. Number of
+				      // `increment` calls, less those undone by
+				      // `decrement`.
+
+    int numBuckets;    // The array is indexed from 0 to numBuckets. Always
+		       // a power of two.
 
     int numEntries;    // The total number of entries in the whole
 		       // dictionary, distributed amongst its buckets.
 
+    int numDeleted;    // How many slots of the FLAT engine were left
+		       // DELETED by removed entries.
+
     int loadFactor;    // The threshold maximum average size of the
 		       // buckets. When numEntries/numBuckets exceeds
 		       // this loadFactor, the table gets rehashed.
+		       // The FLAT engine instead grows once 7/8 of
+		       // its slots are full.
+
+    arena::pool* words; // The characters of every word, back to back.
+
+    arena::pool* nodes; // The entries of the CHAINED engine.
+
+    node<Count>* spare; // Entries that were removed, linked by `next`, to be
+			// used again before `nodes` hands out more.
+
+    meter::counters counted; // Its lookups and rehashes, when built with
+			     // METER. See "meter.hh".
   };
 
+  // The two widths of dictionary.
+  typedef basic_dict<std::uint64_t> dict;
+  typedef basic_dict<std::uint32_t> compact;
+
   //
-  // The public interface to freq::dict objects.
+  // The public interface to freq::dict objects. Those built with
+  // `build<std::uint32_t>` are `freq::compact` objects, and all but
+  // `build` work on both.
   //
-  dict* build(int initialSize, int loadFactor); // Constructs and returns a new `freq::dict`.
+  template <class Count = std::uint64_t>        // Constructs and returns a new `freq::dict`.
+  basic_dict<Count>* build(int initialSize, int loadFactor);
+  template <class Count = std::uint64_t>        // Constructs one using the given engine.
+  basic_dict<Count>* build(int initialSize, int loadFactor, engine kind);
+
+  template <class Count>
+  int numKeys(basic_dict<Count>* D);            // Returns the number of entries in `D`.
+  template <class Count>
+  unsigned long long totalCount(basic_dict<Count>* D); // Returns the sum of the counts of the words in `D`.
+
+  template <class Count>
+  void increment(basic_dict<Count>* D,          // Updates the count of a word `k` in `D`. Only a word
+		 std::string_view k);           // not yet in `D` has anything allocated for it.
+  template <class Count>
+  void increment(basic_dict<Count>* D,          // Adds `by` to the count of word `k` in `D`.
+		 std::string_view k, unsigned long long by);
+
+  template <class Count>
+  void incrementHashed(basic_dict<Count>* D,    // The same as `increment(D,k)`, given `h`, the
+		       std::string_view k,      // `hashing::hash64` of `k`, for callers that
+		       unsigned long long h);   // already needed it.
+
+  template <class Count>
+  void decrement(basic_dict<Count>* D,          // Takes one from the count of word `k` in `D`, removing
+		 std::string_view k);           // the word once its count reaches zero.
+  template <class Count>
+  void decrement(basic_dict<Count>* D,          // Takes `by` from the count of word `k` in `D`.
+		 std::string_view k, unsigned long long by);
+
+  template <class Count>
+  void merge(basic_dict<Count>* into,           // Adds all the counts of `from` into `into`.
+	     basic_dict<Count>* from);
+
+  template <class Count>
+  Count getCount(basic_dict<Count>* D,          // Gets the count of word `k` in `D`.
+		 std::string_view k);
+  template <class Count>
+  Count getCountHashed(basic_dict<Count>* D,    // The same, given `h`, the `hashing::hash64` of `k`.
+		       std::string_view k, unsigned long long h);
+
+  template <class Count>
+  void setRehashStep(basic_dict<Count>* D,      // Makes `D` grow its table by moving `step` buckets
+		     int step);                 // per `increment` rather than all at once.
+
+  template <class Count>
+  entry* topK(basic_dict<Count>* D, int k);     // Gives back a new array of the `k` most frequent entries
+                                                // of `D`, most frequent first, leaving `D` intact.
+
+  template <class Count>
+  entry* snapshot(basic_dict<Count>* D);        // Gives back a new array of all `numKeys(D)` entries,
+                                                // most frequent first, leaving `D` intact.
 
-  int numKeys(dict* D);                         // Returns the number of entries in `D`. 
-  int totalCount(dict* D);                      // Returns the number of `increment` calls made on `D`.
+  template <class Count>
+  int numWithCount(basic_dict<Count>* D,        // Returns how many words of `D` have a count of exactly `c`.
+		   unsigned long long c);
+  template <class Count>
+  Count highestCount(basic_dict<Count>* D);     // Returns the largest count of any word in `D`.
 
-  void increment(dict* D, std::string k);       // Updates the count of a word `k` in `D`.
+  template <class Count>
+  void measure(basic_dict<Count>* D,            // Fills in `T` with the shape of the table of `D` and
+	       meter::table* T);                // what it has counted.
 
-  int getCount(dict* D, std::string k);         // Gets the count of word `k` in `D`.
+  template <class Count>
+  void destroy(basic_dict<Count>* D);           // Returns the storage of `D` back to the heap.
 
-  entry* dumpAndDestroy(dict* D);               // Gives back a summary of `D` and returns its storage of
-                                                // back to the heap. Communicates the number of entries
-                                                // in the summary using `sizep`.
+  template <class Count>
+  entry* dumpAndDestroy(basic_dict<Count>* D);  // Gives back a new array of all `numKeys(D)` entries,
+                                                // most frequent first, and returns the storage of `D`
+                                                // back to the heap.
 
 }
 
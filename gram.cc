@@ -1,256 +1,709 @@
 #include <string>
+#include <string_view>
 #include <iostream>
+#include <algorithm>
 #include "gram.hh"
-#include <ctime>
+#include "vocab.hh"
+#include "hash.hh"
+#include "rng.hh"
+#include "meter.hh"
+#include "mem.hh"
+#include "arena.hh"
 #include <cstdlib>
+#include <thread>
 
-bool isPrime(int n) {
-  // Handle the obvious cases, including even ones.
-  if ((n <= 2) || (n % 2 == 0)) {
-    return (n == 2);
-  }
-  // Try several odd divisors.
-  int d = 3;
-  while (d*d <= n) {
-    if (n % d == 0) {
-      // It has a divisor. It's not prime.
-      return false;
-    }
-    d += 2;
-  }
-  // No divisors. It's prime.
-  return true;
-}
-
-int primeAtLeast(int n) {
-  if (n <= 2) {
-    return 2;
-  }
-  int p = 3;
-  while (p < n || !isPrime(p)) {
-    p += 2;
-  }
-  return p;
-}
-
-int charToInt(char c) {
-  if (c >= 'a' && c <= 'z') {
-    return c - 'a' + 1;
-  } else if (c == '.') {
-    return 27;
-  } else if (c == '!') {
-    return 28;
-  } else if (c == '?') {
-    return 29;
-  } else if (c == '\'') {
-    return 30;
-  } else if (c == ' ') {
-    return 31;
-  } else {
-    return 0;
-  }
-}
-
-int hashValue(std::string key, int modulus) {
-  int hashValue = 0;
-  for (char c: key) {
-    // Horner's method for computing the value.
-    hashValue = (32*hashValue + charToInt(c)) % modulus;
-  }
-  return hashValue;
-}
+using hashing::hashInt;
+using hashing::powerOfTwoAtLeast;
 
 namespace gram {
 
+  //how many grams are allocated at once
+  const int BLOCK = 1024;
+
+  //(every allocation and free below is counted against its part in mem.hh;
+  //the follower arrays and alias tables come from the dict's arenas, so
+  //they are counted a chunk at a time, and all go at once in destroy)
+
+  //makes an array of empty buckets; calloc hands back fresh zeroed pages
+  //for big tables without touching them, so this never stalls
   bucket* buildBuckets(int howMany) {
-    bucket* bs = new bucket[howMany];
-    for (int i=0; i<howMany; i++) {
-      bs[i].first = nullptr;
+    mem::allocated(mem::GRAM_TABLE,howMany*sizeof(bucket));
+    return static_cast<bucket*>(std::calloc(howMany,sizeof(bucket)));
+  }
+
+  //puts each gram of a list at the front of its bucket in a table
+  void moveChain(gram* oldGram, bucket* buckets, int numBuckets){
+    while(oldGram!=nullptr){
+      int newIndex = hashInt(oldGram->key) & (numBuckets-1);
+      gram* nextGram = oldGram->next;
+      oldGram->next = buckets[newIndex].first;
+      buckets[newIndex].first = oldGram;
+      oldGram = nextGram;
     }
-    return bs;
   }
 
-  //rehashed our hashtable to maintain loadfactor
+  //moves up to howMany more of the old buckets into the new table,
+  //freeing the old table once they have all moved
+  void migrate(dict* D, int howMany){
+    while(howMany > 0 and D->migrated < D->oldNumBuckets){
+      moveChain(D->oldBuckets[D->migrated].first,D->buckets,D->numBuckets);
+      D->migrated++;
+      howMany--;
+    }
+    if(D->migrated == D->oldNumBuckets){
+      std::free(D->oldBuckets);
+      mem::freed(mem::GRAM_TABLE,D->oldNumBuckets*sizeof(bucket));
+      D->oldBuckets = nullptr;
+      D->oldNumBuckets = 0;
+      D->migrated = 0;
+    }
+  }
+
+  //rehashed our hashtable to maintain loadfactor; with a rehash step the
+  //old buckets are only moved over a few at a time by later adds
   void rehash(dict* D){
+    long long started = meter::stamp();
+
+    //any earlier move gets finished first
+    if(D->oldBuckets!=nullptr){
+      migrate(D,D->oldNumBuckets);
+    }
 
     //we want to keep track of the old stuff so we can put it into the new buckets
-    int oldNumBuckets = D->numBuckets;
-    bucket* oldTable = D->buckets;
+    D->oldBuckets = D->buckets;
+    D->oldNumBuckets = D->numBuckets;
+    D->migrated = 0;
 
     //makes the new buckets and updates numBuckets
-    D->numBuckets = primeAtLeast(2*D->numBuckets);
+    D->numBuckets = 2*D->numBuckets;
     D->buckets = buildBuckets(D->numBuckets);
 
-    //we iterate through the old buckets here
-    for(int i = 0; i < oldNumBuckets; i++){
-
-      gram* oldGram = oldTable[i].first;
+    if(D->rehashStep == 0){
+      migrate(D,D->oldNumBuckets);
+    }
+    meter::rehashed(D->counted,started);
+  }
 
-      //we go through the grams in the old bucket and put them into their new buckets
-      while(oldGram!=nullptr){
-	int newIndex = hashValue(oldGram->words,D->numBuckets);
-	gram* currentFirstGram = D->buckets[newIndex].first;
-	gram* nextGram = oldGram->next;
+  //chooses how many old buckets each add moves while rehashing (0 means all at once)
+  void setRehashStep(dict* D, int step){
+    D->rehashStep = step;
+  }
 
-	//we just insert the oldGram as the first gram of it's new bucket.
-	if(currentFirstGram==nullptr){
-	  D->buckets[newIndex].first = oldGram;
-	  oldGram->next = nullptr;
-	}
-	else{
-	  oldGram->next = D->buckets[newIndex].first;
-	  D->buckets[newIndex].first = oldGram;
+  //finds the gram for key k (with hash h), looking in its old bucket too if
+  //that hasn't been moved yet
+  //(counting each gram it looks at, when built with METER)
+  gram* findGram(dict* D, unsigned long long k, unsigned long long h){
+    long compared = 0;
+    gram* currentGram = D->buckets[h & (D->numBuckets-1)].first;
+    while(currentGram!=nullptr){
+      compared++;
+      if(currentGram->key == k){
+	break;
+      }
+      currentGram = currentGram->next;
+    }
+    if(currentGram==nullptr and D->oldBuckets!=nullptr){
+      int oldIndex = h & (D->oldNumBuckets-1);
+      if(oldIndex >= D->migrated){
+	currentGram = D->oldBuckets[oldIndex].first;
+	while(currentGram!=nullptr){
+	  compared++;
+	  if(currentGram->key == k){
+	    break;
+	  }
+	  currentGram = currentGram->next;
 	}
-	oldGram = nextGram;
+      }
+    }
+    meter::looked(D->counted,compared);
+    return currentGram;
+  }
 
+  //hands out the next unused gram, starting a new block when the last is full;
+  //the list of blocks doubles whenever their number reaches a power of two
+  gram* newGram(dict* D){
+    if(D->used == BLOCK){
+      if((D->numBlocks & (D->numBlocks-1)) == 0){
+	gram** blocks = new gram*[2*D->numBlocks];
+	for(int b = 0; b < D->numBlocks; b++){
+	  blocks[b] = D->blocks[b];
+	}
+	delete [] D->blocks;
+	D->blocks = blocks;
+	mem::allocated(mem::GRAM_NODES,D->numBlocks*sizeof(gram*));
       }
+      D->blocks[D->numBlocks++] = new gram[BLOCK];
+      mem::allocated(mem::GRAM_NODES,BLOCK*sizeof(gram));
+      D->used = 0;
+    }
+    return &D->blocks[D->numBlocks-1][D->used++];
+  }
+
+  //hands out an array for `capacity` followers, a power of two, reusing one
+  //that a gram outgrew if there is one that long
+  follower* newFollowers(dict* D, int capacity){
+    int log = __builtin_ctz(capacity);
+    follower* array = D->spare[log];
+    if(array!=nullptr){
+      D->spare[log] = *reinterpret_cast<follower**>(array);
+      return array;
     }
-    //reallocates the space from our old buckets
-    delete [] oldTable;
+    return static_cast<follower*>(arena::allocate(D->followerArrays,capacity*sizeof(follower),alignof(follower*)));
+  }
+
+  //keeps an outgrown array of `capacity` followers to be handed out again;
+  //it is at least two followers long, room enough for the link
+  void dropFollowers(dict* D, follower* array, int capacity){
+    int log = __builtin_ctz(capacity);
+    *reinterpret_cast<follower**>(array) = D->spare[log];
+    D->spare[log] = array;
+  }
+
+  //the followers of a gram, wherever they are kept
+  follower* followersOf(gram* g){
+    return g->number == 1 ? &g->only : g->followers;
+  }
+
+  //the length of an array that doubles whenever its number of elements passes
+  //a power of two, as the follower arrays and the list of blocks do
+  int capacityOf(int number){
+    return powerOfTwoAtLeast(number);
   }
 
   //builds a dict, with all the defaults set
   dict* build(int initialSize, int loadFactor) {
-    srand(time(0));
     dict* newD = new dict;
     newD->numEntries = 0;
     newD->loadFactor = loadFactor;
-    newD->numBuckets = primeAtLeast(initialSize);
+    newD->numBuckets = powerOfTwoAtLeast(initialSize);
     newD->buckets = buildBuckets(newD->numBuckets);
+    newD->oldBuckets = nullptr;
+    newD->oldNumBuckets = 0;
+    newD->migrated = 0;
+    newD->rehashStep = 0;
+    newD->words = vocab::build(initialSize);
+    newD->blocks = new gram*[1];
+    newD->blocks[0] = new gram[BLOCK];
+    mem::allocated(mem::GRAM_NODES,sizeof(gram*) + BLOCK*sizeof(gram));
+    newD->numBlocks = 1;
+    newD->used = 0;
+    newD->followerArrays = arena::build(mem::GRAM_FOLLOWERS);
+    for(int i = 0; i < 32; i++){
+      newD->spare[i] = nullptr;
+    }
+    newD->aliasTables = arena::build(mem::GRAM_CHOICES);
+    meter::reset(newD->counted);
     return newD;
   }
 
-  //gets a random follower of a word
-  std::string get(dict* D, std::string ws) {
+  //fills in the alias table of n followers with the given total (Vose's method):
+  //every column starts out holding its own follower, weighted by count*n against
+  //the total, and each column short of the total is topped up with the rest of
+  //one over it
+  void buildAlias(const follower* followers, int n, long long total, choice* choices){
+    long long* weight = new long long[n];
+    int* under = new int[n];
+    int* over = new int[n];
+    int numUnder = 0;
+    int numOver = 0;
+
+    for(int i = 0; i < n; i++){
+      choices[i] = choice{followers[i].word,followers[i].word,1.0f};
+      weight[i] = (long long)followers[i].count * n;
+      if(weight[i] < total){
+	under[numUnder++] = i;
+      }
+      else{
+	over[numOver++] = i;
+      }
+    }
+
+    //pairs a short column with a tall one, which gives up the difference
+    while(numUnder > 0 and numOver > 0){
+      int s = under[--numUnder];
+      int l = over[numOver-1];
+      choices[s].chance = (float)((double)weight[s] / total);
+      choices[s].alias = choices[l].word;
+      weight[l] -= total - weight[s];
+      if(weight[l] < total){
+	numOver--;
+	under[numUnder++] = l;
+      }
+    }
+    //whatever is left is full (up to rounding) and keeps its own follower
+
+    delete [] weight;
+    delete [] under;
+    delete [] over;
+  }
+
+  //builds the alias table of a gram, first putting its followers in one fixed
+  //order, most counted first and then by spelling, so that the table doesn't
+  //depend on the order they were added in: a dict merged from pieces trained
+  //on several threads, whose word IDs differ too, then draws just the same
+  //words from a seed as one trained serially
+  void buildChoices(dict* D, gram* g){
+    std::sort(g->followers,g->followers+g->number,[D](const follower& a, const follower& b){
+      if(a.count != b.count){
+	return a.count > b.count;
+      }
+      return vocab::word(D->words,a.word) < vocab::word(D->words,b.word);
+    });
+    g->choices = static_cast<choice*>(arena::allocate(D->aliasTables,g->number*sizeof(choice),alignof(choice)));
+    buildAlias(followersOf(g),g->number,g->total,g->choices);
+  }
 
-    //we find the appropriate bucket, iterate through til we find our word
-    int hashIndex= hashValue(ws,D->numBuckets);
-    gram* currentGram = D->buckets[hashIndex].first;
-    while(currentGram!=nullptr and currentGram->words != ws){
-      currentGram = currentGram->next;
+  //builds the alias tables of every gram, so that no get has to
+  void finish(dict* D){
+    if(D->oldBuckets!=nullptr){
+      migrate(D,D->oldNumBuckets);
+    }
+    for(int i = 0; i < D->numBuckets; i++){
+      for(gram* g = D->buckets[i].first; g!=nullptr; g = g->next){
+	if(g->choices==nullptr and g->number > 1){
+	  buildChoices(D,g);
+	}
+      }
     }
+  }
 
-    //we pick a follower # "randomly" and iterate to it
-    int randInt = std::rand() % currentGram->number;
-    follower* currentFollower = currentGram->followers;
+  //gets the ID of a word, giving it one if it's new
+  unsigned wordId(dict* D, const char* chars, int length){
+    return vocab::intern(D->words,chars,length);
+  }
 
-    while(currentFollower!=nullptr and randInt!=0){
-      currentFollower = currentFollower->next;
-      randInt--;
+  unsigned wordId(dict* D, std::string_view w){
+    return vocab::intern(D->words,w);
+  }
+
+  //gets the word with an ID
+  const std::string& word(dict* D, unsigned id){
+    return vocab::word(D->words,id);
+  }
+
+  //gets a random follower of a key, each as likely as the number of times
+  //it followed that key: one uniform pick of a column of the alias table and
+  //one coin flip, however many followers there are, both made from a single
+  //draw of the random stream
+  unsigned pick(dict* D, unsigned long long k, rng::stream& r) {
+
+    //we find the appropriate bucket, iterate through til we find our key;
+    //a pair never seen backs off to the followers of its second word alone
+    gram* currentGram = findGram(D,k,hashInt(k));
+    if(currentGram == nullptr and (k >> 32) != vocab::NONE){
+      k = key((unsigned)k);
+      currentGram = findGram(D,k,hashInt(k));
+    }
+    if(currentGram == nullptr){
+      return vocab::NONE;
+    }
+    if(currentGram->number == 1){
+      return currentGram->only.word;
+    }
+    if(currentGram->choices == nullptr){
+      buildChoices(D,currentGram);
+    }
+
+    //we pick a column randomly, then between its follower and its alias
+    unsigned long long x = rng::next(r);
+    choice& c = currentGram->choices[rng::below(x,currentGram->number)];
+    if(rng::fraction(x) < c.chance){
+      return c.word;
     }
+    return c.alias;
+  }
 
-    //returns that follower
-    return currentFollower->word;
+  //the same for words given as strings, with an empty string for none
+  std::string get(dict* D, std::string_view w, rng::stream& r) {
+    unsigned fw = pick(D,key(vocab::find(D->words,w)),r);
+    return fw == vocab::NONE ? std::string() : word(D,fw);
   }
 
-  std::string get(dict* D, std::string w1, std::string w2) {
-    return get(D,w1+" "+w2);
+  std::string get(dict* D, std::string_view w1, std::string_view w2, rng::stream& r) {
+    unsigned fw = pick(D,key(vocab::find(D->words,w1),vocab::find(D->words,w2)),r);
+    return fw == vocab::NONE ? std::string() : word(D,fw);
   }
 
-  //adds a word gram and it's follower to the hashtable
-  void add(dict* D, std::string ws, std::string fw) {
+  //adds a word gram and it's follower to the hashtable, counted `times` times
+  void add(dict* D, unsigned long long k, unsigned fw, int times) {
+    //moves a few more buckets along if we are rehashing incrementally
+    if(D->oldBuckets!=nullptr){
+      migrate(D,D->rehashStep);
+    }
+
     //if we are goint to exceed the load factor, we immediately rehash
     if((D->numEntries+1)/D->numBuckets > D->loadFactor){
 
       rehash(D);
 
     }
-    //creates the new entry in case we need to add it
-    follower* newFollower = new follower{fw,nullptr};
-    gram* newGram = new gram{ws,1,newFollower,nullptr};
-    int bucketIndex = hashValue(ws,D->numBuckets);
-    gram* currentGram = D->buckets[bucketIndex].first;
+    unsigned long long h = hashInt(k);
+    gram* currentGram = findGram(D,k,h);
 
-    //if this is our first entry
+    //if the gram is not already in there, we just add it to the front of its bucket
     if(currentGram == nullptr){
-      D->buckets[bucketIndex].first = newGram;
+      int bucketIndex = h & (D->numBuckets-1);
+      gram* newEntry = newGram(D);
+      newEntry->key = k;
+      newEntry->number = 1;
+      newEntry->total = times;
+      newEntry->only = follower{fw,times};
+      newEntry->choices = nullptr;
+      newEntry->next = D->buckets[bucketIndex].first;
+      D->buckets[bucketIndex].first = newEntry;
       D->numEntries++;
       return;
+    }
 
+    //the gram's counts are changing, so any alias table is out of date; it
+    //stays in the arena until destroy, as tables are built once training is
+    //done and hardly ever thrown out
+    currentGram->total += times;
+    currentGram->choices = nullptr;
+
+    //if the gram is aleady in the dict, we count the follower again, swapping it
+    //one place forward so the common followers drift to the front
+    follower* followers = followersOf(currentGram);
+    for(int i = 0; i < currentGram->number; i++){
+      if(followers[i].word == fw){
+	followers[i].count += times;
+	if(i > 0){
+	  follower moved = followers[i];
+	  followers[i] = followers[i-1];
+	  followers[i-1] = moved;
+	}
+	return;
+      }
     }
 
-    gram* prevGram = currentGram;
-    bool alreadyInTheDict = false;
-    //iterates through the entries in the dict, looking for where the new entry goes
-    // (or if the entry is already there)
-    while(!alreadyInTheDict and  currentGram!=nullptr ){
-      if(currentGram->words == ws){
-	alreadyInTheDict = true;
-     	delete newGram;
-      }else{
-	prevGram = currentGram;
-	currentGram = currentGram->next;
+    //otherwise it's a new follower, at the end; the array doubles when full,
+    //which is whenever the number of followers is a power of two
+    int n = currentGram->number;
+    if((n & (n-1)) == 0){
+      follower* bigger = newFollowers(D,2*n);
+      for(int i = 0; i < n; i++){
+	bigger[i] = followers[i];
       }
+      if(n > 1){
+	dropFollowers(D,followers,n);
+      }
+      currentGram->followers = bigger;
     }
+    currentGram->followers[n] = follower{fw,times};
+    currentGram->number++;
+  }
 
-    //if the gram is aleady in the dict, we just add the new follower (if needed)
-    if(alreadyInTheDict){
-      follower* currentFollower = currentGram->followers;
-      follower* prevFollower = nullptr;
-      while(currentFollower!=nullptr){
-	if(currentFollower->word == fw){
-	  delete newFollower;
-	  return;
+  void add(dict* D, unsigned long long k, unsigned fw) {
+    add(D,k,fw,1);
+  }
+
+  //adds every gram of one dict, with its followers' counts, into another; each
+  //word of `from` is looked up in the vocabulary of `into` just once
+  void merge(dict* into, dict* from) {
+    int numWords = vocab::size(from->words);
+    unsigned* ids = new unsigned[numWords];
+    for(int i = 0; i < numWords; i++){
+      ids[i] = vocab::intern(into->words,vocab::word(from->words,i));
+    }
+
+    //goes through the grams of `from` block by block, in the order they were made
+    for(int b = 0; b < from->numBlocks; b++){
+      int inBlock = b == from->numBlocks-1 ? from->used : BLOCK;
+      for(int i = 0; i < inBlock; i++){
+	gram* g = &from->blocks[b][i];
+	unsigned first = g->key >> 32;
+	unsigned second = (unsigned)g->key;
+	unsigned long long k = first == vocab::NONE ? key(ids[second]) : key(ids[first],ids[second]);
+	follower* followers = followersOf(g);
+	for(int j = 0; j < g->number; j++){
+	  add(into,k,ids[followers[j].word],followers[j].count);
 	}
-	prevFollower = currentFollower;
-	currentFollower = currentFollower->next;
       }
+    }
+    delete [] ids;
+  }
 
-      if(prevFollower == nullptr){
-	currentGram->followers = newFollower;
-	currentGram->number++;
-	return;
+  //the same for words given as strings; each is looked up where it sits, and
+  //only a word new to the vocabulary gets copied
+  void add(dict* D, std::string_view w, std::string_view fw) {
+    add(D,key(wordId(D,w)),wordId(D,fw));
+  }
+
+  void add(dict* D, std::string_view w1, std::string_view w2, std::string_view fw) {
+    add(D,key(wordId(D,w1),wordId(D,w2)),wordId(D,fw));
+  }
 
+  //fills in the readings of a dict's table: each bucket holds the grams of
+  //its list, and the gram i places along it takes i comparisons to find;
+  //buckets an incremental rehash hasn't moved yet count too
+  void measure(dict* D, meter::table* T){
+    T->numEntries = D->numEntries;
+    T->numBuckets = D->numBuckets + D->oldNumBuckets - D->migrated;
+    T->counts = true;
+    T->counted = D->counted;
+    for(int which = 0; which < 2; which++){
+      bucket* buckets = which == 0 ? D->buckets : D->oldBuckets;
+      int from = which == 0 ? 0 : D->migrated;
+      int to = which == 0 ? D->numBuckets : D->oldNumBuckets;
+      for(int b = from; b < to; b++){
+	long length = 0;
+	for(gram* g = buckets[b].first; g!=nullptr; g = g->next){
+	  length++;
+	  meter::tally(T->chains,length);
+	  T->sumChains += length;
+	}
+	meter::tally(T->occupancy,length);
+	if(length > T->longest){
+	  T->longest = length;
+	}
       }
-      prevFollower->next = newFollower;
-      currentGram->number++;
-    }
-    
-    else{
-      //if the gram is not already in there, we just add it
-      D->numEntries++;
-      prevGram->next = newGram;
-      
     }
   }
-  
-  void add(dict* D, std::string w1, std::string w2, std::string fw) {
-     add(D,w1+" "+w2,fw);
-  }
 
-  //reallocates space
+  //reallocates space; the grams' followers and alias tables go with the
+  //chunks of their arenas, so no gram has to be looked at
   void destroy(dict *D) {
 
-    //goes through all the buckets
-    for(int i = 0; i< D->numBuckets; i++){
+    //deletes the blocks of grams
+    for(int b = 0; b < D->numBlocks; b++){
+      delete [] D->blocks[b];
+      mem::freed(mem::GRAM_NODES,BLOCK*sizeof(gram));
+    }
+    arena::destroy(D->followerArrays);
+    arena::destroy(D->aliasTables);
+
+    //deletes D, its blocks, its buckets and its words (unless a frozen
+    //dict has taken them over)
+    delete [] D->blocks;
+    std::free(D->buckets);
+    std::free(D->oldBuckets);
+    mem::freed(mem::GRAM_NODES,capacityOf(D->numBlocks)*sizeof(gram*));
+    mem::freed(mem::GRAM_TABLE,(D->numBuckets+D->oldNumBuckets)*sizeof(bucket));
+    if(D->words!=nullptr){
+      vocab::destroy(D->words);
+    }
+    delete D;
+
+  }  
 
-      //goes through all the grams in the buckets
-      gram* currentGram = D->buckets[i].first;
-      while(currentGram!=nullptr){
-	gram* toBeDeleted = currentGram;
-	follower* currentFollower = currentGram->followers;
+  //marks an empty slot of a frozen dict; no key that was added packs two
+  //missing words, though one looked up may
+  const unsigned long long NO_KEY = ~0ULL;
+
+  //lays out a trained dict as a frozen one: the keys go into a table a
+  //quarter or more bigger than their number, and then the alias tables go
+  //into one array in the order of the slots their keys landed in
+  frozen* freeze(dict* D){
+    finish(D);
+    frozen* F = new frozen;
+    F->numEntries = D->numEntries;
+    F->tableSize = powerOfTwoAtLeast(D->numEntries + D->numEntries/4 + 1);
+    F->keys = new unsigned long long[F->tableSize];
+    F->offsets = new int[F->tableSize+1];
+    gram** placed = new gram*[F->tableSize];
+    mem::allocated(mem::FROZEN,F->tableSize*sizeof(unsigned long long) + (F->tableSize+1)*sizeof(int));
+    mem::allocated(mem::GRAM_TABLE,F->tableSize*sizeof(gram*));
+    for(int s = 0; s < F->tableSize; s++){
+      F->keys[s] = NO_KEY;
+      placed[s] = nullptr;
+    }
 
-	//deletes all the grams followers
-	while(currentFollower !=nullptr){
-	  follower* followerToDelete = currentFollower;
-	  currentFollower = currentFollower->next;
-	  delete followerToDelete;
+    //places each key by linear probing
+    int mask = F->tableSize-1;
+    for(int i = 0; i < D->numBuckets; i++){
+      for(gram* g = D->buckets[i].first; g!=nullptr; g = g->next){
+	int s = hashInt(g->key) & mask;
+	while(placed[s]!=nullptr){
+	  s = (s+1) & mask;
+	}
+	F->keys[s] = g->key;
+	placed[s] = g;
+      }
+    }
 
+    //each slot's columns start where the last slot's end
+    int numColumns = 0;
+    for(int s = 0; s < F->tableSize; s++){
+      F->offsets[s] = numColumns;
+      if(placed[s]!=nullptr){
+	numColumns += placed[s]->number;
+      }
+    }
+    F->offsets[F->tableSize] = numColumns;
+
+    //column c of a key's alias table starts out as its follower c, so the
+    //counts line up with the columns
+    F->choices = new choice[numColumns];
+    F->counts = new int[numColumns];
+    mem::allocated(mem::FROZEN,numColumns*(sizeof(choice) + sizeof(int)));
+    for(int s = 0; s < F->tableSize; s++){
+      gram* g = placed[s];
+      if(g==nullptr){
+	continue;
+      }
+      choice* columns = &F->choices[F->offsets[s]];
+      int* counts = &F->counts[F->offsets[s]];
+      follower* followers = followersOf(g);
+      if(g->number == 1){
+	columns[0] = choice{g->only.word,g->only.word,1.0f};
+      }
+      else{
+	for(int c = 0; c < g->number; c++){
+	  columns[c] = g->choices[c];
 	}
-	//deletes the gram
-	currentGram = currentGram->next;
-	delete toBeDeleted;
+      }
+      for(int c = 0; c < g->number; c++){
+	counts[c] = followers[c].count;
+      }
+    }
+    delete [] placed;
+    mem::freed(mem::GRAM_TABLE,F->tableSize*sizeof(gram*));
+
+    //the frozen dict keeps the words; the rest goes
+    F->words = D->words;
+    D->words = nullptr;
+    destroy(D);
+    return F;
+  }
+
+  //gets the ID of a word, if it has one
+  unsigned wordId(frozen* F, std::string_view w){
+    return vocab::find(F->words,w);
+  }
+
+  const std::string& word(frozen* F, unsigned id){
+    return vocab::word(F->words,id);
+  }
 
+  //finds the slot of a key in a frozen dict, or -1; the probe for it
+  //reads a run of neighbouring slots
+  int findSlot(frozen* F, unsigned long long k){
+    int mask = F->tableSize-1;
+    int s = hashInt(k) & mask;
+    while(F->keys[s] != k or k == NO_KEY){
+      if(F->keys[s] == NO_KEY){
+	return -1;
       }
+      s = (s+1) & mask;
+    }
+    return s;
+  }
 
+  //gets a random follower of a key in a frozen dict, backing off from a pair
+  //never seen as the dict does; the key's columns are all together
+  unsigned pick(frozen* F, unsigned long long k, rng::stream& r){
+    int s = findSlot(F,k);
+    if(s == -1 and (k >> 32) != vocab::NONE){
+      s = findSlot(F,key((unsigned)k));
+    }
+    if(s == -1){
+      return vocab::NONE;
+    }
+    int first = F->offsets[s];
+    int number = F->offsets[s+1] - first;
+    if(number == 1){
+      return F->choices[first].word;
+    }
+
+    //we pick a column randomly, then between its follower and its alias
+    unsigned long long x = rng::next(r);
+    choice& c = F->choices[first + rng::below(x,number)];
+    if(rng::fraction(x) < c.chance){
+      return c.word;
+    }
+    return c.alias;
+  }
 
+  //the same for words given as strings, with an empty string for none
+  std::string get(frozen* F, std::string_view w, rng::stream& r) {
+    unsigned fw = pick(F,key(wordId(F,w)),r);
+    return fw == vocab::NONE ? std::string() : word(F,fw);
+  }
 
+  std::string get(frozen* F, std::string_view w1, std::string_view w2, rng::stream& r) {
+    unsigned fw = pick(F,key(wordId(F,w1),wordId(F,w2)),r);
+    return fw == vocab::NONE ? std::string() : word(F,fw);
+  }
 
+  //writes texts first through last of a batch, each one picked word by word
+  //from its own stream, starting as if after stoppers
+  void generateSome(frozen* F, rng::stream* streams, int first, int last, int length, unsigned* words){
+    unsigned period = vocab::find(F->words,".");
+    for(int t = first; t < last; t++){
+      unsigned w1 = period;
+      unsigned w2 = period;
+      unsigned* text = &words[(long)t*length];
+      for(int i = 0; i < length; i++){
+	text[i] = pick(F,key(w1,w2),streams[t]);
+	w1 = w2;
+	w2 = text[i];
+      }
     }
-    //deletes D and its buckets
-    delete [] D->buckets;
-    delete D;
+  }
 
-  }  
-} 
+  //generates a batch of texts, each from its own stream: the streams are the
+  //seed's stream jumped once more for each text, so the same seed gives the
+  //same texts however many threads share the work
+  unsigned* generate(frozen* F, int numTexts, int length, unsigned long long seed, int numThreads){
+    unsigned* words = new unsigned[(long)numTexts*length];
+    rng::stream* streams = new rng::stream[numTexts];
+    rng::stream r;
+    rng::seed(r,seed);
+    for(int t = 0; t < numTexts; t++){
+      streams[t] = r;
+      rng::jump(r);
+    }
+
+    //each thread takes its own run of texts
+    std::thread* workers = new std::thread[numThreads];
+    for(int i = 0; i < numThreads; i++){
+      int first = (long)numTexts*i/numThreads;
+      int last = (long)numTexts*(i+1)/numThreads;
+      workers[i] = std::thread(generateSome,F,streams,first,last,length,words);
+    }
+    for(int i = 0; i < numThreads; i++){
+      workers[i].join();
+    }
+    delete [] workers;
+    delete [] streams;
+    return words;
+  }
 
+  //fills in the readings of a frozen dict's table: each group of 16 slots
+  //counts as a bucket, and a key takes a comparison for each slot its probe
+  //reads, from the slot it hashes to up to its own
+  void measure(frozen* F, meter::table* T){
+    const int GROUP = 16;
+    int mask = F->tableSize-1;
+    T->numEntries = F->numEntries;
+    T->numBuckets = (F->tableSize + GROUP-1)/GROUP;
+    for(int group = 0; group < T->numBuckets; group++){
+      int full = 0;
+      for(int s = group*GROUP; s < (group+1)*GROUP and s < F->tableSize; s++){
+	if(F->keys[s] == NO_KEY){
+	  continue;
+	}
+	full++;
+	long compared = ((s - (int)(hashInt(F->keys[s]) & mask)) & mask) + 1;
+	meter::tally(T->chains,compared);
+	T->sumChains += compared;
+	if(compared > T->longest){
+	  T->longest = compared;
+	}
+      }
+      meter::tally(T->occupancy,full);
+    }
+  }
+
+  //gives back the frozen dict's arrays and its words
+  void destroy(frozen* F){
+    mem::freed(mem::FROZEN,F->tableSize*sizeof(unsigned long long) + (F->tableSize+1)*sizeof(int)
+	       + F->offsets[F->tableSize]*(sizeof(choice) + sizeof(int)));
+    delete [] F->keys;
+    delete [] F->offsets;
+    delete [] F->choices;
+    delete [] F->counts;
+    vocab::destroy(F->words);
+    delete F;
+  }
+} 
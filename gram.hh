@@ -1,41 +1,135 @@
 #ifndef _GRAM_H
 #define _GRAM_H
 
+#include <string>
+#include <string_view>
+#include "vocab.hh"
+#include "rng.hh"
+#include "meter.hh"
+#include "arena.hh"
+
 namespace gram {
 
-  // List of following words.
+  // One following word: its ID in the dictionary's vocabulary, and
+  // how many times it followed the word/bigram.
   struct follower {
-    std::string word;
-    struct follower* next;
+    unsigned word;
+    int count;
+  };
+
+  // One column of a gram's alias table. A sample picks a column
+  // uniformly, then keeps its follower with probability `chance`,
+  // otherwise taking its alias.
+  struct choice {
+    unsigned word;
+    unsigned alias;
+    float chance;
   };
 
   // Word/bigram dictionary entry.
   struct gram {
-    std::string words;    // Either a word or a pair of words separated by a space.
-    int number;           // The number of followers of that word/bigram.
-    follower* followers;  // The list of words that follow that word/bigram.
+    unsigned long long key; // The ID of a word, or the IDs of a pair of words, packed by `key`.
+    int number;           // The number of distinct followers of that word/bigram.
+    int total;            // The sum of their counts.
+    union {
+      follower only;        // The word that follows that word/bigram, while there is just one,
+      follower* followers;  // or else an array of them, more frequent ones nearer the front.
+    };                      // The array doubles each time `number` passes a power of two.
+    choice* choices;      // Its alias table of `number` columns, built by `finish`
+                          // or the first `pick`, or nullptr when out of date.
     struct gram* next;    // Another entry in this dictionary.
   };
 
   struct bucket {
     gram* first;
   };
-    
+
   struct dict {
     bucket* buckets;
     int numBuckets;
     int numEntries;
     int loadFactor;
-    
-    
+    bucket* oldBuckets;   // The table being moved out of during an incremental rehash, or nullptr.
+    int oldNumBuckets;    // The size of that old table.
+    int migrated;         // How many of its buckets have moved so far.
+    int rehashStep;       // How many old buckets each `add` moves. Zero rehashes all at once.
+    vocab::dict* words;   // Every word seen, each stored once under its ID.
+    gram** blocks;        // Where the grams are, allocated a block at a time rather than one by one.
+    int numBlocks;        // How many blocks there are.
+    int used;             // How many grams of the last block hold an entry.
+    arena::pool* followerArrays;  // Where the follower arrays come from, packed together,
+    follower* spare[32];          // and the arrays grams have outgrown, by the log of their
+                                  // length, linked through their first bytes to be used again.
+    arena::pool* aliasTables;     // Where the alias tables come from.
+    meter::counters counted; // Its lookups and rehashes, when built with METER.
   };
 
+  // A trained dictionary made read-only and compact by `freeze`. The
+  // keys sit in one open-addressing table, and the alias table of the
+  // key in each slot sits in one shared array, between `offsets[slot]`
+  // and `offsets[slot+1]`: a key and its followers are found with no
+  // pointers to chase.
+  struct frozen {
+    unsigned long long* keys; // The key in each slot of the table, or all ones if it's empty.
+    int* offsets;         // Where each slot's columns start in `choices`, and at the
+                          // end, how many columns there are in all.
+    int tableSize;        // The number of slots; a power of two.
+    int numEntries;       // How many of them hold a key.
+    choice* choices;      // The alias tables of all the keys, back to back. A key
+                          // with one follower has one column, with chance 1.
+    int* counts;          // How many times the word of each column followed its key,
+                          // kept so that a saved model can go on counting.
+    vocab::dict* words;   // The vocabulary, taken over from the dictionary.
+  };
+
+  // The key of a single word `w`, or of the bigram `w1 w2`: both IDs in
+  // one integer, with no word at all standing in front of a single one.
+  inline unsigned long long key(unsigned w) {
+    return ((unsigned long long)vocab::NONE << 32) | w;
+  }
+  inline unsigned long long key(unsigned w1, unsigned w2) {
+    return ((unsigned long long)w1 << 32) | w2;
+  }
+
   dict* build(int initialSize, int loadFactor);
-  void add(dict* d, std::string ws, std::string fw);
-  void add(dict* d, std::string w1, std::string w2, std::string fw);
-  std::string get(dict* d, std::string k1, std::string k2);
-  std::string get(dict* d, std::string k);
+  unsigned wordId(dict* d, const char* chars, int length); // The ID of a word, adding it to the vocabulary if new.
+  unsigned wordId(dict* d, std::string_view w);
+  const std::string& word(dict* d, unsigned id);           // The word with an ID.
+  void add(dict* d, unsigned long long k, unsigned fw);    // Counts word `fw` as following the key `k`.
+  void add(dict* d, unsigned long long k, unsigned fw,     // The same, `times` times over.
+           int times);
+  unsigned pick(dict* d, unsigned long long k,             // A random follower of the key `k`, drawn from `r`,
+                rng::stream& r);                           // or of just its second word if `k` is a pair never
+                                                           // seen; or vocab::NONE if neither was.
+  void add(dict* d, std::string_view w, std::string_view fw);
+  void add(dict* d, std::string_view w1, std::string_view w2, std::string_view fw);
+  std::string get(dict* d, std::string_view k1, std::string_view k2, rng::stream& r);
+  std::string get(dict* d, std::string_view k, rng::stream& r);
+  void merge(dict* into, dict* from);                      // Adds all the grams and follower counts of `from`
+                                                           // into `into`.
+  void finish(dict* d);   // Builds every gram's alias table once training is done.
+  void buildAlias(const follower* followers, int n,        // Fills `choices` with the alias table of `n`
+                  long long total, choice* choices);       // followers whose counts sum to `total`.
+  void setRehashStep(dict* d, int step);
+  void measure(dict* d, meter::table* t);                  // Fills in `t` with the shape of the table of `d`
+                                                           // and what it has counted.
   void destroy(dict* d);
+
+  frozen* freeze(dict* d);                                 // Turns a trained dictionary into a frozen one,
+                                                           // destroying `d`.
+  unsigned wordId(frozen* f, std::string_view w);          // The ID of a word, or vocab::NONE if it's unknown.
+  const std::string& word(frozen* f, unsigned id);
+  unsigned pick(frozen* f, unsigned long long k,           // The same, for a frozen dictionary.
+                rng::stream& r);
+  std::string get(frozen* f, std::string_view k1, std::string_view k2, rng::stream& r);
+  std::string get(frozen* f, std::string_view k, rng::stream& r);
+  unsigned* generate(frozen* f, int numTexts, int length,  // Gives back a new array of `numTexts` texts of
+                     unsigned long long seed,              // `length` word IDs each, back to back, generated
+                     int numThreads);                      // by `numThreads` threads. Each text has its own
+                                                           // stream, derived from `seed`.
+  void measure(frozen* f, meter::table* t);                // The same for a frozen dictionary, which counts
+                                                           // nothing, being read by many threads at once.
+  void destroy(frozen* f);
 }
 
 #endif // _GRAM_H
@@ -0,0 +1,129 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+// hash.hh
+//
+// This defines the string hash function shared by the `freq` and
+// `vocab` hash tables, a hash of integers for the `gram` tables keyed
+// by word IDs, and the helper that sizes the tables.
+//
+// `hashing::hash64` follows the design of wyhash: the key is read 4 or
+// 8 bytes at a time, and each pair of 64-bit words is mixed by taking
+// the full 128-bit product of the two and folding its halves together.
+// Every byte of the key affects every bit of the result, so the low
+// bits can index a power-of-two table directly.
+//
+// The tables keep each key's full hash alongside it. That way growing
+// a table never hashes a key again, and a search compares the strings
+// of only those keys whose hashes match exactly.
+//
+
+#include <string>
+#include <cstring>
+
+namespace hashing {
+
+  // The constants wyhash uses to mix in the key and its length.
+  const unsigned long long SECRET0 = 0xa0761d6478bd642fULL;
+  const unsigned long long SECRET1 = 0xe7037ed1a0b428dbULL;
+  const unsigned long long SEED    = 0x8ebc6af09c88c6e3ULL;
+
+  // mix(a,b):
+  //
+  // Returns the high and low halves of the 128-bit product a*b,
+  // XORed together.
+  //
+  inline unsigned long long mix(unsigned long long a, unsigned long long b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return (unsigned long long)product ^ (unsigned long long)(product >> 64);
+  }
+
+  // read8(p), read4(p):
+  //
+  // Return the 8 or 4 bytes at `p` as an integer.
+  //
+  inline unsigned long long read8(const unsigned char* p) {
+    unsigned long long v;
+    std::memcpy(&v,p,8);
+    return v;
+  }
+
+  inline unsigned long long read4(const unsigned char* p) {
+    unsigned int v;
+    std::memcpy(&v,p,4);
+    return v;
+  }
+
+  // hash64(key,length):
+  //
+  // Returns a 64-bit hash of the `length` bytes starting at `key`.
+  //
+  inline unsigned long long hash64(const char* key, long length) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(key);
+    unsigned long long seed = SEED ^ mix(SEED ^ SECRET0,SECRET1);
+    unsigned long long a, b;
+    if (length <= 16) {
+      if (length >= 4) {
+	// Two overlapping pairs of 4-byte reads cover the whole key.
+	long skip = (length >> 3) << 2;
+	a = (read4(p) << 32) | read4(p+skip);
+	b = (read4(p+length-4) << 32) | read4(p+length-4-skip);
+      } else if (length > 0) {
+	a = ((unsigned long long)p[0] << 16) | ((unsigned long long)p[length >> 1] << 8) | p[length-1];
+	b = 0;
+      } else {
+	a = b = 0;
+      }
+    } else {
+      long left = length;
+      while (left > 16) {
+	seed = mix(read8(p) ^ SECRET1,read8(p+8) ^ seed);
+	p += 16;
+	left -= 16;
+      }
+      a = read8(p+left-16);
+      b = read8(p+left-8);
+    }
+    a ^= SECRET1;
+    b ^= seed;
+    unsigned __int128 product = (unsigned __int128)a * b;
+    a = (unsigned long long)product;
+    b = (unsigned long long)(product >> 64);
+    return mix(a ^ SECRET0 ^ (unsigned long long)length,b ^ SECRET1);
+  }
+
+  // hash64(key):
+  //
+  // Returns a 64-bit hash of the characters of the string `key`.
+  //
+  inline unsigned long long hash64(const std::string& key) {
+    return hash64(key.data(),key.size());
+  }
+
+  // hashInt(key):
+  //
+  // Returns a 64-bit hash of the integer `key`, for tables keyed by
+  // numbers rather than strings: one multiply of the key against the
+  // secrets, folded like the rest.
+  //
+  inline unsigned long long hashInt(unsigned long long key) {
+    return mix(key ^ SECRET0,SECRET1 ^ SEED);
+  }
+
+  // powerOfTwoAtLeast(n):
+  //
+  // Return the smallest power of two no smaller than `n`. Tables of
+  // that size find a key's bucket by masking off the low bits of its
+  // hash, with no division.
+  //
+  inline int powerOfTwoAtLeast(int n) {
+    int p = 1;
+    while (p < n) {
+      p *= 2;
+    }
+    return p;
+  }
+
+}
+
+#endif // _HASH_H
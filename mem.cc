@@ -0,0 +1,112 @@
+//
+// mem.cc
+//
+// This implements the memory accounts described in "mem.hh": starting
+// them, and reporting them along with the process's peak resident
+// memory.
+//
+// The functions it defines include
+//    * `void mem::track()`: zero the counts and start counting
+//    * `void mem::stop()`: stop counting
+//    * `const char* mem::partName(mem::part)`: get a part's name
+//    * `long mem::peakRSS()`: get the process's peak resident memory
+//    * `void mem::report(std::ostream&,const char*,long)`: write the accounts
+//
+// The hooks that do the counting are inline, in "mem.hh".
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sys/resource.h>
+#include "mem.hh"
+
+namespace mem {
+
+  bool tracking = false;
+  std::atomic<long> live[NUM_PARTS];
+  std::atomic<long> peak[NUM_PARTS];
+  std::atomic<long> liveTotal(0);
+  std::atomic<long> peakTotal(0);
+
+  // track():
+  //
+  // Zeroes every count, then starts counting.
+  //
+  void track() {
+    for (int p=0; p<NUM_PARTS; p++) {
+      live[p] = 0;
+      peak[p] = 0;
+    }
+    liveTotal = 0;
+    peakTotal = 0;
+    tracking = true;
+  }
+
+  // stop():
+  //
+  // Stops counting. The counts are left as they were, to be reported.
+  //
+  void stop() {
+    tracking = false;
+  }
+
+  // partName(p):
+  //
+  // Returns a printable name for the part `p`.
+  //
+  const char* partName(part p) {
+    switch (p) {
+    case FREQ_ENTRIES:   return "freq entries";
+    case FREQ_WORDS:     return "freq words";
+    case FREQ_TABLE:     return "freq table";
+    case FREQ_COUNTS:    return "freq counts";
+    case GRAM_NODES:     return "gram nodes";
+    case GRAM_FOLLOWERS: return "gram followers";
+    case GRAM_CHOICES:   return "gram choices";
+    case GRAM_TABLE:     return "gram table";
+    case VOCAB_WORDS:    return "vocab words";
+    case VOCAB_TABLE:    return "vocab table";
+    case FROZEN:         return "frozen";
+    default:             return "?";
+    }
+  }
+
+  // peakRSS():
+  //
+  // Returns the most memory the process has had resident at once so
+  // far, in kilobytes.
+  //
+  long peakRSS() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+  }
+
+  // report(out,per,n):
+  //
+  // Writes a line to `out` for each part that has held any bytes, with
+  // how many it holds now and the most it held, then the same for all
+  // of them, then the process's peak resident memory. With `n` above
+  // zero, the live total is also divided among `n` of `per`.
+  //
+  void report(std::ostream& out, const char* per, long n) {
+    out << std::left << std::setw(16) << "part" << std::right
+	<< std::setw(14) << "live bytes" << std::setw(14) << "peak bytes" << std::endl;
+    for (int p=0; p<NUM_PARTS; p++) {
+      if (peak[p] > 0) {
+	out << std::left << std::setw(16) << partName((part)p) << std::right
+	    << std::setw(14) << live[p] << std::setw(14) << peak[p] << std::endl;
+      }
+    }
+    out << std::left << std::setw(16) << "total" << std::right
+	<< std::setw(14) << liveTotal << std::setw(14) << peakTotal << std::endl;
+    if (n > 0) {
+      std::streamsize precision = out.precision();
+      out << std::fixed << std::setprecision(1)
+	  << (double)liveTotal/n << " bytes live per " << per << ", over " << n << std::endl;
+      out << std::defaultfloat << std::setprecision(precision);
+    }
+    out << "peak resident memory: " << peakRSS() << " KB" << std::endl;
+  }
+
+} // end namespace mem
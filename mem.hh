@@ -0,0 +1,124 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+// mem.hh
+//
+// This keeps account of the memory held by the data structures of
+// `stats` and `chats`, for their `--mem-report` option and for the
+// `mem` section of the benchmark.
+//
+// Every place that allocates or frees storage for a `freq::dict`, a
+// `gram::dict`, a `vocab::dict` or a `gram::frozen` tells this module
+// how many bytes went to which of their `part`s. Each part keeps the
+// bytes it holds now and the most it held at once, and so does their
+// total. The bytes are those asked for, so the allocator's own
+// overhead isn't counted; the process's peak resident memory, which
+// is reported alongside, does include it.
+//
+// Nothing is counted until `track` is called, which should be before
+// any of those structures is built, so that none is freed uncounted.
+// Until then each hook costs a test of one flag. The counts are kept
+// with atomic adds, so threads training their own dictionaries can
+// all count into them at once.
+//
+
+#include <string>
+#include <atomic>
+#include <iosfwd>
+
+namespace mem {
+
+  // part
+  //
+  // The parts of the structures that memory is counted against.
+  //
+  enum part {
+    FREQ_ENTRIES,    // The arenas of `freq::node`s, or the slots of a FLAT table.
+    FREQ_WORDS,      // The string pools of the words of `freq::dict`s.
+    FREQ_TABLE,      // Bucket arrays and FLAT control bytes.
+    FREQ_COUNTS,     // The count histogram of each `freq::dict`.
+    GRAM_NODES,      // The blocks of `gram::gram` entries.
+    GRAM_FOLLOWERS,  // The arenas of the follower arrays of grams with more than one.
+    GRAM_CHOICES,    // The arenas of their alias tables.
+    GRAM_TABLE,      // The bucket arrays of `gram::dict`s.
+    VOCAB_WORDS,     // The words of vocabularies, with their hashes.
+    VOCAB_TABLE,     // The open-addressing tables of their IDs.
+    FROZEN,          // The arrays of `gram::frozen` dictionaries.
+    NUM_PARTS
+  };
+
+  // Whether the hooks below are counting. Set by `track`.
+  extern bool tracking;
+
+  // The bytes each part holds now, and the most it has held at once.
+  extern std::atomic<long> live[NUM_PARTS];
+  extern std::atomic<long> peak[NUM_PARTS];
+
+  // The same for all of the parts together.
+  extern std::atomic<long> liveTotal;
+  extern std::atomic<long> peakTotal;
+
+  // raise(most,now):
+  //
+  // Makes `most` at least `now`.
+  //
+  inline void raise(std::atomic<long>& most, long now) {
+    long before = most.load(std::memory_order_relaxed);
+    while (now > before && !most.compare_exchange_weak(before,now,std::memory_order_relaxed)) {
+    }
+  }
+
+  // allocated(p,bytes):
+  //
+  // Counts `bytes` more held by the part `p`.
+  //
+  inline void allocated(part p, long bytes) {
+    if (!tracking || bytes == 0) {
+      return;
+    }
+    raise(peak[p],live[p].fetch_add(bytes,std::memory_order_relaxed) + bytes);
+    raise(peakTotal,liveTotal.fetch_add(bytes,std::memory_order_relaxed) + bytes);
+  }
+
+  // freed(p,bytes):
+  //
+  // Counts `bytes` given back by the part `p`.
+  //
+  inline void freed(part p, long bytes) {
+    if (!tracking || bytes == 0) {
+      return;
+    }
+    live[p].fetch_sub(bytes,std::memory_order_relaxed);
+    liveTotal.fetch_sub(bytes,std::memory_order_relaxed);
+  }
+
+  // heapBytes(s):
+  //
+  // Returns how many bytes the characters of `s` take on the heap: none
+  // while they fit inside the string itself, otherwise its capacity and
+  // the terminating zero.
+  //
+  inline long heapBytes(const std::string& s) {
+    static const long INSIDE = std::string().capacity();
+    return (long)s.capacity() > INSIDE ? (long)s.capacity() + 1 : 0;
+  }
+
+  //
+  // The public interface to the accounts.
+  //
+  void track();                           // Zeroes every count and starts counting.
+  void stop();                            // Stops counting.
+
+  const char* partName(part p);           // Returns a printable name for `p`.
+
+  long peakRSS();                         // Returns the most memory the process has had resident
+                                          // at once so far, in kilobytes.
+
+  void report(std::ostream& out,          // Writes the live and peak bytes of every part that held
+	      const char* per, long n);   // any, and the peak resident memory, to `out`. When `n`
+                                          // is positive, also gives the live bytes per each of the
+                                          // `n` things named by `per`.
+
+}
+
+#endif // _MEM_H
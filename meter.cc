@@ -0,0 +1,189 @@
+//
+// meter.cc
+//
+// This implements the `--stats` readings `meter::readings*` described
+// in "meter.hh": collecting phase times and tables, and printing them.
+//
+// The functions it defines include
+//    * `meter::readings* meter::build()`: build empty readings
+//    * `void meter::phase(meter::readings*,const char*,long long)`: add to a phase's time
+//    * `meter::table* meter::addTable(meter::readings*,const char*)`: add a table to fill in
+//    * `void meter::print(meter::readings*,std::ostream&)`: write the readings as text
+//    * `void meter::printJson(meter::readings*,std::ostream&)`: write the readings as JSON
+//    * `void meter::destroy(meter::readings*)`: give back the readings' storage
+//
+// How each table is measured is up to its own module; see the
+// `measure` functions of "freq.hh" and "gram.hh".
+//
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include "meter.hh"
+
+namespace meter {
+
+  // build():
+  //
+  // Build readings with no phases and no tables.
+  //
+  readings* build() {
+    readings* newR = new readings;
+    newR->numPhases = 0;
+    newR->numTables = 0;
+    return newR;
+  }
+
+  // phase(R,name,nanos):
+  //
+  // Adds `nanos` nanoseconds to the phase `name` of `R`. A phase not
+  // seen before is added after the others, so they print in the order
+  // they first ran. Phases past MAX_PHASES are dropped.
+  //
+  void phase(readings* R, const char* name, long long nanos) {
+    for (int i=0; i<R->numPhases; i++) {
+      if (std::strcmp(R->phases[i],name) == 0) {
+	R->nanos[i] += nanos;
+	return;
+      }
+    }
+    if (R->numPhases < MAX_PHASES) {
+      R->phases[R->numPhases] = name;
+      R->nanos[R->numPhases] = nanos;
+      R->numPhases++;
+    }
+  }
+
+  // addTable(R,name):
+  //
+  // Adds a table called `name` to `R`, with every reading zero, and
+  // returns it to be filled in. Returns nullptr if `R` has no room.
+  //
+  table* addTable(readings* R, const char* name) {
+    if (R->numTables == MAX_TABLES) {
+      return nullptr;
+    }
+    table* T = &R->tables[R->numTables++];
+    std::memset(T,0,sizeof(table));
+    T->name = name;
+    return T;
+  }
+
+  // printBins(out,h):
+  //
+  // Writes the nonzero bins of `h` as `size:count`, each after a space.
+  // The last bin is written `size+:count`.
+  //
+  void printBins(std::ostream& out, const histogram& h) {
+    for (int i=0; i<BINS; i++) {
+      if (h.bins[i] != 0) {
+	out << " " << i << (i == BINS-1 ? "+" : "") << ":" << h.bins[i];
+      }
+    }
+  }
+
+  // print(R,out):
+  //
+  // Writes the phases of `R` with their times, then each table with its
+  // histograms and counters, as lines of text to `out`.
+  //
+  void print(readings* R, std::ostream& out) {
+    std::streamsize precision = out.precision();
+    long long total = 0;
+    for (int i=0; i<R->numPhases; i++) {
+      total += R->nanos[i];
+    }
+    out << std::fixed << std::setprecision(1);
+    for (int i=0; i<R->numPhases; i++) {
+      out << "phase " << std::left << std::setw(10) << R->phases[i] << std::right
+	  << std::setw(10) << R->nanos[i]/1e6 << " ms"
+	  << std::setw(7) << (total > 0 ? 100.0*R->nanos[i]/total : 0.0) << "%" << std::endl;
+    }
+    out << std::setprecision(2);
+    for (int t=0; t<R->numTables; t++) {
+      table& T = R->tables[t];
+      out << "table " << T.name << ": " << T.numEntries << " entries in "
+	  << T.numBuckets << " buckets" << std::endl;
+      out << "  occupancy";
+      printBins(out,T.occupancy);
+      out << std::endl;
+      out << "  chains   ";
+      printBins(out,T.chains);
+      out << std::endl;
+      out << "  to find each entry: " << (T.numEntries > 0 ? (double)T.sumChains/T.numEntries : 0.0)
+	  << " comparisons on average, at most " << T.longest << std::endl;
+#ifdef METER
+      const counters& c = T.counted;
+      if (T.counts) {
+	out << "  lookups: " << c.lookups << ", "
+	    << (c.lookups > 0 ? (double)c.comparisons/c.lookups : 0.0)
+	    << " comparisons on average, at most " << c.most << std::endl;
+	out << "  rehashes: " << c.rehashes << ", taking " << c.rehashNanos/1e6 << " ms" << std::endl;
+      }
+#endif
+    }
+    if (!ENABLED) {
+      out << "(lookups and rehashes are counted only when built with `make METER=1`)" << std::endl;
+    }
+    out << std::defaultfloat << std::setprecision(precision);
+  }
+
+  // printJsonBins(out,h):
+  //
+  // Writes the bins of `h` as a JSON array.
+  //
+  void printJsonBins(std::ostream& out, const histogram& h) {
+    out << "[";
+    for (int i=0; i<BINS; i++) {
+      out << (i == 0 ? "" : ",") << h.bins[i];
+    }
+    out << "]";
+  }
+
+  // printJson(R,out):
+  //
+  // Writes `R` to `out` as one JSON object on one line. Phase times
+  // are in nanoseconds. The table counters are there only if they were
+  // compiled in, as `metered` says, and the table keeps them.
+  //
+  void printJson(readings* R, std::ostream& out) {
+    out << "{\"metered\":" << (ENABLED ? "true" : "false") << ",\"phases\":{";
+    for (int i=0; i<R->numPhases; i++) {
+      out << (i == 0 ? "" : ",") << "\"" << R->phases[i] << "\":" << R->nanos[i];
+    }
+    out << "},\"tables\":[";
+    for (int t=0; t<R->numTables; t++) {
+      table& T = R->tables[t];
+      out << (t == 0 ? "" : ",") << "{\"name\":\"" << T.name << "\""
+	  << ",\"buckets\":" << T.numBuckets
+	  << ",\"entries\":" << T.numEntries
+	  << ",\"occupancy\":";
+      printJsonBins(out,T.occupancy);
+      out << ",\"chains\":";
+      printJsonBins(out,T.chains);
+      out << ",\"chain_comparisons\":" << T.sumChains
+	  << ",\"longest_chain\":" << T.longest;
+#ifdef METER
+      const counters& c = T.counted;
+      if (T.counts) {
+	out << ",\"lookups\":" << c.lookups
+	    << ",\"comparisons\":" << c.comparisons
+	    << ",\"most_comparisons\":" << c.most
+	    << ",\"rehashes\":" << c.rehashes
+	    << ",\"rehash_ns\":" << c.rehashNanos;
+      }
+#endif
+      out << "}";
+    }
+    out << "]}" << std::endl;
+  }
+
+  // destroy(R):
+  //
+  // Deletes `R`, if it isn't nullptr.
+  //
+  void destroy(readings* R) {
+    delete R;
+  }
+
+} // end namespace meter
@@ -0,0 +1,206 @@
+#ifndef _METER_H
+#define _METER_H
+
+// meter.hh
+//
+// This defines what the `--stats` option of `stats` and `chats`
+// reports about where their time goes, as the type `meter::readings*`.
+// It collects three kinds of numbers:
+//
+//   * the shape of each hash table: how many entries its buckets (or
+//     groups of 16 slots) hold, and how many comparisons it takes to
+//     find each entry, as histograms. These are read off a table by
+//     its own module's `measure`, so they cost nothing until then.
+//   * the `counters` a table keeps as it goes: how many lookups it
+//     did and how many comparisons they made, and how many times it
+//     rehashed and how long that took. These sit in the innermost
+//     loops, so they are only compiled in when built with `-DMETER`
+//     (`make METER=1`). Otherwise `counters` is empty and the
+//     functions that keep it do nothing.
+//   * the wall time of each phase of a program, such as reading,
+//     tokenizing, counting, sorting or generating.
+//
+// A comparison is one look at a chained entry, or one group of 16
+// slots checked at once by a FLAT table, or one slot of a frozen one.
+//
+// The readings print as a few lines of text, or as one JSON object.
+//
+
+#include <iosfwd>
+#include <chrono>
+
+namespace meter {
+
+  // Whether the counters are compiled in.
+#ifdef METER
+  const bool ENABLED = true;
+#else
+  const bool ENABLED = false;
+#endif
+
+  // The number of bins of a histogram.
+  const int BINS = 17;
+
+  // histogram
+  //
+  // How many things there are of each size, for sizes 0 up to BINS-2;
+  // the last bin counts all of those of size BINS-1 or more.
+  //
+  struct histogram {
+    long bins[BINS];
+  };
+
+  // counters
+  //
+  // What a table counts as it is used, when built with METER.
+  //
+  struct counters {
+#ifdef METER
+    long lookups;            // How many keys were looked for,
+    long comparisons;        // how many comparisons that took in all,
+    long most;               // and the most that any one took.
+
+    long rehashes;           // How many times the table was rehashed,
+    long long rehashNanos;   // and how long that took, in nanoseconds.
+#endif
+  };
+
+  // table
+  //
+  // The readings of one hash table.
+  //
+  struct table {
+
+    const char* name;        // What the table is for.
+
+    long numBuckets;         // Its number of buckets, or groups of 16 slots,
+    long numEntries;         // and of entries.
+
+    histogram occupancy;     // Its buckets, or groups of 16 slots, by how
+			     // many entries they hold.
+
+    histogram chains;        // Its entries, by how many comparisons it
+			     // takes to find them.
+
+    long sumChains;          // How many comparisons finding every entry
+    long longest;            // once takes in all, and the most for one.
+
+    bool counts;             // Whether the table keeps counters,
+    counters counted;        // and what it counted as it went.
+  };
+
+  // The most phases and tables one `readings` can hold.
+  const int MAX_PHASES = 8;
+  const int MAX_TABLES = 4;
+
+  // readings
+  //
+  // Everything `--stats` reports for one run of a program.
+  //
+  struct readings {
+
+    const char* phases[MAX_PHASES];   // The name of each phase,
+    long long nanos[MAX_PHASES];      // and its wall time, in nanoseconds.
+    int numPhases;
+
+    table tables[MAX_TABLES];         // The tables measured.
+    int numTables;
+  };
+
+  // now():
+  //
+  // Returns the time on a steady clock, in nanoseconds.
+  //
+  inline long long now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // stamp():
+  //
+  // Returns the time, as `now`, for the counters to time something by,
+  // or just 0 when they aren't compiled in.
+  //
+  inline long long stamp() {
+#ifdef METER
+    return now();
+#else
+    return 0;
+#endif
+  }
+
+  // reset(c):
+  //
+  // Zeroes the counters `c`.
+  //
+  inline void reset([[maybe_unused]] counters& c) {
+#ifdef METER
+    c.lookups = c.comparisons = c.most = c.rehashes = 0;
+    c.rehashNanos = 0;
+#endif
+  }
+
+  // looked(c,comparisons):
+  //
+  // Counts one lookup that made `comparisons` comparisons.
+  //
+  inline void looked([[maybe_unused]] counters& c, [[maybe_unused]] long comparisons) {
+#ifdef METER
+    c.lookups++;
+    c.comparisons += comparisons;
+    c.most = comparisons > c.most ? comparisons : c.most;
+#endif
+  }
+
+  // rehashed(c,since):
+  //
+  // Counts one rehash, which started at the time `since`, a `stamp`.
+  //
+  inline void rehashed([[maybe_unused]] counters& c, [[maybe_unused]] long long since) {
+#ifdef METER
+    c.rehashes++;
+    c.rehashNanos += now() - since;
+#endif
+  }
+
+  // add(into,from):
+  //
+  // Adds the counts of `from` into `into`, as for tables merged into one.
+  //
+  inline void add([[maybe_unused]] counters& into, [[maybe_unused]] const counters& from) {
+#ifdef METER
+    into.lookups += from.lookups;
+    into.comparisons += from.comparisons;
+    into.most = from.most > into.most ? from.most : into.most;
+    into.rehashes += from.rehashes;
+    into.rehashNanos += from.rehashNanos;
+#endif
+  }
+
+  // tally(h,size):
+  //
+  // Counts one more thing of the given size in `h`.
+  //
+  inline void tally(histogram& h, long size) {
+    h.bins[size < BINS-1 ? size : BINS-1]++;
+  }
+
+  //
+  // The public interface to meter::readings objects.
+  //
+  readings* build();                               // Constructs readings with no phases or tables.
+
+  void phase(readings* R, const char* name,        // Adds `nanos` to the wall time of the phase
+	     long long nanos);                     // `name`, adding the phase if it's new.
+
+  table* addTable(readings* R, const char* name);  // Adds a table named `name`, all zeroes, for a
+                                                   // `measure` to fill in. Returns nullptr if full.
+
+  void print(readings* R, std::ostream& out);      // Writes the readings as lines of text.
+  void printJson(readings* R, std::ostream& out);  // Writes the readings as one JSON object.
+
+  void destroy(readings* R);                       // Returns the storage of `R`, if any, back to the heap.
+
+}
+
+#endif // _METER_H
@@ -0,0 +1,340 @@
+//
+// model.cc
+//
+// This implements the model files described in "model.hh": writing
+// one from a `gram::frozen`, and mapping one back in to generate from.
+//
+// The functions it defines include
+//    * `bool model::save(gram::frozen*,const char*)`: write a frozen model to a file
+//    * `model::file* model::open(const char*)`: map a model file
+//    * `bool model::verify(model::file*)`: check a model's checksums and ranges
+//    * `gram::frozen* model::frozen(model::file*)`: get the model to generate from
+//    * `void model::addTo(model::file*,gram::dict*)`: add a model's counts to a dictionary
+//    * `void model::close(model::file*)`: give back the model's mapping
+//
+// `save` works out where every part goes before writing any of it,
+// then writes the arrays of the model straight from memory. The
+// header goes in last, once the checksums of what was written are
+// known.
+//
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "model.hh"
+#include "gram.hh"
+#include "vocab.hh"
+#include "hash.hh"
+
+using hashing::hash64;
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// WRITING MODELS
+//
+namespace model {
+
+  // The largest string pool a model can have, since word starts are
+  // 32-bit offsets.
+  const unsigned long long MAX_POOL = 0xFFFFFFFFULL;
+
+  // The key of an empty slot of the table.
+  const unsigned long long NO_KEY = ~0ULL;
+
+  // alignUp(at,alignment):
+  //
+  // Returns the first position at or after `at` that is a multiple of
+  // `alignment`.
+  //
+  unsigned long long alignUp(unsigned long long at, unsigned long long alignment) {
+    return (at + alignment-1) / alignment * alignment;
+  }
+
+  // writeAt(fd,data,size,at):
+  //
+  // Writes the `size` bytes at `data` to `fd` at position `at`.
+  // Returns false if they couldn't all be written.
+  //
+  bool writeAt(int fd, const void* data, unsigned long long size, unsigned long long at) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+      long n = pwrite(fd,bytes,size,at);
+      if (n <= 0) {
+	return false;
+      }
+      bytes += n;
+      size -= n;
+      at += n;
+    }
+    return true;
+  }
+
+  // save(F,filename):
+  //
+  // Writes the vocabulary, table, alias tables and counts of `F` into a
+  // new model file `filename`. It is written to a temporary file beside
+  // it, then renamed, so a failed save leaves any old `filename` as it
+  // was.
+  //
+  bool save(gram::frozen* F, const char* filename) {
+    header head;
+    std::memset(&head,0,sizeof(header));
+    head.numWords = vocab::size(F->words);
+    head.tableSize = F->tableSize;
+    head.numEntries = F->numEntries;
+    head.numColumns = F->offsets[F->tableSize];
+
+    //the words go into the pool in ID order
+    unsigned int* starts = new unsigned int[head.numWords+1];
+    for (unsigned long long id=0; id<head.numWords; id++) {
+      starts[id] = head.poolSize;
+      head.poolSize += vocab::word(F->words,id).size();
+    }
+    starts[head.numWords] = head.poolSize;
+    if (head.poolSize > MAX_POOL) {
+      delete [] starts;
+      return false;
+    }
+
+    head.poolAt    = sizeof(header);
+    head.startsAt  = alignUp(head.poolAt+head.poolSize,4);
+    head.keysAt    = alignUp(head.startsAt+(head.numWords+1)*sizeof(unsigned int),8);
+    head.offsetsAt = head.keysAt+head.tableSize*sizeof(unsigned long long);
+    head.choicesAt = head.offsetsAt+(head.tableSize+1)*sizeof(int);
+    head.countsAt  = head.choicesAt+head.numColumns*sizeof(gram::choice);
+    unsigned long long size = head.countsAt+head.numColumns*sizeof(int);
+
+    std::string temporary = std::string(filename)+".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0) {
+      delete [] starts;
+      return false;
+    }
+    bool ok = fchmod(fd,0644) == 0 && ftruncate(fd,size) == 0;
+    for (unsigned long long id=0; ok && id<head.numWords; id++) {
+      const std::string& w = vocab::word(F->words,id);
+      ok = writeAt(fd,w.data(),w.size(),head.poolAt+starts[id]);
+    }
+    ok = ok
+      && writeAt(fd,starts,(head.numWords+1)*sizeof(unsigned int),head.startsAt)
+      && writeAt(fd,F->keys,head.tableSize*sizeof(unsigned long long),head.keysAt)
+      && writeAt(fd,F->offsets,(head.tableSize+1)*sizeof(int),head.offsetsAt)
+      && writeAt(fd,F->choices,head.numColumns*sizeof(gram::choice),head.choicesAt)
+      && writeAt(fd,F->counts,head.numColumns*sizeof(int),head.countsAt);
+    delete [] starts;
+
+    //checksums what landed in the file, padding and all
+    if (ok) {
+      void* written = mmap(nullptr,size,PROT_READ,MAP_SHARED,fd,0);
+      if (written == MAP_FAILED) {
+	ok = false;
+      } else {
+	const char* base = static_cast<const char*>(written);
+	std::memcpy(head.magic,MAGIC,sizeof(MAGIC));
+	head.version = VERSION;
+	head.headerSize = sizeof(header);
+	head.poolChecksum = hash64(base+head.poolAt,head.poolSize);
+	head.tableChecksum = hash64(base+head.startsAt,size-head.startsAt);
+	head.headerChecksum = hash64(reinterpret_cast<const char*>(&head),
+				     offsetof(header,headerChecksum));
+	munmap(written,size);
+	ok = writeAt(fd,&head,sizeof(header),0);
+      }
+    }
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && std::rename(temporary.c_str(),filename) == 0;
+    if (!ok) {
+      unlink(temporary.c_str());
+    }
+    return ok;
+  }
+
+} // end namespace model
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// READING MODELS
+//
+namespace model {
+
+  // within(at,count,width,alignment,size):
+  //
+  // Whether `count` items of `width` bytes, starting at `at` and
+  // aligned to `alignment`, lie within a file of `size` bytes.
+  //
+  bool within(unsigned long long at, unsigned long long count, unsigned long long width,
+	      unsigned long long alignment, unsigned long long size) {
+    return at % alignment == 0 && at <= size && count <= (size-at)/width;
+  }
+
+  // open(filename):
+  //
+  // Maps the model file `filename`, checks that its header is sound and
+  // that every part it locates lies within the file, and rebuilds its
+  // vocabulary. The rest is only checked by `verify`.
+  //
+  file* open(const char* filename) {
+    int fd = ::open(filename,O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd,&info) != 0 || info.st_size < (long)sizeof(header)) {
+      ::close(fd);
+      return nullptr;
+    }
+    void* mapping = mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      return nullptr;
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    const header* head = reinterpret_cast<const header*>(base);
+    unsigned long long size = info.st_size;
+    bool ok = std::memcmp(head->magic,MAGIC,sizeof(MAGIC)) == 0
+      && head->version == VERSION
+      && head->headerSize == sizeof(header)
+      && head->headerChecksum == hash64(base,offsetof(header,headerChecksum))
+      && head->tableSize > 0 && head->tableSize <= 0x40000000ULL
+      && (head->tableSize & (head->tableSize-1)) == 0
+      && head->numEntries < head->tableSize
+      && head->numWords < vocab::NONE
+      && head->numColumns <= 0x7FFFFFFFULL
+      && within(head->poolAt,head->poolSize,1,1,size)
+      && head->poolSize <= MAX_POOL
+      && within(head->startsAt,head->numWords+1,sizeof(unsigned int),4,size)
+      && within(head->keysAt,head->tableSize,sizeof(unsigned long long),8,size)
+      && within(head->offsetsAt,head->tableSize+1,sizeof(int),4,size)
+      && within(head->choicesAt,head->numColumns,sizeof(gram::choice),4,size)
+      && within(head->countsAt,head->numColumns,sizeof(int),4,size);
+    if (!ok) {
+      munmap(mapping,info.st_size);
+      return nullptr;
+    }
+
+    //the words are interned in ID order, so each must get the next ID
+    const unsigned int* starts = reinterpret_cast<const unsigned int*>(base+head->startsAt);
+    const char* pool = base+head->poolAt;
+    vocab::dict* words = vocab::build(head->numWords);
+    for (unsigned long long id=0; ok && id<head->numWords; id++) {
+      ok = starts[id] <= starts[id+1] && starts[id+1] <= head->poolSize
+	&& vocab::intern(words,pool+starts[id],starts[id+1]-starts[id]) == id;
+    }
+    if (!ok) {
+      vocab::destroy(words);
+      munmap(mapping,info.st_size);
+      return nullptr;
+    }
+
+    file* M = new file;
+    M->head    = head;
+    M->starts  = starts;
+    M->pool    = pool;
+    M->mapping = mapping;
+    M->size    = info.st_size;
+    M->model.keys       = reinterpret_cast<unsigned long long*>(const_cast<char*>(base+head->keysAt));
+    M->model.offsets    = reinterpret_cast<int*>(const_cast<char*>(base+head->offsetsAt));
+    M->model.choices    = reinterpret_cast<gram::choice*>(const_cast<char*>(base+head->choicesAt));
+    M->model.counts     = reinterpret_cast<int*>(const_cast<char*>(base+head->countsAt));
+    M->model.tableSize  = head->tableSize;
+    M->model.numEntries = head->numEntries;
+    M->model.words      = words;
+    return M;
+  }
+
+  // verify(M):
+  //
+  // Checks the string pool and the arrays of `M` against the checksums
+  // in its header, and that they hold a model `gram::pick` can use:
+  // each slot's columns come after the last's, a slot has columns just
+  // when it has a key, and every key and column names words of the
+  // vocabulary.
+  //
+  bool verify(file* M) {
+    const header* head = M->head;
+    const char* base = static_cast<const char*>(M->mapping);
+    if (hash64(M->pool,head->poolSize) != head->poolChecksum
+	|| hash64(base+head->startsAt,M->size-head->startsAt) != head->tableChecksum) {
+      return false;
+    }
+    const gram::frozen& F = M->model;
+    if (F.offsets[0] != 0 || F.offsets[F.tableSize] != (long long)head->numColumns) {
+      return false;
+    }
+    unsigned long long numEntries = 0;
+    for (int s=0; s<F.tableSize; s++) {
+      bool empty = F.keys[s] == NO_KEY;
+      if (F.offsets[s+1] < F.offsets[s] || empty != (F.offsets[s+1] == F.offsets[s])) {
+	return false;
+      }
+      unsigned first = F.keys[s] >> 32;
+      unsigned second = (unsigned)F.keys[s];
+      if (!empty && ((first >= head->numWords && first != vocab::NONE) || second >= head->numWords)) {
+	return false;
+      }
+      numEntries += empty ? 0 : 1;
+    }
+    if (numEntries != head->numEntries) {
+      return false;
+    }
+    for (unsigned long long c=0; c<head->numColumns; c++) {
+      if (F.choices[c].word >= head->numWords || F.choices[c].alias >= head->numWords
+	  || F.counts[c] <= 0) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // frozen(M):
+  //
+  // Returns the model of `M`.
+  //
+  gram::frozen* frozen(file* M) {
+    return &M->model;
+  }
+
+  // addTo(M,D):
+  //
+  // Adds each follower of each key of `M` into `D`, as many times as
+  // it was counted. Every word of `M` is looked up in the vocabulary of
+  // `D` just once, as `gram::merge` does.
+  //
+  void addTo(file* M, gram::dict* D) {
+    const gram::frozen& F = M->model;
+    unsigned* ids = new unsigned[M->head->numWords];
+    for (unsigned long long id=0; id<M->head->numWords; id++) {
+      ids[id] = gram::wordId(D,M->pool+M->starts[id],M->starts[id+1]-M->starts[id]);
+    }
+    for (int s=0; s<F.tableSize; s++) {
+      if (F.keys[s] == NO_KEY) {
+	continue;
+      }
+      unsigned first = F.keys[s] >> 32;
+      unsigned second = (unsigned)F.keys[s];
+      unsigned long long k = first == vocab::NONE ? gram::key(ids[second]) : gram::key(ids[first],ids[second]);
+      for (int c=F.offsets[s]; c<F.offsets[s+1]; c++) {
+	gram::add(D,k,ids[F.choices[c].word],F.counts[c]);
+      }
+    }
+    delete [] ids;
+  }
+
+  // close(M):
+  //
+  // Deletes the vocabulary of `M`, unmaps it and deletes it.
+  //
+  void close(file* M) {
+    vocab::destroy(M->model.words);
+    munmap(M->mapping,M->size);
+    delete M;
+  }
+
+} // end namespace model
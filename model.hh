@@ -0,0 +1,125 @@
+#ifndef _MODEL_H
+#define _MODEL_H
+
+// model.hh
+//
+// This defines a file format for saving a trained chat model, a
+// `gram::frozen`, and the type `model::file*` for opening one back up
+// to generate from, so that `chats` needn't train on its text again.
+//
+// A model file is the frozen model's own arrays, laid out so that they
+// can be mapped into memory and used as they sit:
+//
+//   * a `header`, holding a magic string, the format version, where
+//     each part below starts, and checksums;
+//   * the string pool: the characters of every word, in ID order;
+//   * where each word starts in the pool, and where the last one ends;
+//   * the key in each slot of the frozen table, all ones if empty;
+//   * where each slot's columns start, and how many columns there are;
+//   * the alias table columns of every key, back to back;
+//   * the count of the word of each of those columns.
+//
+// Only the vocabulary is rebuilt when a model is opened, since the
+// words are handed out as strings; the table, the alias tables and
+// the counts are read in place, with nothing to parse or allocate.
+// All numbers are stored little-endian, as this machine has them.
+//
+// The counts let a model be updated without training on all of its
+// text again: `addTo` puts them back into a `gram::dict`, which can
+// then be trained on new text, or have other models added to it, and
+// be saved once more. So new text can be kept as a small model of its
+// own, a delta, to be folded into the main one whenever convenient.
+//
+
+#include "gram.hh"
+
+namespace model {
+
+  // The magic string that starts every model file, and the version of
+  // the layout described here.
+  const char MAGIC[8] = {'C','H','A','T','M','O','D','L'};
+  const unsigned int VERSION = 1;
+
+  // header
+  //
+  // The first bytes of a model file.
+  //
+  struct header {
+
+    char magic[8];                   // Always MAGIC.
+
+    unsigned int version;            // The VERSION that wrote the file.
+
+    unsigned int headerSize;         // sizeof(header) when it was written.
+
+    unsigned long long numWords;     // The number of words in the vocabulary.
+
+    unsigned long long tableSize;    // The number of slots in the table; a
+				     // power of two.
+
+    unsigned long long numEntries;   // How many of them hold a key.
+
+    unsigned long long numColumns;   // The number of alias table columns.
+
+    unsigned long long poolAt;       // Where the string pool starts,
+    unsigned long long poolSize;     // and how many bytes it spans.
+
+    unsigned long long startsAt;     // Where the `numWords+1` word starts are.
+
+    unsigned long long keysAt;       // Where the `tableSize` keys are,
+    unsigned long long offsetsAt;    // the `tableSize+1` column offsets,
+    unsigned long long choicesAt;    // the `numColumns` columns,
+    unsigned long long countsAt;     // and their counts.
+
+    unsigned long long poolChecksum;  // The hash64 of the string pool.
+
+    unsigned long long tableChecksum; // The hash64 of everything after
+				      // the pool, which sits back to back.
+
+    unsigned long long headerChecksum; // The hash64 of the header up
+				       // to this field.
+  };
+
+  // file
+  //
+  // A model file opened for generating.
+  //
+  struct file {
+
+    const header* head;          // The header, at the start of the mapping.
+
+    gram::frozen model;          // The model, its arrays pointing into the
+				 // mapping; only its vocabulary is its own.
+
+    const unsigned int* starts;  // Where each word starts in the pool.
+
+    const char* pool;            // The characters of the words.
+
+    void* mapping;               // The whole file, mapped into memory.
+
+    long size;                   // The length of the mapping.
+  };
+
+  //
+  // The public interface to model files.
+  //
+  bool save(gram::frozen* F, const char* filename); // Writes the model `F` to `filename`. Returns false
+                                                    // if it can't be written.
+
+  file* open(const char* filename);                 // Maps the model file `filename`. Returns nullptr if
+                                                    // it can't be opened or isn't a valid model.
+
+  bool verify(file* M);                             // Checks the arrays of `M` against their checksums,
+                                                    // and that every column and offset is in range.
+
+  gram::frozen* frozen(file* M);                    // Returns the model of `M`, to generate from. It
+                                                    // lasts until `M` is closed, which frees it.
+
+  void addTo(file* M, gram::dict* D);               // Adds every key of `M` into `D`, each follower with
+                                                    // its count, so that `D` can go on training.
+
+  void close(file* M);                              // Unmaps `M`, deletes its vocabulary and deletes it.
+
+}
+
+#endif // _MODEL_H
@@ -0,0 +1,527 @@
+#ifndef _NGRAM_H
+#define _NGRAM_H
+
+// ngram.hh
+//
+// This defines `ngram::model<N>`, a chat model of any order N: each
+// word is picked by the N-1 words before it, where `gram::dict` is
+// fixed at two. The order is a template parameter, so each model's
+// context width is known when it is compiled. Its keys are arrays of
+// exactly N-1 word IDs, with no separators or lengths to store, and
+// the loops over them are unrolled.
+//
+// A model keeps a level for every context length from 0 up to N-1.
+// A context of N-1 words that was never seen backs off to the last
+// N-2 of them, and so on down to the empty context, which has every
+// word of the text as a follower. So a pick always finds a word.
+//
+// Higher orders have far more distinct contexts than lower ones, and
+// most of them are followed by just one word, so the levels are kept
+// flat from the start:
+//
+//   * While training, each level is a single open-addressing table of
+//     `tally` records: a context, a follower, and a count. Training is
+//     one pass, adding each word to every level; there are no nodes
+//     or lists and nothing per context.
+//
+//   * `freeze` then lays out each level as `gram::frozen` does: an
+//     open-addressing table of contexts, and the alias tables of their
+//     followers back to back in one array, found through `offsets`. A
+//     slot with no columns is empty, so no key is set aside to mark it.
+//
+// Being templates, these functions are all defined here, in the header.
+//
+
+#include <string>
+#include <string_view>
+#include "gram.hh"
+#include "vocab.hh"
+#include "hash.hh"
+#include "rng.hh"
+
+namespace ngram {
+
+  // tally
+  //
+  // How many times a context of W words was followed by one word.
+  //
+  template<int W>
+  struct tally {
+
+    unsigned words[W+1];  // The words of the context, oldest first, then
+			  // the follower.
+
+    int count;            // How many times; 0 marks an empty slot.
+  };
+
+  // level
+  //
+  // The followers of every context of W words seen in training.
+  //
+  template<int W>
+  struct level {
+
+    tally<W>* tallies;      // While training, an open-addressing table of the
+			    // counts of each context and follower.
+
+    int numTallies;         // How many slots of `tallies` are in use.
+
+    int tallySize;          // The length of `tallies`; a power of two.
+
+    unsigned* keys;         // Once frozen, the context in each slot of a table,
+			    // W words apiece.
+
+    int* offsets;           // Where each slot's columns start in `choices`, and
+			    // at the end, how many columns there are in all.
+
+    int tableSize;          // The number of slots; a power of two.
+
+    gram::choice* choices;  // The alias tables of all the contexts, back to back.
+  };
+
+  // levels
+  //
+  // The levels of contexts of W words and of every shorter length.
+  //
+  template<int W>
+  struct levels {
+    levels<W-1> shorter;
+    level<W> longest;
+  };
+
+  template<>
+  struct levels<-1> {
+  };
+
+  // model
+  //
+  // A chat model that picks each word by the N-1 words before it.
+  //
+  template<int N>
+  struct model {
+
+    vocab::dict* words;     // Every word seen, each stored once under its ID.
+
+    levels<N-1> contexts;   // The followers of contexts of 0 through N-1 words.
+
+    bool frozen;            // Whether `freeze` has been called.
+  };
+
+  //
+  // The public interface to ngram::model objects.
+  //
+  template<int N> model<N>* build();                                 // Constructs an empty model.
+
+  template<int N> unsigned wordId(model<N>* M, const char* chars,    // Returns the ID of a word, adding it
+				  int length);                       // if it is new.
+  template<int N> unsigned wordId(model<N>* M, std::string_view w);
+  template<int N> const std::string& word(model<N>* M, unsigned id); // Returns the word with an ID.
+
+  template<int N> void add(model<N>* M, const unsigned* recent,      // Counts `fw` as following the N-1
+			   unsigned fw);                             // words `recent`, oldest first, and
+                                                                     // each shorter context they end with.
+
+  template<int N> void freeze(model<N>* M);                          // Lays out the model for picking once
+                                                                     // training is done.
+
+  template<int N> unsigned pick(model<N>* M, const unsigned* recent, // Returns a random follower of the N-1
+				rng::stream& r);                     // words `recent` in a frozen model,
+                                                                     // drawn from `r`, backing off to
+                                                                     // shorter contexts.
+
+  template<int N> void destroy(model<N>* M);                         // Returns the storage of `M` back to
+                                                                     // the heap.
+
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// ONE LEVEL
+//
+namespace ngram {
+
+  // hashOf<W>(words):
+  //
+  // Returns a hash of the W word IDs at `words`, taken two at a time.
+  //
+  template<int W>
+  unsigned long long hashOf(const unsigned* words) {
+    unsigned long long h = W;
+    for (int i=0; i<W; i+=2) {
+      unsigned long long pair = words[i];
+      if (i+1 < W) {
+	pair |= (unsigned long long)words[i+1] << 32;
+      }
+      h = hashing::hashInt(h ^ pair);
+    }
+    return h;
+  }
+
+  // same<W>(a,b):
+  //
+  // Whether the W word IDs at `a` and at `b` are the same.
+  //
+  template<int W>
+  bool same(const unsigned* a, const unsigned* b) {
+    for (int i=0; i<W; i++) {
+      if (a[i] != b[i]) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // start(L):
+  //
+  // Makes `L` an empty level, ready for training.
+  //
+  template<int W>
+  void start(level<W>& L) {
+    L.tallySize  = 16;
+    L.tallies    = new tally<W>[L.tallySize]();
+    L.numTallies = 0;
+    L.keys       = nullptr;
+    L.offsets    = nullptr;
+    L.tableSize  = 0;
+    L.choices    = nullptr;
+  }
+
+  // growTallies(L):
+  //
+  // Doubles the table of tallies of `L`, placing each one anew.
+  //
+  template<int W>
+  void growTallies(level<W>& L) {
+    tally<W>* old = L.tallies;
+    int oldSize = L.tallySize;
+    L.tallySize *= 2;
+    L.tallies = new tally<W>[L.tallySize]();
+    int mask = L.tallySize-1;
+    for (int t=0; t<oldSize; t++) {
+      if (old[t].count != 0) {
+	int slot = hashOf<W+1>(old[t].words) & mask;
+	while (L.tallies[slot].count != 0) {
+	  slot = (slot+1) & mask;
+	}
+	L.tallies[slot] = old[t];
+      }
+    }
+    delete [] old;
+  }
+
+  // tallyUp(L,context,fw):
+  //
+  // Counts `fw` once more as following the W words at `context`. The
+  // table grows once it would be more than three quarters full.
+  //
+  template<int W>
+  void tallyUp(level<W>& L, const unsigned* context, unsigned fw) {
+    unsigned words[W+1];
+    for (int i=0; i<W; i++) {
+      words[i] = context[i];
+    }
+    words[W] = fw;
+
+    int mask = L.tallySize-1;
+    int slot = hashOf<W+1>(words) & mask;
+    while (L.tallies[slot].count != 0) {
+      if (same<W+1>(L.tallies[slot].words,words)) {
+	L.tallies[slot].count++;
+	return;
+      }
+      slot = (slot+1) & mask;
+    }
+    if (4*(L.numTallies+1) > 3*L.tallySize) {
+      growTallies(L);
+      mask = L.tallySize-1;
+      slot = hashOf<W+1>(words) & mask;
+      while (L.tallies[slot].count != 0) {
+	slot = (slot+1) & mask;
+      }
+    }
+    for (int i=0; i<=W; i++) {
+      L.tallies[slot].words[i] = words[i];
+    }
+    L.tallies[slot].count = 1;
+    L.numTallies++;
+  }
+
+  // findContext(L,context,numSlots,keys,filled):
+  //
+  // Returns the slot of a table of `numSlots` slots, with keys `keys`,
+  // that holds the W words at `context`, or the empty slot where they
+  // would go. A slot is in use if `filled` says so.
+  //
+  template<int W>
+  int findContext(const unsigned* context, int numSlots, const unsigned* keys, const bool* filled) {
+    int mask = numSlots-1;
+    int slot = hashOf<W>(context) & mask;
+    while (filled[slot] && !same<W>(&keys[W*slot],context)) {
+      slot = (slot+1) & mask;
+    }
+    return slot;
+  }
+
+  // freezeLevel(L):
+  //
+  // Lays out the tallies of `L` as a table of contexts and their alias
+  // tables, then gives back the tallies. There are at most as many
+  // contexts as tallies; they are counted first so that the table can
+  // be sized for them alone.
+  //
+  template<int W>
+  void freezeLevel(level<W>& L) {
+
+    //count the distinct contexts in a table big enough for every tally
+    int provisional = hashing::powerOfTwoAtLeast(L.numTallies + L.numTallies/4 + 1);
+    unsigned* seenKeys = new unsigned[W*provisional + 1];
+    bool* seen = new bool[provisional]();
+    int numContexts = 0;
+    for (int t=0; t<L.tallySize; t++) {
+      if (L.tallies[t].count != 0) {
+	int slot = findContext<W>(L.tallies[t].words,provisional,seenKeys,seen);
+	if (!seen[slot]) {
+	  seen[slot] = true;
+	  for (int i=0; i<W; i++) {
+	    seenKeys[W*slot+i] = L.tallies[t].words[i];
+	  }
+	  numContexts++;
+	}
+      }
+    }
+    delete [] seenKeys;
+    delete [] seen;
+
+    //place each context in the real table, counting its followers
+    L.tableSize = hashing::powerOfTwoAtLeast(numContexts + numContexts/4 + 1);
+    L.keys = new unsigned[W*L.tableSize + 1];
+    bool* filled = new bool[L.tableSize]();
+    int* number = new int[L.tableSize]();
+    long long* total = new long long[L.tableSize]();
+    for (int t=0; t<L.tallySize; t++) {
+      if (L.tallies[t].count != 0) {
+	int slot = findContext<W>(L.tallies[t].words,L.tableSize,L.keys,filled);
+	if (!filled[slot]) {
+	  filled[slot] = true;
+	  for (int i=0; i<W; i++) {
+	    L.keys[W*slot+i] = L.tallies[t].words[i];
+	  }
+	}
+	number[slot]++;
+	total[slot] += L.tallies[t].count;
+      }
+    }
+
+    //each slot's columns start where the last slot's end
+    L.offsets = new int[L.tableSize+1];
+    int numColumns = 0;
+    for (int s=0; s<L.tableSize; s++) {
+      L.offsets[s] = numColumns;
+      numColumns += number[s];
+    }
+    L.offsets[L.tableSize] = numColumns;
+
+    //gather the followers of each context, then make their alias tables
+    gram::follower* followers = new gram::follower[numColumns];
+    int* placed = new int[L.tableSize]();
+    for (int t=0; t<L.tallySize; t++) {
+      if (L.tallies[t].count != 0) {
+	int slot = findContext<W>(L.tallies[t].words,L.tableSize,L.keys,filled);
+	followers[L.offsets[slot] + placed[slot]++] = gram::follower{L.tallies[t].words[W],L.tallies[t].count};
+      }
+    }
+    L.choices = new gram::choice[numColumns];
+    for (int s=0; s<L.tableSize; s++) {
+      if (number[s] > 0) {
+	gram::buildAlias(&followers[L.offsets[s]],number[s],total[s],&L.choices[L.offsets[s]]);
+      }
+    }
+
+    delete [] followers;
+    delete [] placed;
+    delete [] filled;
+    delete [] number;
+    delete [] total;
+    delete [] L.tallies;
+    L.tallies = nullptr;
+    L.numTallies = 0;
+    L.tallySize = 0;
+  }
+
+  // pickFrom(L,context,r):
+  //
+  // Returns a random follower of the W words at `context` in the frozen
+  // level `L`, drawn from `r`, or vocab::NONE if they were never seen.
+  //
+  template<int W>
+  unsigned pickFrom(level<W>& L, const unsigned* context, rng::stream& r) {
+    int mask = L.tableSize-1;
+    int slot = hashOf<W>(context) & mask;
+    while (L.offsets[slot] != L.offsets[slot+1]) {
+      if (same<W>(&L.keys[W*slot],context)) {
+	int first = L.offsets[slot];
+	int number = L.offsets[slot+1] - first;
+	unsigned long long x = rng::next(r);
+	gram::choice& c = L.choices[first + rng::below(x,number)];
+	if (rng::fraction(x) < c.chance) {
+	  return c.word;
+	}
+	return c.alias;
+      }
+      slot = (slot+1) & mask;
+    }
+    return vocab::NONE;
+  }
+
+  // finish(L):
+  //
+  // Gives back the storage of level `L`.
+  //
+  template<int W>
+  void finish(level<W>& L) {
+    delete [] L.tallies;
+    delete [] L.keys;
+    delete [] L.offsets;
+    delete [] L.choices;
+  }
+
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// ALL THE LEVELS
+//
+// Each of these walks from the longest context down to the empty one.
+// A context of W words is the last W of the N-1 words ending at `end`.
+//
+namespace ngram {
+
+  inline void startAll(levels<-1>&) { }
+  inline void addAll(levels<-1>&, const unsigned*, unsigned) { }
+  inline void freezeAll(levels<-1>&) { }
+  inline unsigned pickAll(levels<-1>&, const unsigned*, rng::stream&) { return vocab::NONE; }
+  inline void finishAll(levels<-1>&) { }
+
+  template<int W>
+  void startAll(levels<W>& Ls) {
+    start(Ls.longest);
+    startAll(Ls.shorter);
+  }
+
+  template<int W>
+  void addAll(levels<W>& Ls, const unsigned* end, unsigned fw) {
+    tallyUp(Ls.longest,end-W,fw);
+    addAll(Ls.shorter,end,fw);
+  }
+
+  template<int W>
+  void freezeAll(levels<W>& Ls) {
+    freezeLevel(Ls.longest);
+    freezeAll(Ls.shorter);
+  }
+
+  template<int W>
+  unsigned pickAll(levels<W>& Ls, const unsigned* end, rng::stream& r) {
+    unsigned fw = pickFrom(Ls.longest,end-W,r);
+    return fw != vocab::NONE ? fw : pickAll(Ls.shorter,end,r);
+  }
+
+  template<int W>
+  void finishAll(levels<W>& Ls) {
+    finish(Ls.longest);
+    finishAll(Ls.shorter);
+  }
+
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// Operations on ngram::model.
+//
+namespace ngram {
+
+  // build():
+  //
+  // Build an empty model of order N.
+  //
+  template<int N>
+  model<N>* build() {
+    model<N>* newM = new model<N>;
+    newM->words  = vocab::build(1024);
+    newM->frozen = false;
+    startAll(newM->contexts);
+    return newM;
+  }
+
+  // wordId(M,chars,length), wordId(M,w):
+  //
+  // Returns the ID of a word, giving it one if it is new.
+  //
+  template<int N>
+  unsigned wordId(model<N>* M, const char* chars, int length) {
+    return vocab::intern(M->words,chars,length);
+  }
+
+  template<int N>
+  unsigned wordId(model<N>* M, std::string_view w) {
+    return vocab::intern(M->words,w);
+  }
+
+  // word(M,id):
+  //
+  // Returns the word with the given ID.
+  //
+  template<int N>
+  const std::string& word(model<N>* M, unsigned id) {
+    return vocab::word(M->words,id);
+  }
+
+  // add(M,recent,fw):
+  //
+  // Counts the word `fw` as following the N-1 words `recent`, oldest
+  // first, and as following every shorter context they end with.
+  //
+  template<int N>
+  void add(model<N>* M, const unsigned* recent, unsigned fw) {
+    addAll(M->contexts,recent+(N-1),fw);
+  }
+
+  // freeze(M):
+  //
+  // Lays out every level of `M` for picking. No more can be added.
+  //
+  template<int N>
+  void freeze(model<N>* M) {
+    if (!M->frozen) {
+      freezeAll(M->contexts);
+      M->frozen = true;
+    }
+  }
+
+  // pick(M,recent,r):
+  //
+  // Returns a random word to follow the N-1 words `recent`, oldest
+  // first, each as likely as the number of times it followed them. If
+  // they were never seen together, the oldest is dropped, and so on.
+  // Freezes `M` first if needed. Only an empty model gives vocab::NONE.
+  //
+  template<int N>
+  unsigned pick(model<N>* M, const unsigned* recent, rng::stream& r) {
+    freeze(M);
+    return pickAll(M->contexts,recent+(N-1),r);
+  }
+
+  // destroy(M):
+  //
+  // Deletes all the heap-allocated components of `M`.
+  //
+  template<int N>
+  void destroy(model<N>* M) {
+    finishAll(M->contexts);
+    vocab::destroy(M->words);
+    delete M;
+  }
+
+}
+
+#endif // _NGRAM_H
@@ -0,0 +1,120 @@
+#ifndef _RNG_H
+#define _RNG_H
+
+// rng.hh
+//
+// This defines `rng::stream`, a pseudorandom number generator that the
+// chat models draw from in place of `std::rand`. Each stream is its
+// own state, so threads that each hold one never share anything, and a
+// stream seeded the same way always gives the same numbers.
+//
+// A stream is xoshiro256** (Blackman and Vigna): 256 bits of state,
+// stepped with shifts, rotations and XORs, and scrambled by one
+// multiply on the way out. It has a period of 2^256-1, passes the
+// usual statistical test batteries, and costs a few cycles a number.
+//
+// A seed is spread over the state by splitmix64, so that nearby seeds
+// give unrelated streams. Streams for many texts or threads are made
+// from one seed by `jump`, which moves a stream 2^128 numbers ahead in
+// one go: the streams that result never overlap in practice.
+//
+
+namespace rng {
+
+  // stream
+  //
+  // The state of one generator.
+  //
+  struct stream {
+    unsigned long long s[4];
+  };
+
+  // rotl(x,k):
+  //
+  // Returns `x` rotated left by `k` bits.
+  //
+  inline unsigned long long rotl(unsigned long long x, int k) {
+    return (x << k) | (x >> (64-k));
+  }
+
+  // splitmix(state):
+  //
+  // Steps the splitmix64 generator with the given `state` and returns
+  // its next number.
+  //
+  inline unsigned long long splitmix(unsigned long long& state) {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // seed(r,seed):
+  //
+  // Sets the state of `r` from `seed`.
+  //
+  inline void seed(stream& r, unsigned long long seed) {
+    for (int i=0; i<4; i++) {
+      r.s[i] = splitmix(seed);
+    }
+  }
+
+  // next(r):
+  //
+  // Returns the next 64 random bits of `r`.
+  //
+  inline unsigned long long next(stream& r) {
+    unsigned long long result = rotl(r.s[1]*5,7)*9;
+    unsigned long long t = r.s[1] << 17;
+    r.s[2] ^= r.s[0];
+    r.s[3] ^= r.s[1];
+    r.s[1] ^= r.s[2];
+    r.s[0] ^= r.s[3];
+    r.s[2] ^= t;
+    r.s[3] = rotl(r.s[3],45);
+    return result;
+  }
+
+  // jump(r):
+  //
+  // Moves `r` ahead by 2^128 numbers.
+  //
+  inline void jump(stream& r) {
+    const unsigned long long JUMP[4] = {
+      0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+      0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    unsigned long long s[4] = {0, 0, 0, 0};
+    for (int i=0; i<4; i++) {
+      for (int b=0; b<64; b++) {
+	if (JUMP[i] & (1ULL << b)) {
+	  for (int j=0; j<4; j++) {
+	    s[j] ^= r.s[j];
+	  }
+	}
+	next(r);
+      }
+    }
+    for (int j=0; j<4; j++) {
+      r.s[j] = s[j];
+    }
+  }
+
+  // below(x,n), fraction(x):
+  //
+  // Turn the random bits `x` into a number below `n`, using the low 32
+  // bits (multiplied out, with no division), or into a fraction in
+  // [0,1), using the top 24. As they use different bits, one number
+  // from `next` can serve for both.
+  //
+  inline unsigned below(unsigned long long x, unsigned n) {
+    return (unsigned)(((x & 0xffffffffULL) * n) >> 32);
+  }
+
+  inline float fraction(unsigned long long x) {
+    return (x >> 40) * (1.0f/16777216);
+  }
+
+}
+
+#endif // _RNG_H
@@ -0,0 +1,577 @@
+//
+// snap.cc
+//
+// This implements the snapshot files of word counts described in
+// "snap.hh": writing one from a `freq::dict`, mapping one back in to
+// answer queries, and merging several into one.
+//
+// The functions it defines include
+//    * `bool snap::save(freq::dict*,const char*)`: write a dictionary's counts to a file
+//    * `snap::file* snap::open(const char*)`: map a snapshot file
+//    * `bool snap::verify(snap::file*)`: check a snapshot's checksums
+//    * `unsigned long long snap::numWords(snap::file*)`: get the number of words
+//    * `unsigned long long snap::totalCount(snap::file*)`: get the total word count
+//    * `unsigned long long snap::getCount(snap::file*,std::string_view)`: get the count for a word
+//    * `std::string snap::word(snap::file*,long)`, `unsigned long long snap::count(snap::file*,long)`: get a record
+//    * `void snap::addTo(snap::file*,freq::dict*)`: add a snapshot's counts to a dictionary
+//    * `bool snap::merge(const char**,int,const char*)`: sum several snapshots into one
+//    * `void snap::close(snap::file*)`: give back the snapshot's mapping
+//
+// Both `save` and `merge` write the string pool first, in sorted
+// order, then the records and the index after it. That way `merge`
+// can send out each word's characters as soon as it has summed its
+// counts, keeping only the fixed-size records in memory. The header
+// goes in last, once the checksums are known.
+//
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snap.hh"
+#include "freq.hh"
+#include "hash.hh"
+
+using hashing::hash64;
+using hashing::powerOfTwoAtLeast;
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// WRITING SNAPSHOTS
+//
+namespace snap {
+
+  // The size of the buffer that output is collected in before it's
+  // written.
+  const long WRITE_BUFFER = 1 << 20;
+
+  // The largest string pool a snapshot can have, since records locate
+  // their words with 32-bit offsets.
+  const unsigned long long MAX_POOL = 0xFFFFFFFFULL;
+
+  // writer
+  //
+  // A file being written through a buffer.
+  //
+  struct writer {
+    int fd;                  // The file being written.
+    std::string temporary;   // Its name, until it is complete.
+    std::string filename;    // The name it then takes.
+    char* buffer;            // Output not yet written.
+    long used;               // How much of `buffer` is filled.
+    unsigned long long at;   // How many bytes have been put so far.
+    bool failed;             // Whether any write has failed.
+  };
+
+  // flush(out):
+  //
+  // Writes out everything in the buffer of `out`.
+  //
+  void flush(writer& out) {
+    long done = 0;
+    while (done < out.used && !out.failed) {
+      long n = ::write(out.fd,out.buffer+done,out.used-done);
+      if (n <= 0) {
+	out.failed = true;
+      } else {
+	done += n;
+      }
+    }
+    out.used = 0;
+  }
+
+  // put(out,data,size):
+  //
+  // Writes the `size` bytes at `data` to `out`.
+  //
+  void put(writer& out, const void* data, long size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+      if (out.used == WRITE_BUFFER) {
+	flush(out);
+      }
+      long n = WRITE_BUFFER-out.used < size ? WRITE_BUFFER-out.used : size;
+      std::memcpy(out.buffer+out.used,bytes,n);
+      out.used += n;
+      out.at += n;
+      bytes += n;
+      size -= n;
+    }
+  }
+
+  // padTo8(out):
+  //
+  // Writes zeros to `out` until its length is a multiple of 8.
+  //
+  void padTo8(writer& out) {
+    const char zeros[8] = {0};
+    put(out,zeros,(8 - out.at % 8) % 8);
+  }
+
+  // startWriting(filename,out):
+  //
+  // Creates a temporary file beside `filename` for `out`, leaving room
+  // for its header. It only replaces `filename` once `finishWriting`
+  // has written all of it, so a snapshot can be merged into one of its
+  // own inputs, and a failed write leaves the old file as it was.
+  // Returns false if it can't be created.
+  //
+  bool startWriting(const char* filename, writer& out) {
+    out.filename = filename;
+    out.temporary = out.filename+".XXXXXX";
+    out.fd = mkstemp(&out.temporary[0]);
+    if (out.fd < 0) {
+      return false;
+    }
+    if (fchmod(out.fd,0644) != 0) {
+      ::close(out.fd);
+      unlink(out.temporary.c_str());
+      return false;
+    }
+    out.buffer = new char[WRITE_BUFFER];
+    out.used = 0;
+    out.at = 0;
+    out.failed = false;
+    header blank;
+    std::memset(&blank,0,sizeof(header));
+    put(out,&blank,sizeof(header));
+    return true;
+  }
+
+  // writeTable(out,head,records):
+  //
+  // Writes the `head->numWords` records that follow the pool, and a
+  // hash index of them, noting where each goes in `head`.
+  //
+  void writeTable(writer& out, header& head, const record* records) {
+    padTo8(out);
+    head.recordsAt = out.at;
+    put(out,records,head.numWords*sizeof(record));
+
+    head.indexAt = out.at;
+    head.indexSize = powerOfTwoAtLeast(2*head.numWords < 1 ? 1 : 2*head.numWords);
+    unsigned int* index = new unsigned int[head.indexSize]();
+    unsigned long long mask = head.indexSize-1;
+    for (unsigned long long r=0; r<head.numWords; r++) {
+      unsigned long long slot = records[r].hash & mask;
+      while (index[slot] != 0) {
+	slot = (slot+1) & mask;
+      }
+      index[slot] = r+1;
+    }
+    put(out,index,head.indexSize*sizeof(unsigned int));
+    delete [] index;
+  }
+
+  // finishWriting(out,head):
+  //
+  // Writes the rest of `out`, then computes the checksums of what was
+  // written and fills in the header at its start. Then renames it to
+  // the name it was started with. Returns false, removing it, if any
+  // of it couldn't be written.
+  //
+  bool finishWriting(writer& out, header& head) {
+    flush(out);
+    delete [] out.buffer;
+    bool ok = !out.failed;
+    if (ok) {
+      void* written = mmap(nullptr,out.at,PROT_READ,MAP_SHARED,out.fd,0);
+      if (written == MAP_FAILED) {
+	ok = false;
+      } else {
+	const char* base = static_cast<const char*>(written);
+	std::memcpy(head.magic,MAGIC,sizeof(MAGIC));
+	head.version = VERSION;
+	head.headerSize = sizeof(header);
+	head.poolChecksum = hash64(base+head.poolAt,head.poolSize);
+	head.tableChecksum = hash64(base+head.recordsAt,out.at-head.recordsAt);
+	head.headerChecksum = hash64(reinterpret_cast<const char*>(&head),
+				     offsetof(header,headerChecksum));
+	munmap(written,out.at);
+	ok = pwrite(out.fd,&head,sizeof(header),0) == (long)sizeof(header);
+      }
+    }
+    ok = ::close(out.fd) == 0 && ok;
+    ok = ok && std::rename(out.temporary.c_str(),out.filename.c_str()) == 0;
+    if (!ok) {
+      unlink(out.temporary.c_str());
+    }
+    return ok;
+  }
+
+  // alphabetically(entries,order,n):
+  //
+  // Sorts the `n` positions in `order` so that the words of `entries`
+  // they point to come in alphabetical order. A bottom-up merge sort.
+  //
+  void alphabetically(const freq::entry* entries, int* order, int n) {
+    int* other = new int[n];
+    for (int width=1; width<n; width*=2) {
+      for (int lo=0; lo<n; lo+=2*width) {
+	int mid = lo+width < n ? lo+width : n;
+	int hi = lo+2*width < n ? lo+2*width : n;
+	int a = lo, b = mid, to = lo;
+	while (a < mid && b < hi) {
+	  if (entries[order[b]].word < entries[order[a]].word) {
+	    other[to++] = order[b++];
+	  } else {
+	    other[to++] = order[a++];
+	  }
+	}
+	while (a < mid) {
+	  other[to++] = order[a++];
+	}
+	while (b < hi) {
+	  other[to++] = order[b++];
+	}
+      }
+      std::memcpy(order,other,n*sizeof(int));
+    }
+    delete [] other;
+  }
+
+  // save(D,filename):
+  //
+  // Writes all the word counts of `D` into a new snapshot `filename`.
+  //
+  bool save(freq::dict* D, const char* filename) {
+    writer out;
+    if (!startWriting(filename,out)) {
+      return false;
+    }
+    header head;
+    std::memset(&head,0,sizeof(header));
+    head.numWords = freq::numKeys(D);
+    head.totalCount = freq::totalCount(D);
+
+    freq::entry* entries = freq::snapshot(D);
+    int* order = new int[head.numWords];
+    for (unsigned long long i=0; i<head.numWords; i++) {
+      order[i] = i;
+    }
+    alphabetically(entries,order,head.numWords);
+
+    record* records = new record[head.numWords];
+    head.poolAt = out.at;
+    for (unsigned long long i=0; i<head.numWords; i++) {
+      const freq::entry& e = entries[order[i]];
+      records[i].count = e.count;
+      records[i].hash = hash64(e.word);
+      records[i].offset = out.at-head.poolAt;
+      records[i].length = e.word.size();
+      put(out,e.word.data(),e.word.size());
+    }
+    head.poolSize = out.at-head.poolAt;
+    out.failed = out.failed || head.poolSize > MAX_POOL;
+    writeTable(out,head,records);
+
+    delete [] records;
+    delete [] order;
+    delete [] entries;
+    return finishWriting(out,head);
+  }
+
+} // end namespace snap
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// READING SNAPSHOTS
+//
+namespace snap {
+
+  // open(filename):
+  //
+  // Maps the snapshot `filename` and checks that its header is sound
+  // and that every part it locates lies within the file. The data
+  // itself is only checked by `verify`.
+  //
+  file* open(const char* filename) {
+    int fd = ::open(filename,O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd,&info) != 0 || info.st_size < (long)sizeof(header)) {
+      ::close(fd);
+      return nullptr;
+    }
+    void* mapping = mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      return nullptr;
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    const header* head = reinterpret_cast<const header*>(base);
+    unsigned long long size = info.st_size;
+    bool ok = std::memcmp(head->magic,MAGIC,sizeof(MAGIC)) == 0
+      && head->version == VERSION
+      && head->headerSize == sizeof(header)
+      && head->headerChecksum == hash64(base,offsetof(header,headerChecksum))
+      && head->poolAt <= size && head->poolSize <= size-head->poolAt
+      && head->recordsAt % 8 == 0 && head->recordsAt <= size
+      && head->numWords <= (size-head->recordsAt)/sizeof(record)
+      && head->indexAt <= size
+      && head->indexSize <= (size-head->indexAt)/sizeof(unsigned int)
+      && head->indexSize > head->numWords
+      && (head->indexSize & (head->indexSize-1)) == 0;
+    if (!ok) {
+      munmap(mapping,info.st_size);
+      return nullptr;
+    }
+
+    file* F = new file;
+    F->head    = head;
+    F->records = reinterpret_cast<const record*>(base+head->recordsAt);
+    F->index   = reinterpret_cast<const unsigned int*>(base+head->indexAt);
+    F->pool    = base+head->poolAt;
+    F->mapping = mapping;
+    F->size    = info.st_size;
+    return F;
+  }
+
+  // verify(F):
+  //
+  // Checks the string pool, records and index of `F` against the
+  // checksums in its header, and that every record's word lies within
+  // the pool.
+  //
+  bool verify(file* F) {
+    const header* head = F->head;
+    const char* base = static_cast<const char*>(F->mapping);
+    if (hash64(F->pool,head->poolSize) != head->poolChecksum
+	|| hash64(base+head->recordsAt,F->size-head->recordsAt) != head->tableChecksum) {
+      return false;
+    }
+    for (unsigned long long r=0; r<head->numWords; r++) {
+      const record& rec = F->records[r];
+      if (rec.offset > head->poolSize || rec.length > head->poolSize-rec.offset) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  // numWords(F):
+  //
+  // Gives back the number of distinct words saved in `F`.
+  //
+  unsigned long long numWords(file* F) {
+    return F->head->numWords;
+  }
+
+  // totalCount(F):
+  //
+  // Gives back the total of the counts saved in `F`.
+  //
+  unsigned long long totalCount(file* F) {
+    return F->head->totalCount;
+  }
+
+  // getCount(F,w):
+  //
+  // Gets the count saved for the word `w` in `F`, looking it up by its
+  // hash in the index.
+  //
+  unsigned long long getCount(file* F, std::string_view w) {
+    unsigned long long h = hash64(w.data(),w.size());
+    unsigned long long mask = F->head->indexSize-1;
+    for (unsigned long long slot = h & mask; F->index[slot] != 0; slot = (slot+1) & mask) {
+      const record& r = F->records[F->index[slot]-1];
+      if (r.hash == h && r.length == w.size()
+	  && std::memcmp(F->pool+r.offset,w.data(),r.length) == 0) {
+	return r.count;
+      }
+    }
+    return 0;
+  }
+
+  // word(F,i):
+  //
+  // Returns the `i`th word of `F`, in alphabetical order.
+  //
+  std::string word(file* F, long i) {
+    return std::string(F->pool+F->records[i].offset,F->records[i].length);
+  }
+
+  // count(F,i):
+  //
+  // Returns the count of the `i`th word of `F`.
+  //
+  unsigned long long count(file* F, long i) {
+    return F->records[i].count;
+  }
+
+  // addTo(F,D):
+  //
+  // Adds the count of every word of `F` into `D`, reading each word
+  // where it sits in the pool.
+  //
+  void addTo(file* F, freq::dict* D) {
+    for (unsigned long long r=0; r<F->head->numWords; r++) {
+      const record& rec = F->records[r];
+      freq::increment(D,std::string_view(F->pool+rec.offset,rec.length),rec.count);
+    }
+  }
+
+  // close(F):
+  //
+  // Unmaps the snapshot `F` and deletes it.
+  //
+  void close(file* F) {
+    munmap(F->mapping,F->size);
+    delete F;
+  }
+
+} // end namespace snap
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// MERGING SNAPSHOTS
+//
+// Every input is read front to back at once. A min-heap holds each
+// unfinished input, ordered by the word it is up to, so the inputs
+// at its top are the ones holding the next word of the output.
+//
+namespace snap {
+
+  // before(F,i,G,j):
+  //
+  // Whether record `i` of `F` has a word alphabetically before that of
+  // record `j` of `G`. Compares bytes, as `std::string` does.
+  //
+  bool before(file* F, unsigned long long i, file* G, unsigned long long j) {
+    const record& a = F->records[i];
+    const record& b = G->records[j];
+    unsigned int shorter = a.length < b.length ? a.length : b.length;
+    int c = std::memcmp(F->pool+a.offset,G->pool+b.offset,shorter);
+    return c < 0 || (c == 0 && a.length < b.length);
+  }
+
+  // sameWord(F,i,G,j):
+  //
+  // Whether record `i` of `F` and record `j` of `G` are the same word.
+  //
+  bool sameWord(file* F, unsigned long long i, file* G, unsigned long long j) {
+    const record& a = F->records[i];
+    const record& b = G->records[j];
+    return a.hash == b.hash && a.length == b.length
+      && std::memcmp(F->pool+a.offset,G->pool+b.offset,a.length) == 0;
+  }
+
+  // siftDown(heap,size,files,at,i):
+  //
+  // Restores the heap of input numbers below position `i`, where input
+  // `f` is ordered by the word of its record `at[f]`.
+  //
+  void siftDown(int* heap, int size, file** files, unsigned long long* at, int i) {
+    while (true) {
+      int least = i;
+      for (int child=2*i+1; child<=2*i+2 && child<size; child++) {
+	if (before(files[heap[child]],at[heap[child]],files[heap[least]],at[heap[least]])) {
+	  least = child;
+	}
+      }
+      if (least == i) {
+	return;
+      }
+      int swap = heap[i];
+      heap[i] = heap[least];
+      heap[least] = swap;
+      i = least;
+    }
+  }
+
+  // merge(inputs,numInputs,output):
+  //
+  // Writes a snapshot `output` holding every word of the snapshots
+  // named by `inputs`, each with the sum of its counts in them. Every
+  // input is verified first, since merging trusts its records.
+  //
+  bool merge(const char** inputs, int numInputs, const char* output) {
+    file** files = new file*[numInputs];
+    bool ok = true;
+    for (int f=0; f<numInputs; f++) {
+      files[f] = ok ? open(inputs[f]) : nullptr;
+      ok = ok && files[f] != nullptr && verify(files[f]);
+    }
+    writer out;
+    if (!ok || !startWriting(output,out)) {
+      for (int f=0; f<numInputs; f++) {
+	if (files[f] != nullptr) {
+	  close(files[f]);
+	}
+      }
+      delete [] files;
+      return false;
+    }
+
+    header head;
+    std::memset(&head,0,sizeof(header));
+    head.poolAt = out.at;
+    unsigned long long* at = new unsigned long long[numInputs]();
+    int* heap = new int[numInputs];
+    int size = 0;
+    for (int f=0; f<numInputs; f++) {
+      if (files[f]->head->numWords > 0) {
+	heap[size++] = f;
+      }
+    }
+    for (int i=size/2-1; i>=0; i--) {
+      siftDown(heap,size,files,at,i);
+    }
+
+    long capacity = 1024;
+    record* records = new record[capacity];
+    while (size > 0) {
+      //the first input at the top supplies the word and its hash
+      int f = heap[0];
+      file* F = files[f];
+      unsigned long long i = at[f];
+      record merged = F->records[i];
+      merged.count = 0;
+      merged.offset = out.at-head.poolAt;
+      put(out,F->pool+F->records[i].offset,F->records[i].length);
+
+      //take the word from every input that has it
+      while (size > 0 && sameWord(F,i,files[heap[0]],at[heap[0]])) {
+	int g = heap[0];
+	merged.count += files[g]->records[at[g]].count;
+	at[g]++;
+	if (at[g] == files[g]->head->numWords) {
+	  heap[0] = heap[--size];
+	}
+	siftDown(heap,size,files,at,0);
+      }
+
+      if (head.numWords == (unsigned long long)capacity) {
+	record* bigger = new record[2*capacity];
+	std::memcpy(bigger,records,capacity*sizeof(record));
+	delete [] records;
+	records = bigger;
+	capacity *= 2;
+      }
+      records[head.numWords++] = merged;
+      head.totalCount += merged.count;
+    }
+    head.poolSize = out.at-head.poolAt;
+    out.failed = out.failed || head.poolSize > MAX_POOL;
+    writeTable(out,head,records);
+
+    delete [] records;
+    delete [] heap;
+    delete [] at;
+    for (int f=0; f<numInputs; f++) {
+      close(files[f]);
+    }
+    delete [] files;
+    return finishWriting(out,head);
+  }
+
+} // end namespace snap
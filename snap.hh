@@ -0,0 +1,138 @@
+#ifndef _SNAP_H
+#define _SNAP_H
+
+// snap.hh
+//
+// This defines a file format for saving the word counts of a
+// `freq::dict`, and the type `snap::file*` for reading one back.
+//
+// A snapshot file is laid out so that it can be mapped into memory
+// and used as it sits, with nothing to parse:
+//
+//   * a `header`, holding a magic string, the format version, where
+//     each part below starts, and checksums;
+//   * the string pool: the characters of every word, back to back;
+//   * the `record` of each word, sorted by word: its count, its
+//     hash, and where its characters sit in the pool;
+//   * a hash index, an open-addressing table of record numbers keyed
+//     by the same `hashing::hash64` the dictionaries use.
+//
+// The index answers `getCount` in a probe or two. The sorted records
+// let several snapshots be merged by streaming through all of them at
+// once, in the way of a merge sort, never building a dictionary.
+// All numbers are stored little-endian, as this machine has them.
+//
+
+#include <string>
+#include <string_view>
+#include "freq.hh"
+
+namespace snap {
+
+  // The magic string that starts every snapshot, and the version of
+  // the layout described here.
+  const char MAGIC[8] = {'W','O','R','D','S','N','A','P'};
+  const unsigned int VERSION = 1;
+
+  // header
+  //
+  // The first bytes of a snapshot file.
+  //
+  struct header {
+
+    char magic[8];                   // Always MAGIC.
+
+    unsigned int version;            // The VERSION that wrote the file.
+
+    unsigned int headerSize;         // sizeof(header) when it was written.
+
+    unsigned long long numWords;     // The number of distinct words.
+
+    unsigned long long totalCount;   // The sum of all their counts.
+
+    unsigned long long poolAt;       // Where the string pool starts,
+    unsigned long long poolSize;     // and how many bytes it spans.
+
+    unsigned long long recordsAt;    // Where the `numWords` records start.
+
+    unsigned long long indexAt;      // Where the hash index starts,
+    unsigned long long indexSize;    // and how many slots it has; a
+				     // power of two.
+
+    unsigned long long poolChecksum;  // The hash64 of the string pool.
+
+    unsigned long long tableChecksum; // The hash64 of the records and
+				      // index, which sit back to back.
+
+    unsigned long long headerChecksum; // The hash64 of the header up
+				       // to this field.
+  };
+
+  // record
+  //
+  // The saved count of one word.
+  //
+  struct record {
+
+    unsigned long long count; // How many times the word was counted.
+
+    unsigned long long hash;  // The hash64 of the word.
+
+    unsigned int offset;      // Where its characters start in the pool.
+
+    unsigned int length;      // How many characters it has.
+  };
+
+  // file
+  //
+  // A snapshot opened for reading.
+  //
+  struct file {
+
+    const header* head;          // The header, at the start of the mapping.
+
+    const record* records;       // The records, sorted by word.
+
+    const unsigned int* index;   // The hash index. Each slot holds one more
+				 // than a record's number, or 0 if empty.
+
+    const char* pool;            // The characters of the words.
+
+    void* mapping;               // The whole file, mapped into memory.
+
+    long size;                   // The length of the mapping.
+  };
+
+  //
+  // The public interface to snapshot files.
+  //
+  bool save(freq::dict* D, const char* filename);  // Writes the counts of `D` as a snapshot to `filename`.
+                                                   // Returns false if it can't be written.
+
+  file* open(const char* filename);                // Maps the snapshot `filename`. Returns nullptr if it
+                                                   // can't be opened or isn't a valid snapshot.
+
+  bool verify(file* F);                            // Checks the pool, records and index of `F` against
+                                                   // their checksums.
+
+  unsigned long long numWords(file* F);            // Returns the number of distinct words in `F`.
+  unsigned long long totalCount(file* F);          // Returns the sum of the counts in `F`.
+
+  unsigned long long getCount(file* F,             // Gets the count of word `k` in `F`.
+			      std::string_view k);
+
+  std::string word(file* F, long i);               // Returns the `i`th word of `F`, in sorted order,
+  unsigned long long count(file* F, long i);       // and its count.
+
+  void addTo(file* F, freq::dict* D);              // Adds all the counts of `F` into `D`.
+
+  bool merge(const char** inputs, int numInputs,   // Writes the sums of the counts of the snapshots named
+	     const char* output);                  // by `inputs` as a new snapshot `output`. Returns
+                                                   // false if any can't be read or verified, or it can't
+                                                   // be written.
+
+  void close(file* F);                             // Unmaps `F` and deletes it.
+
+}
+
+#endif // _SNAP_H
@@ -4,9 +4,11 @@
 // Count and report statistics about the number of occurrences of
 // words within some entered text.
 //
-// Compile with: g++ -g --std=c++11 -o stats stats.cc freq.cc
+// Compile with: g++ -g --std=c++17 -pthread -o stats stats.cc freq.cc approx.cc window.cc snap.cc token.cc meter.cc mem.cc arena.cc
 //
-// Usage: ./stats
+// Usage: ./stats [-j N | --approx KB | --window N [--every M]] [--save counts.snap]
+//                [--stats] [--stats-json stats.json] [--mem-report] [textfile.txt]
+//        ./stats --load counts.snap [--load more.snap ...] [--save merged.snap]
 //
 // The program will process a series of lines of text, looking for
 // contiguous runs of alphabetic characters treating them each as a
@@ -18,103 +20,253 @@
 //
 // Alternative usage: ./stats < textfile.txt
 //
-// The above will instead process the text of the file in
-// 'textfile.txt'.
+// Both of the above will instead process the text of the file in
+// 'textfile.txt'. Naming the file lets it be mapped into memory
+// rather than read through STDIN.
+//
+// With `-j N` the counting is split among N threads. The text (the
+// mapped file, or each large block of STDIN) is cut into N pieces
+// between words, each thread counts its pieces into a dictionary of
+// its own, and those are merged at the end. The report is the same
+// as with one thread.
+//
+// With `--approx KB` the counts are instead kept approximately in
+// about KB kibibytes, however long the text is, as defined in
+// "approx.hh". Each of the top words is reported with the most its
+// count might be over, written like `the:7032+5`. The number of
+// distinct words isn't known in this mode, so it isn't reported.
+//
+// With `--window N` only the last N words count, as defined in
+// "window.hh". Every M words (N by default, or as given with
+// `--every M`) it reports the top 10 words of the window so far,
+// while the text keeps coming, and once more at its end.
+//
+// With `--save FILE` the word counts are also written to FILE as a
+// snapshot, as defined in "snap.hh". With one or more `--load FILE`
+// no text is read: the report covers the counts of those snapshots
+// summed together, and `--save` then writes that sum, merging the
+// snapshots as they sit on disk.
+//
+// With `--stats`, once the report is done, it also reports to STDERR
+// how long each phase took, and the shape of the dictionary's hash
+// table, as defined in "meter.hh": how full its buckets are and how
+// many comparisons its words take to find. With `--stats-json FILE`
+// the same goes to FILE as JSON. The phases are reading the text,
+// tokenizing, counting and sorting the top words. For a named file,
+// tokenizing is timed by a pass of the tokenizer alone before the
+// counting, and the counting is timed less that. Lookups and rehashes
+// are also reported when built with `make METER=1`.
+//
+// With `--mem-report` it also reports to STDERR how many bytes each
+// part of the dictionary holds at the end and held at most, as kept
+// by "mem.hh", the bytes per distinct word, and the process's peak
+// resident memory.
 //
 
 //
 // This implementation relies on a word count dictionary implemented
-// as a bucket hash table as defined in "freq.hh".
+// as a bucket hash table as defined in "freq.hh", using its FLAT
+// open-addressing engine.
 //
 
 #include <iostream>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
 #include "freq.hh"
+#include "approx.hh"
+#include "window.hh"
+#include "snap.hh"
+#include "token.hh"
+#include "meter.hh"
+#include "mem.hh"
 
+// The size of the blocks STDIN is read in when counting in parallel.
+const long PARALLEL_BLOCK = 64L << 20;
 
-
-// next_word_in(line):
+// countSerial(d,text):
 //
-// Process the characters of the std::string object 'line', seeking
-// the next contiguous sequence of letters within that string.
+// Counts every word of `text` into `d`.
 //
-// Once it has processed that next word, it modifies 'line' to exclude
-// the prefix of processed characters from it, and returns that next
-// word as a string. The word will be a string of lowercase alphabetic
-// characters.
+void countSerial(freq::dict* d, token::stream* text) {
+  token::word w;
+  while (token::next(text,w)) {
+    freq::increment(d,token::toView(w));
+  }
+}
+
+// countPiece(d,piece,size):
 //
-// It returns the empty string once the line has been fully processed.
+// Counts the words in the `size` bytes at `piece` into `d`.
 //
-std::string next_word_in(std::string &line) {
-  std::string word = "";
-  int i;
-  for (i=0; i < line.size(); i++) {
-    char c = line[i];
-
-    // Make letters lowercase.
-    if ('A' <= c && c <= 'Z') {
-      c = c+32;
-    }
-
-    // Include letters or contraction marks as part of a word.
-    if (('a' <= c && c <= 'z') || c == '\'') {
-      word += c;
+void countPiece(freq::dict* d, char* piece, long size) {
+  token::stream* S = token::view(piece,size);
+  countSerial(d,S);
+  token::close(S);
+}
 
-    // If we hit a "stopper", emit it as a word.   
-    } else if (c == '.' || c == '!' || c == '?') {
-      if (word.size() > 0) {
-	line.erase(0,i);
-	return word;
-      } else {
-	word += c;
-	line.erase(0,1);
-	return word;
-      }
+// countParallel(text,numThreads):
+//
+// Returns a new dictionary of the word counts of `text`, counted by
+// `numThreads` threads. Each block of the text is cut into one piece
+// per thread at word boundaries; every thread keeps its own dictionary
+// across blocks, so they never share anything until the final merge.
+//
+freq::dict* countParallel(token::stream* text, int numThreads) {
+  freq::dict** shards = new freq::dict*[numThreads];
+  for (int t=0; t<numThreads; t++) {
+    shards[t] = freq::build(9,2,freq::FLAT);
+  }
+  std::thread* workers = new std::thread[numThreads];
 
-    // If we hit any non-letter, emit a word.
-    } else {
-      if (word.size() > 0) {
-	line.erase(0,i);
-	return word;
+  char* block;
+  long size;
+  while (token::nextBlock(text,PARALLEL_BLOCK,block,size)) {
+    long start = 0;
+    for (int t=0; t<numThreads; t++) {
+      long end = size;
+      if (t < numThreads-1) {
+	end = token::boundaryAfter(block,size,size/numThreads*(t+1));
+	end = end < start ? start : end;
       }
+      workers[t] = std::thread(countPiece,shards[t],block+start,end-start);
+      start = end;
+    }
+    for (int t=0; t<numThreads; t++) {
+      workers[t].join();
     }
   }
-  // End of the line, emit that ending word.
-  line.erase(0,i);
-  return word;
+
+  //fold the other shards into the first
+  for (int t=1; t<numThreads; t++) {
+    freq::merge(shards[0],shards[t]);
+    meter::add(shards[0]->counted,shards[t]->counted);
+    freq::destroy(shards[t]);
+  }
+  freq::dict* d = shards[0];
+  delete [] workers;
+  delete [] shards;
+  return d;
 }
-  
-// main()
+
+// reportApprox(text):
 //
-// Processes STDIN as a sequence of words. Using a htable::htable, tracks
-// the number of occurrences of words in that entered text.
+// Counts the words of `text` into an `approx::dict` of `budget` bytes
+// and reports the most frequent of them, with their error bounds.
 //
-// It reports the word counts to STDOUT.
-//
-int main(int argc, char **argv) {
+void reportApprox(token::stream* text, long budget) {
+  approx::dict* d = approx::build(budget);
+  token::word w;
+  while (token::next(text,w)) {
+    approx::increment(d,token::toView(w));
+  }
+  std::cout << "DONE.\n";
+  std::cout << "HERE are the approximate word statistics of that text:\n";
 
-  //
-  // Build a dictionary of word:count entries based on the text entered.
-  freq::dict *d = freq::build(9,2);
-  std::cout << "READING text from STDIN. Hit ctrl-d when done entering text.\n";
+  std::cout << std::endl;
+  std::cout << "That text was " << approx::totalCount(d) << " words in length." << std::endl;
+  std::cout << std::endl;
+  std::cout << "Its most frequent words were tracked with " << d->numCounters << " counters," << std::endl;
+  std::cout << "so any word making up more than 1/" << d->numCounters << " of it is among them." << std::endl;
 
-  // Read until the end of text entry.
-  while (std::cin) {
+  int top = approx::numTracked(d) < 100 ? approx::numTracked(d) : 100;
+  approx::counter* words = approx::topK(d,top);
+  std::cout << std::endl;
+  std::cout << "The top " << top << " ranked words (with their frequencies, and how much each might be over) are:" << std::endl;
+  int lineLimit = 60;
+  int line = 0;
+  std::string next;
+  for (int i=0; i<top; i++) {
+    next = std::to_string((i+1)) + ". " + words[i].word + ":" + std::to_string(words[i].count)
+      + "+" + std::to_string(words[i].error);
+    if (line+2 + (int)next.length() >= lineLimit) {
+      std::cout << std::endl;
+      line = 0;
+    }
+    line += next.length();
+    std::cout << next;
+    if (i != top-1) {
+      line += 2;
+      std::cout << ", ";
+    }
+  }
+  std::cout << std::endl;
 
-    // Get the next line of entered text.
-    std::string line;
-    std::getline(std::cin,line);
+  delete [] words;
+  approx::destroy(d);
+}
+
+// The number of words in each report of `--window`.
+const int WINDOW_TOP = 10;
 
-    // Read each of the words in that line of text.
-    for (std::string w = next_word_in(line); w != ""; w = next_word_in(line)) {
-      freq::increment(d,w);
+// printWindow(W,position):
+//
+// Prints which words of the text the window `W` holds, given that the
+// last one is at `position`, and its top words.
+//
+void printWindow(window::dict* W, int position) {
+  int top = window::numKeys(W) < WINDOW_TOP ? window::numKeys(W) : WINDOW_TOP;
+  freq::entry* words = window::topK(W);
+  std::cout << "Words " << position-window::numWords(W)+1 << " to " << position << ":";
+  for (int i=0; i<top; i++) {
+    std::cout << (i == 0 ? " " : ", ") << words[i].word << ":" << words[i].count;
+  }
+  std::cout << std::endl;
+  delete [] words;
+}
+
+// reportWindow(text,size,every):
+//
+// Counts the words of `text` in a window of the last `size` of them.
+// Reports the top words of the window after every `every` words, and
+// after the last one.
+//
+void reportWindow(token::stream* text, int size, int every) {
+  window::dict* W = window::build(size,WINDOW_TOP);
+  token::word w;
+  int position = 0;
+  while (token::next(text,w)) {
+    window::push(W,token::toView(w));
+    position++;
+    if (position % every == 0) {
+      printWindow(W,position);
     }
   }
   std::cout << "DONE.\n";
-  std::cout << "HERE are the word statistics of that text:\n";
+  if (position % every != 0) {
+    printWindow(W,position);
+  }
+  window::destroy(W);
+}
+
+// timeTokenizing(text):
+//
+// Returns how long the tokenizer alone takes to scan the mapped text
+// of `text`, in nanoseconds, leaving `text` where it was.
+//
+long long timeTokenizing(token::stream* text) {
+  long long started = meter::now();
+  token::stream* S = token::view(text->buffer,text->size);
+  token::word w;
+  while (token::next(S,w)) {
+  }
+  token::close(S);
+  return meter::now() - started;
+}
+
+// report(d,R):
+//
+// Reports the statistics of the word counts in `d` to STDOUT: the
+// number of words and distinct words, the top ranked words, and how
+// many appear only once. The time taken to rank the top words is
+// added to the readings `R`, unless it is nullptr.
+//
+void report(freq::dict* d, meter::readings* R) {
 
   //
   // Report some basic statistics.
-  int wordCount = freq::totalCount(d);
+  unsigned long long wordCount = freq::totalCount(d);
   int numWords  = freq::numKeys(d);
   std::cout << std::endl;
   std::cout << "That text was " << wordCount << " words in length." << std::endl;
@@ -122,8 +274,7 @@ int main(int argc, char **argv) {
   std::cout << "There are " << numWords << " distinct words used in that text." << std::endl;
 
   //
-  // Get the full word count analysis.
-  freq::entry* words = freq::dumpAndDestroy(d);
+  // Get the most frequent words. Only these need to be ranked.
   int top = 1;
   if (numWords > 10) {
     top = 10;
@@ -131,6 +282,14 @@ int main(int argc, char **argv) {
       top = 100;
     }
   }
+  if (top > numWords) {
+    top = numWords;
+  }
+  long long started = meter::now();
+  freq::entry* words = freq::topK(d,top);
+  if (R != nullptr) {
+    meter::phase(R,"sort",meter::now()-started);
+  }
   std::cout << std::endl;
   std::cout << "The top " << top << " ranked words (with their frequencies) are:" << std::endl;
   int lineLimit = 60;
@@ -142,7 +301,7 @@ int main(int argc, char **argv) {
     next = std::to_string((i+1)) + ". " + words[i].word + ":"+ std::to_string( words[i].count);
 
     // if our next entry won't fit on the line, go to a new one
-    if( line+2 + next.length() >= lineLimit){
+    if( line+2 + (int)next.length() >= lineLimit){
       std::cout << std::endl;
       line = 0;
     }
@@ -156,12 +315,245 @@ int main(int argc, char **argv) {
     }
   }
   
-  int count = 0;
-  while (count < numWords && words[count].count > 1) {
-    count++; 
-  }
   std::cout << std::endl;
-  std::cout << "Among its "<< numWords << " words, " << (numWords-count) << " of them appear exactly once." << std::endl;
+  std::cout << "Among its "<< numWords << " words, " << freq::numWithCount(d,1) << " of them appear exactly once." << std::endl;
+
+  delete [] words;
+}
+
+// loadSnapshots(names,numNames,saveTo):
+//
+// Returns a new dictionary of the summed counts of the snapshots
+// named by `names`. If `saveTo` isn't nullptr, the sum is first
+// written there by merging the snapshots, and read back from it.
+// Returns nullptr, after saying why, if any of that fails.
+//
+freq::dict* loadSnapshots(const char** names, int numNames, const char* saveTo) {
+  if (saveTo != nullptr) {
+    if (!snap::merge(names,numNames,saveTo)) {
+      std::cerr << "Could not merge those snapshots into " << saveTo << "." << std::endl;
+      return nullptr;
+    }
+    names = &saveTo;
+    numNames = 1;
+  }
+  freq::dict* d = freq::build(9,2,freq::FLAT);
+  for (int i=0; i<numNames; i++) {
+    snap::file* F = snap::open(names[i]);
+    if (F == nullptr || !snap::verify(F)) {
+      std::cerr << names[i] << " is not a readable snapshot." << std::endl;
+      if (F != nullptr) {
+	snap::close(F);
+      }
+      freq::destroy(d);
+      return nullptr;
+    }
+    snap::addTo(F,d);
+    snap::close(F);
+  }
+  return d;
+}
+
+// reportStats(d,R,jsonTo):
+//
+// Measures the table of `d` into the readings `R`, then writes them to
+// STDERR, and as JSON to the file `jsonTo` unless it is nullptr.
+// Deletes `R`. Returns false, after saying why, if the file can't be
+// written.
+//
+bool reportStats(freq::dict* d, meter::readings* R, const char* jsonTo) {
+  freq::measure(d,meter::addTable(R,"words"));
+  std::cerr << std::endl;
+  meter::print(R,std::cerr);
+  bool written = true;
+  if (jsonTo != nullptr) {
+    std::ofstream out(jsonTo);
+    meter::printJson(R,out);
+    written = out.good();
+    if (!written) {
+      std::cerr << "Could not write the readings to " << jsonTo << "." << std::endl;
+    }
+  }
+  meter::destroy(R);
+  return written;
 }
-    
 
+// main()
+//
+// Processes STDIN (or the named file) as a sequence of words. Using a
+// htable::htable, tracks the number of occurrences of words in that
+// entered text.
+//
+// It reports the word counts to STDOUT.
+//
+int main(int argc, char **argv) {
+
+  //
+  // Read the options, then open the text, either the named file or STDIN.
+  int numThreads = 1;
+  long budget = 0;
+  int windowSize = 0;
+  int every = 0;
+  const char* saveTo = nullptr;
+  bool showStats = false;
+  const char* statsTo = nullptr;
+  bool memReport = false;
+  const char** loads = new const char*[argc];
+  int numLoads = 0;
+  const char* filename = nullptr;
+  for (int i=1; i<argc; i++) {
+    if (std::strcmp(argv[i],"-j") == 0 && i+1 < argc) {
+      numThreads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i],"--approx") == 0 && i+1 < argc) {
+      budget = 1024L*std::atol(argv[++i]);
+      if (budget <= 0) {
+	std::cerr << "The memory budget given with --approx must be at least 1 KB." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--window") == 0 && i+1 < argc) {
+      windowSize = std::atoi(argv[++i]);
+      if (windowSize < 1) {
+	std::cerr << "The window given with --window must be at least 1 word." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--every") == 0 && i+1 < argc) {
+      every = std::atoi(argv[++i]);
+      if (every < 1) {
+	std::cerr << "The report interval given with --every must be at least 1 word." << std::endl;
+	return 1;
+      }
+    } else if (std::strcmp(argv[i],"--save") == 0 && i+1 < argc) {
+      saveTo = argv[++i];
+    } else if (std::strcmp(argv[i],"--load") == 0 && i+1 < argc) {
+      loads[numLoads++] = argv[++i];
+    } else if (std::strcmp(argv[i],"--stats") == 0) {
+      showStats = true;
+    } else if (std::strcmp(argv[i],"--stats-json") == 0 && i+1 < argc) {
+      showStats = true;
+      statsTo = argv[++i];
+    } else if (std::strcmp(argv[i],"--mem-report") == 0) {
+      memReport = true;
+    } else {
+      filename = argv[i];
+    }
+  }
+  if (numThreads < 1) {
+    std::cerr << "The number of threads given with -j must be at least 1." << std::endl;
+    return 1;
+  }
+  if ((budget > 0) + (windowSize > 0) + (numThreads > 1) > 1) {
+    std::cerr << "Only one of -j, --approx and --window can be used at a time." << std::endl;
+    return 1;
+  }
+  if (every > 0 && windowSize == 0) {
+    std::cerr << "A report interval can only be given with --every along with --window." << std::endl;
+    return 1;
+  }
+  if (saveTo != nullptr && (budget > 0 || windowSize > 0)) {
+    std::cerr << "Only exact counts can be saved with --save." << std::endl;
+    return 1;
+  }
+  if ((showStats || memReport) && (budget > 0 || windowSize > 0)) {
+    std::cerr << "Only exact counts are kept in the hash table that --stats and --mem-report report on." << std::endl;
+    return 1;
+  }
+  if (memReport) {
+    mem::track();
+  }
+  meter::readings* R = showStats ? meter::build() : nullptr;
+  long long started = meter::now();
+
+  //
+  // Snapshots stand in for the text.
+  freq::dict *d;
+  if (numLoads > 0) {
+    if (filename != nullptr || budget > 0 || windowSize > 0 || numThreads > 1) {
+      std::cerr << "With --load, no text or counting options can be given." << std::endl;
+      meter::destroy(R);
+      return 1;
+    }
+    std::cout << "READING counts from " << numLoads << " snapshot(s).\n";
+    d = loadSnapshots(loads,numLoads,saveTo);
+    delete [] loads;
+    if (d == nullptr) {
+      meter::destroy(R);
+      return 1;
+    }
+    if (R != nullptr) {
+      meter::phase(R,"read",meter::now()-started);
+    }
+    std::cout << "DONE.\n";
+    std::cout << "HERE are the word statistics of those counts:\n";
+    report(d,R);
+    bool written = R == nullptr || reportStats(d,R,statsTo);
+    if (memReport) {
+      std::cerr << std::endl;
+      mem::report(std::cerr,"distinct word",freq::numKeys(d));
+    }
+    freq::destroy(d);
+    return written ? 0 : 1;
+  }
+  delete [] loads;
+
+  token::stream* text = token::open(filename);
+  if (text == nullptr) {
+    std::cerr << "Could not open " << filename << "." << std::endl;
+    meter::destroy(R);
+    return 1;
+  }
+
+  //
+  // Build a dictionary of word:count entries based on the text entered.
+  if (filename != nullptr && std::strcmp(filename,"-") != 0) {
+    std::cout << "READING text from " << filename << ".\n";
+  } else {
+    std::cout << "READING text from STDIN. Hit ctrl-d when done entering text.\n";
+  }
+
+  long long tokenizing = 0;
+  if (R != nullptr) {
+    meter::phase(R,"read",meter::now()-started);
+    if (text->mapped && numThreads == 1) {
+      tokenizing = timeTokenizing(text);
+      meter::phase(R,"tokenize",tokenizing);
+    }
+  }
+
+  // Read each of the words until the end of text entry.
+  if (budget > 0) {
+    reportApprox(text,budget);
+    token::close(text);
+    return 0;
+  }
+  if (windowSize > 0) {
+    reportWindow(text,windowSize,every > 0 ? every : windowSize);
+    token::close(text);
+    return 0;
+  }
+  started = meter::now();
+  if (numThreads == 1) {
+    d = freq::build(9,2,freq::FLAT);
+    countSerial(d,text);
+  } else {
+    d = countParallel(text,numThreads);
+  }
+  token::close(text);
+  if (R != nullptr) {
+    long long counting = meter::now()-started-tokenizing;
+    meter::phase(R,"count",counting > 0 ? counting : 0);
+  }
+  bool saved = saveTo == nullptr || snap::save(d,saveTo);
+  if (!saved) {
+    std::cerr << "Could not save the counts to " << saveTo << "." << std::endl;
+  }
+  std::cout << "DONE.\n";
+  std::cout << "HERE are the word statistics of that text:\n";
+  report(d,R);
+  bool written = R == nullptr || reportStats(d,R,statsTo);
+  if (memReport) {
+    std::cerr << std::endl;
+    mem::report(std::cerr,"distinct word",freq::numKeys(d));
+  }
+  freq::destroy(d);
+  return written && saved ? 0 : 1;
+}
@@ -0,0 +1,555 @@
+//
+// token.cc
+//
+// This implements the word tokenizer `token::stream*` used by both
+// `stats` and `chats`. See "token.hh" for the rules on what counts as
+// a word.
+//
+// The functions it defines include
+//    * `token::stream* token::open(const char*)`: map a file or prepare to read STDIN
+//    * `token::stream* token::view(char*,long)`: scan text already in memory
+//    * `bool token::next(token::stream*,token::word&)`: scan the next word
+//    * `bool token::nextBlock(token::stream*,long,char*&,long&)`: get the next block of whole words
+//    * `long token::boundaryAfter(const char*,long,long)`: find a place to split a text
+//    * `void token::close(token::stream*)`: give back the stream's storage
+//    * `std::string token::toString(token::word)`: copy a word out of the stream
+//
+// and, internally, `void refill(token::stream*,long)` which reads the
+// next block of a non-mapped input.
+//
+// The boundary scanning itself comes in three kernels, each a pair of
+// functions `skip*` (find where the next word or stopper starts) and
+// `end*` (find where a word ends, lowercasing it on the way). The
+// SSE2 and AVX2 kernels classify a whole register of characters with
+// a few comparisons and hand back the first boundary as the lowest
+// set bit of a mask; the scalar kernel is the reference for both.
+//
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "token.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKEN_X86 1
+#endif
+
+namespace token {
+
+  // The size of the blocks read from inputs that can't be mapped.
+  const long BLOCK_SIZE = 1 << 20;
+
+  // isWordChar(c):
+  //
+  // Returns whether `c` is a letter or the contraction mark.
+  //
+  inline bool isWordChar(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '\'';
+  }
+
+  // isStopper(c):
+  //
+  // Returns whether `c` is one of the marks that end a sentence.
+  //
+  inline bool isStopper(char c) {
+    return c == '.' || c == '!' || c == '?';
+  }
+
+  // * * * * * * * * * * * * * * * * * * * * * * *
+  //
+  // SCANNING KERNELS
+  //
+
+  // skipScalar(buffer,i,end):
+  //
+  // Returns the offset of the first word character or stopper at or
+  // after `i`, or `end` when there is none.
+  //
+  long skipScalar(char* buffer, long i, long end) {
+    while (i < end && !isWordChar(buffer[i]) && !isStopper(buffer[i])) {
+      i++;
+    }
+    return i;
+  }
+
+  // endScalar(buffer,i,end):
+  //
+  // Returns the offset of the first non-word character at or after
+  // `i`, or `end` when there is none. Makes the letters before it
+  // lowercase.
+  //
+  long endScalar(char* buffer, long i, long end) {
+    while (i < end && isWordChar(buffer[i])) {
+      if ('A' <= buffer[i] && buffer[i] <= 'Z') {
+	buffer[i] += 32;
+      }
+      i++;
+    }
+    return i;
+  }
+
+#ifdef TOKEN_X86
+
+  // lowestBit(mask):
+  //
+  // Returns the index of the lowest set bit of a nonzero `mask`.
+  //
+  inline int lowestBit(unsigned mask) {
+    return __builtin_ctz(mask);
+  }
+
+  // classifySSE2(v,letters,words,stoppers):
+  //
+  // Classifies the 16 characters in `v`. Folding in the 0x20 bit maps
+  // capitals onto lowercase letters, and shifting 'a' down to -128
+  // turns the range test into a single signed comparison.
+  //
+  inline void classifySSE2(__m128i v, __m128i& letters, __m128i& words, __m128i& stoppers) {
+    __m128i folded = _mm_or_si128(v,_mm_set1_epi8(0x20));
+    __m128i shifted = _mm_add_epi8(folded,_mm_set1_epi8((char)(128-'a')));
+    letters = _mm_cmplt_epi8(shifted,_mm_set1_epi8((char)(-128+26)));
+    words = _mm_or_si128(letters,_mm_cmpeq_epi8(v,_mm_set1_epi8('\'')));
+    stoppers = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('.')),
+					 _mm_cmpeq_epi8(v,_mm_set1_epi8('!'))),
+			    _mm_cmpeq_epi8(v,_mm_set1_epi8('?')));
+  }
+
+  // skipSSE2(buffer,i,end):
+  //
+  // The SSE2 version of `skipScalar`.
+  //
+  long skipSSE2(char* buffer, long i, long end) {
+    __m128i letters, words, stoppers;
+    while (i+16 <= end) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer+i));
+      classifySSE2(v,letters,words,stoppers);
+      unsigned mask = _mm_movemask_epi8(_mm_or_si128(words,stoppers));
+      if (mask != 0) {
+	return i+lowestBit(mask);
+      }
+      i += 16;
+    }
+    return skipScalar(buffer,i,end);
+  }
+
+  // endSSE2(buffer,i,end):
+  //
+  // The SSE2 version of `endScalar`. Capitals are lowercased in the
+  // register, and it is only stored back when something changed, so
+  // mapped pages without capitals are never written.
+  //
+  long endSSE2(char* buffer, long i, long end) {
+    __m128i letters, words, stoppers;
+    while (i+16 <= end) {
+      __m128i* at = reinterpret_cast<__m128i*>(buffer+i);
+      __m128i v = _mm_loadu_si128(at);
+      classifySSE2(v,letters,words,stoppers);
+      __m128i lowered = _mm_or_si128(v,_mm_and_si128(letters,_mm_set1_epi8(0x20)));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(lowered,v)) != 0xFFFF) {
+	_mm_storeu_si128(at,lowered);
+      }
+      unsigned mask = ~_mm_movemask_epi8(words) & 0xFFFF;
+      if (mask != 0) {
+	return i+lowestBit(mask);
+      }
+      i += 16;
+    }
+    return endScalar(buffer,i,end);
+  }
+
+  // classifyAVX2(v,letters,words,stoppers):
+  //
+  // The 32-character version of `classifySSE2`.
+  //
+  __attribute__((target("avx2")))
+  inline void classifyAVX2(__m256i v, __m256i& letters, __m256i& words, __m256i& stoppers) {
+    __m256i folded = _mm256_or_si256(v,_mm256_set1_epi8(0x20));
+    __m256i shifted = _mm256_add_epi8(folded,_mm256_set1_epi8((char)(128-'a')));
+    letters = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128+26)),shifted);
+    words = _mm256_or_si256(letters,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\'')));
+    stoppers = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('.')),
+					       _mm256_cmpeq_epi8(v,_mm256_set1_epi8('!'))),
+			       _mm256_cmpeq_epi8(v,_mm256_set1_epi8('?')));
+  }
+
+  // skipAVX2(buffer,i,end):
+  //
+  // The AVX2 version of `skipScalar`.
+  //
+  __attribute__((target("avx2")))
+  long skipAVX2(char* buffer, long i, long end) {
+    __m256i letters, words, stoppers;
+    while (i+32 <= end) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer+i));
+      classifyAVX2(v,letters,words,stoppers);
+      unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(words,stoppers));
+      if (mask != 0) {
+	return i+lowestBit(mask);
+      }
+      i += 32;
+    }
+    return skipSSE2(buffer,i,end);
+  }
+
+  // endAVX2(buffer,i,end):
+  //
+  // The AVX2 version of `endScalar`.
+  //
+  __attribute__((target("avx2")))
+  long endAVX2(char* buffer, long i, long end) {
+    __m256i letters, words, stoppers;
+    while (i+32 <= end) {
+      __m256i* at = reinterpret_cast<__m256i*>(buffer+i);
+      __m256i v = _mm256_loadu_si256(at);
+      classifyAVX2(v,letters,words,stoppers);
+      __m256i lowered = _mm256_or_si256(v,_mm256_and_si256(letters,_mm256_set1_epi8(0x20)));
+      if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lowered,v)) != 0xFFFFFFFFu) {
+	_mm256_storeu_si256(at,lowered);
+      }
+      unsigned mask = ~(unsigned)_mm256_movemask_epi8(words);
+      if (mask != 0) {
+	return i+lowestBit(mask);
+      }
+      i += 32;
+    }
+    return endSSE2(buffer,i,end);
+  }
+
+#endif // TOKEN_X86
+
+  // skipWith(k,buffer,i,end), endWith(k,buffer,i,end):
+  //
+  // Run the skipping or word-ending loop of kernel `k`.
+  //
+  inline long skipWith(kernel k, char* buffer, long i, long end) {
+#ifdef TOKEN_X86
+    if (k == AVX2) {
+      return skipAVX2(buffer,i,end);
+    } else if (k == SSE2) {
+      return skipSSE2(buffer,i,end);
+    }
+#endif
+    return skipScalar(buffer,i,end);
+  }
+
+  inline long endWith(kernel k, char* buffer, long i, long end) {
+#ifdef TOKEN_X86
+    if (k == AVX2) {
+      return endAVX2(buffer,i,end);
+    } else if (k == SSE2) {
+      return endSSE2(buffer,i,end);
+    }
+#endif
+    return endScalar(buffer,i,end);
+  }
+
+  // bestKernel():
+  //
+  // Returns the widest kernel the running CPU can execute.
+  //
+  kernel bestKernel() {
+#ifdef TOKEN_X86
+    if (__builtin_cpu_supports("avx2")) {
+      return AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return SSE2;
+    }
+#endif
+    return SCALAR;
+  }
+
+  // kernelName(k):
+  //
+  // Returns a printable name for the kernel `k`.
+  //
+  const char* kernelName(kernel k) {
+    if (k == AVX2) {
+      return "avx2";
+    } else if (k == SSE2) {
+      return "sse2";
+    }
+    return "scalar";
+  }
+
+  // * * * * * * * * * * * * * * * * * * * * * * *
+  //
+  // OPERATIONS ON token::stream
+  //
+
+  // buildBuffered(fd,closeFd):
+  //
+  // Build a stream that reads blocks from the descriptor `fd`.
+  //
+  stream* buildBuffered(int fd, bool closeFd) {
+    stream* S   = new stream;
+    S->capacity = BLOCK_SIZE;
+    S->buffer   = new char[S->capacity];
+    S->size     = 0;
+    S->position = 0;
+    S->fd       = fd;
+    S->mapped   = false;
+    S->closeFd  = closeFd;
+    S->borrowed = false;
+    S->atEnd    = false;
+    S->scanner  = bestKernel();
+    return S;
+  }
+
+  // open(filename):
+  //
+  // Build a stream over the text of the file named `filename`. The
+  // file is mapped into memory when possible. Privately mapped pages
+  // are writable, so words can be made lowercase in place; only the
+  // pages actually holding capitals ever get copied.
+  //
+  // When `filename` is nullptr or "-" the stream reads from STDIN.
+  //
+  stream* open(const char* filename) {
+    if (filename == nullptr || std::strcmp(filename,"-") == 0) {
+      return buildBuffered(0,false);
+    }
+
+    int fd = ::open(filename,O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    //regular files get mapped, anything else gets read in blocks
+    struct stat info;
+    if (fstat(fd,&info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+      return buildBuffered(fd,true);
+    }
+    void* text = mmap(nullptr,info.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    if (text == MAP_FAILED) {
+      return buildBuffered(fd,true);
+    }
+    madvise(text,info.st_size,MADV_SEQUENTIAL);
+    ::close(fd);
+
+    stream* S   = new stream;
+    S->buffer   = static_cast<char*>(text);
+    S->size     = info.st_size;
+    S->capacity = 0;
+    S->position = 0;
+    S->fd       = -1;
+    S->mapped   = true;
+    S->closeFd  = false;
+    S->borrowed = false;
+    S->atEnd    = true;
+    S->scanner  = bestKernel();
+    return S;
+  }
+
+  // view(text,size):
+  //
+  // Build a stream over the `size` bytes at `text`, which stay owned
+  // by the caller. The words are lowercased in place.
+  //
+  stream* view(char* text, long size) {
+    stream* S   = new stream;
+    S->buffer   = text;
+    S->size     = size;
+    S->capacity = 0;
+    S->position = 0;
+    S->fd       = -1;
+    S->mapped   = false;
+    S->closeFd  = false;
+    S->borrowed = true;
+    S->atEnd    = true;
+    S->scanner  = bestKernel();
+    return S;
+  }
+
+  // refill(S,keep):
+  //
+  // Discards the bytes of `S` before offset `keep`, slides the rest
+  // to the front of the buffer and reads more after them. The buffer
+  // doubles when a single word fills all of it.
+  //
+  // Marks `S` as at its end once nothing more could be read.
+  //
+  void refill(stream* S, long keep) {
+    //slide the unfinished word down to the front
+    long kept = S->size - keep;
+    if (kept > 0 && keep > 0) {
+      std::memmove(S->buffer,S->buffer+keep,kept);
+    }
+    S->size = kept;
+    S->position = 0;
+
+    //make room if the kept part is the whole buffer
+    if (S->size == S->capacity) {
+      char* bigger = new char[2*S->capacity];
+      std::memcpy(bigger,S->buffer,S->size);
+      delete [] S->buffer;
+      S->buffer = bigger;
+      S->capacity *= 2;
+    }
+
+    //read until we get something or hit the end
+    while (true) {
+      long got = ::read(S->fd,S->buffer+S->size,S->capacity-S->size);
+      if (got > 0) {
+	S->size += got;
+	return;
+      }
+      if (got == 0 || errno != EINTR) {
+	S->atEnd = true;
+	return;
+      }
+    }
+  }
+
+  // next(S,w):
+  //
+  // Scans forward from the current position of `S` for the next word
+  // or stopper, lowercasing it in place, and sets `w` to view it.
+  //
+  // Returns false when the text has no more words.
+  //
+  bool next(stream* S, word& w) {
+    while (true) {
+      char* buffer = S->buffer;
+      long end = S->size;
+      long i = S->position;
+
+      //skip over the separators
+      i = skipWith(S->scanner,buffer,i,end);
+      if (i == end) {
+	if (S->atEnd) {
+	  S->position = end;
+	  return false;
+	}
+	refill(S,end);
+	continue;
+      }
+
+      //a stopper is a word all by itself
+      if (isStopper(buffer[i])) {
+	w.start = buffer+i;
+	w.length = 1;
+	S->position = i+1;
+	return true;
+      }
+
+      //otherwise run to the end of the letters, making them lowercase
+      long j = endWith(S->scanner,buffer,i,end);
+
+      //the word might continue into the next block
+      if (j == end && !S->atEnd) {
+	refill(S,i);
+	continue;
+      }
+      w.start = buffer+i;
+      w.length = j-i;
+      S->position = j;
+      return true;
+    }
+  }
+
+  // boundaryAfter(text,size,at):
+  //
+  // Returns the first offset `p` at or after `at` where the `size`
+  // bytes at `text` can be cut without splitting a word: the start,
+  // the end, or anywhere not between two word characters. Stoppers
+  // are words by themselves, so cutting beside one is always safe.
+  //
+  long boundaryAfter(const char* text, long size, long at) {
+    if (at <= 0) {
+      return 0;
+    }
+    while (at < size && isWordChar(text[at-1]) && isWordChar(text[at])) {
+      at++;
+    }
+    return at < size ? at : size;
+  }
+
+  // nextBlock(S,blockSize,text,size):
+  //
+  // Sets `text` and `size` to the next stretch of the input of `S`
+  // that ends between two words, so that it can be tokenized apart
+  // from what follows. A mapped file is handed back whole. Otherwise
+  // the buffer is grown to `blockSize` bytes and filled, and the
+  // block ends at its last boundary; the rest is kept for next time.
+  //
+  // Returns false once the input is used up.
+  //
+  bool nextBlock(stream* S, long blockSize, char*& text, long& size) {
+    if (S->mapped || S->borrowed) {
+      if (S->position >= S->size) {
+	return false;
+      }
+      text = S->buffer + S->position;
+      size = S->size - S->position;
+      S->position = S->size;
+      return true;
+    }
+
+    //make room for a whole block after what was kept
+    if (S->capacity < blockSize) {
+      char* bigger = new char[blockSize];
+      std::memcpy(bigger,S->buffer+S->position,S->size-S->position);
+      delete [] S->buffer;
+      S->buffer = bigger;
+      S->capacity = blockSize;
+      S->size -= S->position;
+      S->position = 0;
+    }
+
+    //fill it, growing it if a single word somehow fills it
+    long cut = 0;
+    while (cut == 0) {
+      refill(S,S->position);
+      while (!S->atEnd && S->size < S->capacity) {
+	refill(S,0);
+      }
+      if (S->size == 0) {
+	return false;
+      }
+      cut = S->size;
+      if (!S->atEnd) {
+	//the byte after the buffer is unknown, so look from the last one
+	cut = S->size-1;
+	while (cut > 0 && isWordChar(S->buffer[cut-1]) && isWordChar(S->buffer[cut])) {
+	  cut--;
+	}
+      }
+    }
+    text = S->buffer;
+    size = cut;
+    S->position = cut;
+    return true;
+  }
+
+  // close(S):
+  //
+  // Unmaps or deletes the buffer of `S`, closes any file it opened,
+  // and deletes `S` itself.
+  //
+  void close(stream* S) {
+    if (S->mapped) {
+      munmap(S->buffer,S->size);
+    } else if (!S->borrowed) {
+      delete [] S->buffer;
+    }
+    if (S->closeFd) {
+      ::close(S->fd);
+    }
+    delete S;
+  }
+
+  // toString(w):
+  //
+  // Returns a new string holding the characters of `w`.
+  //
+  std::string toString(word w) {
+    return std::string(w.start,w.length);
+  }
+
+} // end namespace token
@@ -0,0 +1,120 @@
+#ifndef _TOKEN_H
+#define _TOKEN_H
+
+// token.hh
+//
+// This defines a word tokenizer shared by `stats` and `chats`. It
+// replaces the old `next_word_in(std::string&)` loop, which built
+// each word character by character and erased the processed prefix
+// of the line, so that long lines cost quadratic time.
+//
+// A `token::stream*` scans a text held in one contiguous buffer. When
+// the text comes from a regular file that buffer is the file itself,
+// mapped into memory. Otherwise (STDIN, pipes) the text is read in
+// large blocks. Either way, `token::next` hands back views of the
+// words sitting in that buffer; nothing is copied or erased.
+//
+// Words follow the same rules as `next_word_in` did:
+//   * letters and the contraction mark ' form words, and letters
+//     are made lowercase;
+//   * each of the "stopper" marks . ! ? is a word all by itself;
+//   * every other character separates words.
+//
+// Scanning for those boundaries is done by one of several kernels:
+// the plain per-character loop, kept as the reference, and SSE2/AVX2
+// versions that classify 16 or 32 characters at a time. The best one
+// the CPU supports is picked when a stream is opened.
+//
+
+#include <string>
+#include <string_view>
+
+namespace token {
+
+  // word
+  //
+  // A view of one word within a stream's buffer. It stays valid
+  // only until the next call to `token::next` on that stream.
+  //
+  struct word {
+    const char* start;  // The first character of the word.
+    int length;         // How many characters it spans.
+  };
+
+  // toView(w):
+  //
+  // Returns the characters of `w` as a `std::string_view`, copying
+  // nothing, for looking it up. It is only valid as long as `w` is.
+  //
+  inline std::string_view toView(word w) {
+    return std::string_view(w.start,w.length);
+  }
+
+  // kernel
+  //
+  // The scanning loops a stream can use to find word boundaries.
+  //
+  enum kernel {
+    SCALAR,  // One character at a time. The reference version.
+    SSE2,    // 16 characters at a time.
+    AVX2     // 32 characters at a time.
+  };
+
+  // stream
+  //
+  // The state of a tokenizer working through one input text.
+  //
+  struct stream {
+
+    char* buffer;    // The text being scanned. Either the mapped
+		     // file or a block read from the input.
+
+    long size;       // The number of valid bytes in `buffer`.
+
+    long capacity;   // The allocated size of `buffer` when we read
+		     // blocks into it. Zero when it is mapped.
+
+    long position;   // Where in `buffer` the next scan starts.
+
+    int fd;          // The file descriptor blocks are read from.
+
+    bool mapped;     // Whether `buffer` is a memory-mapped file.
+
+    bool closeFd;    // Whether `fd` was opened by us.
+
+    bool borrowed;   // Whether `buffer` belongs to someone else, so
+		     // that closing the stream leaves it alone.
+
+    bool atEnd;      // Whether the input has no more to be read.
+
+    kernel scanner;  // Which scanning loop `next` uses. Set to the
+		     // best one supported, but it can be changed.
+  };
+
+  //
+  // The public interface to token::stream objects.
+  //
+  stream* open(const char* filename);   // Maps `filename`, or reads STDIN when given nullptr or "-".
+                                        // Returns nullptr if the file can't be opened.
+
+  stream* view(char* text, long size);  // Scans the `size` bytes at `text`, which it doesn't own.
+
+  bool next(stream* S, word& w);        // Scans the next word of `S` into `w`. Returns false at the end.
+
+  bool nextBlock(stream* S, long blockSize,  // Hands back, in place of words, the next block of about
+		 char*& text, long& size);   // `blockSize` bytes that ends between words. For splitting
+					     // the text among threads; don't mix with `next`.
+
+  long boundaryAfter(const char* text,  // Returns the first offset at or after `at` in the `size`
+		     long size, long at);   // bytes at `text` that doesn't fall inside a word.
+
+  void close(stream* S);                // Unmaps or frees the buffer of `S` and deletes it.
+
+  std::string toString(word w);         // Copies the characters of `w` into a new string.
+
+  kernel bestKernel();                  // Returns the fastest kernel this CPU supports.
+  const char* kernelName(kernel k);     // Returns a printable name for `k`.
+
+}
+
+#endif // _TOKEN_H
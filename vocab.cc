@@ -0,0 +1,178 @@
+//
+// vocab.cc
+//
+// This implements the interning vocabulary `vocab::dict*`. See
+// "vocab.hh".
+//
+// The functions it defines include
+//    * `vocab::dict* vocab::build(int)`: build an empty vocabulary
+//    * `unsigned vocab::intern(vocab::dict*,const char*,int)`: get or make a word's ID
+//    * `unsigned vocab::intern(vocab::dict*,std::string_view)`: the same for a string
+//    * `unsigned vocab::find(vocab::dict*,std::string_view)`: look up a word's ID
+//    * `const std::string& vocab::word(vocab::dict*,unsigned)`: get the word of an ID
+//    * `int vocab::size(vocab::dict*)`: get the number of words
+//    * `void vocab::destroy(vocab::dict*)`: give back the vocabulary's storage
+//
+// The table holds only IDs, probed linearly from a word's hash. The
+// hashes are kept by ID, so growing the table never hashes a word
+// again, and a probe compares the characters only of a word whose
+// hash matches.
+//
+// Its storage is counted against the parts VOCAB_WORDS and VOCAB_TABLE
+// of "mem.hh".
+//
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include "vocab.hh"
+#include "hash.hh"
+#include "mem.hh"
+
+using hashing::hash64;
+using hashing::powerOfTwoAtLeast;
+
+namespace vocab {
+
+  // slotFor(V,chars,length,h):
+  //
+  // Returns the slot of the table of `V` holding the ID of the word
+  // at `chars` (with hash `h`), or the empty slot where it would go.
+  //
+  int slotFor(dict* V, const char* chars, int length, unsigned long long h) {
+    int mask = V->tableSize-1;
+    int slot = h & mask;
+    while (V->table[slot] != 0) {
+      unsigned id = V->table[slot]-1;
+      if (V->hashes[id] == h && V->words[id].size() == (unsigned)length
+	  && std::memcmp(V->words[id].data(),chars,length) == 0) {
+	return slot;
+      }
+      slot = (slot+1) & mask;
+    }
+    return slot;
+  }
+
+  // grow(V):
+  //
+  // Doubles the table of `V` and the arrays of its words, placing each
+  // ID anew by its kept hash.
+  //
+  void grow(dict* V) {
+    std::string* words = new std::string[2*V->capacity];
+    unsigned long long* hashes = new unsigned long long[2*V->capacity];
+    for (int id=0; id<V->numWords; id++) {
+      words[id].swap(V->words[id]);
+      hashes[id] = V->hashes[id];
+    }
+    delete [] V->words;
+    delete [] V->hashes;
+    V->words = words;
+    V->hashes = hashes;
+    mem::allocated(mem::VOCAB_WORDS,V->capacity*(sizeof(std::string) + sizeof(unsigned long long)));
+    V->capacity *= 2;
+
+    delete [] V->table;
+    mem::allocated(mem::VOCAB_TABLE,V->tableSize*sizeof(unsigned));
+    V->tableSize = 2*V->capacity;
+    V->table = new unsigned[V->tableSize]();
+    int mask = V->tableSize-1;
+    for (int id=0; id<V->numWords; id++) {
+      int slot = V->hashes[id] & mask;
+      while (V->table[slot] != 0) {
+	slot = (slot+1) & mask;
+      }
+      V->table[slot] = id+1;
+    }
+  }
+
+  // build(initialSize):
+  //
+  // Build an empty vocabulary with room for about `initialSize` words.
+  //
+  dict* build(int initialSize) {
+    dict* newV = new dict;
+    newV->capacity  = powerOfTwoAtLeast(initialSize < 16 ? 16 : initialSize);
+    newV->words     = new std::string[newV->capacity];
+    newV->hashes    = new unsigned long long[newV->capacity];
+    newV->numWords  = 0;
+    newV->tableSize = 2*newV->capacity;
+    newV->table     = new unsigned[newV->tableSize]();
+    mem::allocated(mem::VOCAB_WORDS,newV->capacity*(sizeof(std::string) + sizeof(unsigned long long)));
+    mem::allocated(mem::VOCAB_TABLE,newV->tableSize*sizeof(unsigned));
+    return newV;
+  }
+
+  // intern(V,chars,length):
+  //
+  // Returns the ID of the word made of the `length` characters at
+  // `chars`. A word not seen before gets the next ID.
+  //
+  unsigned intern(dict* V, const char* chars, int length) {
+    unsigned long long h = hash64(chars,length);
+    int slot = slotFor(V,chars,length,h);
+    if (V->table[slot] != 0) {
+      return V->table[slot]-1;
+    }
+    if (V->numWords == V->capacity) {
+      grow(V);
+      slot = slotFor(V,chars,length,h);
+    }
+    unsigned id = V->numWords++;
+    V->words[id].assign(chars,length);
+    mem::allocated(mem::VOCAB_WORDS,mem::heapBytes(V->words[id]));
+    V->hashes[id] = h;
+    V->table[slot] = id+1;
+    return id;
+  }
+
+  // intern(V,w):
+  //
+  // Returns the ID of the word `w`, giving it one if it is new.
+  //
+  unsigned intern(dict* V, std::string_view w) {
+    return intern(V,w.data(),w.size());
+  }
+
+  // find(V,w):
+  //
+  // Returns the ID of the word `w`, or NONE if it has none.
+  //
+  unsigned find(dict* V, std::string_view w) {
+    int slot = slotFor(V,w.data(),w.size(),hash64(w.data(),w.size()));
+    return V->table[slot] == 0 ? NONE : V->table[slot]-1;
+  }
+
+  // word(V,id):
+  //
+  // Returns the word with the given ID.
+  //
+  const std::string& word(dict* V, unsigned id) {
+    return V->words[id];
+  }
+
+  // size(V):
+  //
+  // Returns the number of words in `V`.
+  //
+  int size(dict* V) {
+    return V->numWords;
+  }
+
+  // destroy(V):
+  //
+  // Deletes all the heap-allocated components of `V`.
+  //
+  void destroy(dict* V) {
+    for (int id=0; mem::tracking && id<V->numWords; id++) {
+      mem::freed(mem::VOCAB_WORDS,mem::heapBytes(V->words[id]));
+    }
+    mem::freed(mem::VOCAB_WORDS,V->capacity*(sizeof(std::string) + sizeof(unsigned long long)));
+    mem::freed(mem::VOCAB_TABLE,V->tableSize*sizeof(unsigned));
+    delete [] V->words;
+    delete [] V->hashes;
+    delete [] V->table;
+    delete V;
+  }
+
+} // end namespace vocab
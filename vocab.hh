@@ -0,0 +1,62 @@
+#ifndef _VOCAB_H
+#define _VOCAB_H
+
+// vocab.hh
+//
+// This defines a vocabulary `vocab::dict*` that interns words: each
+// distinct word is stored once and given a 32-bit ID, numbered from 0
+// in the order the words were first seen. Structures that would hold
+// many copies of the same words, like the chat model of `gram`, can
+// hold their IDs instead, and compare and hash those as integers.
+//
+
+#include <string>
+#include <string_view>
+
+namespace vocab {
+
+  // The ID that stands for no word at all.
+  const unsigned NONE = 0xFFFFFFFFu;
+
+  // dict
+  //
+  // The words of a vocabulary and a hash table to find their IDs.
+  //
+  struct dict {
+
+    std::string* words;        // The word of each ID.
+
+    unsigned long long* hashes; // The hash64 of each ID's word.
+
+    int numWords;              // How many words there are.
+
+    int capacity;              // The allocated length of `words` and `hashes`.
+
+    unsigned* table;           // An open-addressing table of IDs, each plus
+			       // one, indexed by hash. 0 marks an empty slot.
+
+    int tableSize;             // The length of `table`; a power of two kept
+			       // at least twice `numWords`.
+  };
+
+  //
+  // The public interface to vocab::dict objects.
+  //
+  dict* build(int initialSize);                          // Constructs an empty vocabulary.
+
+  unsigned intern(dict* V, const char* chars, int length); // Returns the ID of the word made of the
+                                                           // `length` characters at `chars`, adding it
+                                                           // if it is new.
+  unsigned intern(dict* V, std::string_view w);          // Returns the ID of `w`, adding it if it is new.
+
+  unsigned find(dict* V, std::string_view w);            // Returns the ID of `w`, or NONE if it isn't there.
+
+  const std::string& word(dict* V, unsigned id);         // Returns the word with the given ID.
+
+  int size(dict* V);                                     // Returns the number of words.
+
+  void destroy(dict* V);                                 // Returns the storage of `V` back to the heap.
+
+}
+
+#endif // _VOCAB_H
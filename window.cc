@@ -0,0 +1,358 @@
+//
+// window.cc
+//
+// This implements `window::dict*`, the word counts of the last words
+// of a stream along with its leading words. See "window.hh".
+//
+// The functions it defines include
+//    * `window::dict* window::build(int,int)`: build a window over a stream
+//    * `void window::push(window::dict*,std::string_view)`: add the next word of the stream
+//    * `int window::numWords(window::dict*)`: get the number of words in the window
+//    * `int window::numKeys(window::dict*)`: get the number of distinct words
+//    * `int window::getCount(window::dict*,std::string_view)`: get the count of a word
+//    * `freq::entry* window::topK(window::dict*)`: get the most frequent words
+//    * `void window::destroy(window::dict*)`: give back the window's storage
+//
+
+#include <string>
+#include <utility>
+#include "window.hh"
+#include "freq.hh"
+#include "hash.hh"
+
+using hashing::hash64;
+using hashing::powerOfTwoAtLeast;
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// THE LEADERS
+//
+// `leaders` is kept sorted by rank. Each leader can be found from its
+// hash through `index`, which is updated whenever leaders change places.
+//
+namespace window {
+
+  // ranksAbove(a,b):
+  //
+  // Whether leader `a` ranks above leader `b`: it has a higher count, or
+  // the same count and a word earlier in alphabetical order. The same
+  // order as `freq::topK`.
+  //
+  bool ranksAbove(const leader& a, const leader& b) {
+    return a.count > b.count || (a.count == b.count && a.word < b.word);
+  }
+
+  // findLeader(W,w,h):
+  //
+  // Returns the place in `leaders` of the word `w` with hash `h`, or
+  // -1 if it isn't one of them.
+  //
+  int findLeader(dict* W, std::string_view w, unsigned long long h) {
+    int mask = W->indexSize-1;
+    for (int slot = h & mask; W->index[slot] != -1; slot = (slot+1) & mask) {
+      leader& e = W->leaders[W->index[slot]];
+      if (e.hash == h && e.word == w) {
+	return W->index[slot];
+      }
+    }
+    return -1;
+  }
+
+  // slotOf(W,i):
+  //
+  // Returns the slot of `index` that points to leader `i`.
+  //
+  int slotOf(dict* W, int i) {
+    int mask = W->indexSize-1;
+    int slot = W->leaders[i].hash & mask;
+    while (W->index[slot] != i) {
+      slot = (slot+1) & mask;
+    }
+    return slot;
+  }
+
+  // addIndex(W,i):
+  //
+  // Records in `index` where leader `i` is.
+  //
+  void addIndex(dict* W, int i) {
+    int mask = W->indexSize-1;
+    int slot = W->leaders[i].hash & mask;
+    while (W->index[slot] != -1) {
+      slot = (slot+1) & mask;
+    }
+    W->index[slot] = i;
+  }
+
+  // removeIndex(W,slot):
+  //
+  // Empties the `slot` of `index`, then shifts back any entries after it
+  // that could no longer be reached past the gap.
+  //
+  void removeIndex(dict* W, int slot) {
+    int mask = W->indexSize-1;
+    int gap = slot;
+    int next = (gap+1) & mask;
+    while (W->index[next] != -1) {
+      int home = W->leaders[W->index[next]].hash & mask;
+      //move it back only if its home isn't cyclically within (gap,next]
+      if (((next-home) & mask) >= ((next-gap) & mask)) {
+	W->index[gap] = W->index[next];
+	gap = next;
+      }
+      next = (next+1) & mask;
+    }
+    W->index[gap] = -1;
+  }
+
+  // swapLeaders(W,i,j):
+  //
+  // Exchanges the places of leaders `i` and `j`.
+  //
+  void swapLeaders(dict* W, int i, int j) {
+    int si = slotOf(W,i);
+    int sj = slotOf(W,j);
+    leader& a = W->leaders[i];
+    leader& b = W->leaders[j];
+    a.word.swap(b.word);
+    std::swap(a.count,b.count);
+    std::swap(a.hash,b.hash);
+    W->index[si] = j;
+    W->index[sj] = i;
+  }
+
+  // raise(W,i):
+  //
+  // Moves leader `i` up past those it now ranks above. Returns where
+  // it ends up.
+  //
+  int raise(dict* W, int i) {
+    while (i > 0 && ranksAbove(W->leaders[i],W->leaders[i-1])) {
+      swapLeaders(W,i,i-1);
+      i--;
+    }
+    return i;
+  }
+
+  // lower(W,i):
+  //
+  // Moves leader `i` down past those that now rank above it. Returns
+  // where it ends up.
+  //
+  int lower(dict* W, int i) {
+    while (i < W->numLeaders-1 && ranksAbove(W->leaders[i+1],W->leaders[i])) {
+      swapLeaders(W,i,i+1);
+      i++;
+    }
+    return i;
+  }
+
+  // dropLast(W):
+  //
+  // Takes the last leader off the list, noting its count as one that
+  // a word outside the list may have.
+  //
+  void dropLast(dict* W) {
+    int last = W->numLeaders-1;
+    if (W->leaders[last].count > W->outsideMax) {
+      W->outsideMax = W->leaders[last].count;
+    }
+    removeIndex(W,slotOf(W,last));
+    std::string().swap(W->leaders[last].word);
+    W->numLeaders--;
+  }
+
+  // rebuild(W):
+  //
+  // Makes the leaders the top 2k words of the window exactly, ranking
+  // all of its words, and finds `outsideMax` anew.
+  //
+  void rebuild(dict* W) {
+    int capacity = 2*W->k;
+    int n = freq::numKeys(W->counts);
+    int wanted = n < capacity+1 ? n : capacity+1;
+    freq::entry* best = freq::topK(W->counts,wanted);
+
+    for (int s=0; s<W->indexSize; s++) {
+      W->index[s] = -1;
+    }
+    W->numLeaders = wanted < capacity ? wanted : capacity;
+    for (int i=0; i<W->numLeaders; i++) {
+      W->leaders[i].word.swap(best[i].word);
+      W->leaders[i].count = best[i].count;
+      W->leaders[i].hash  = hash64(W->leaders[i].word);
+      addIndex(W,i);
+    }
+    W->outsideMax = wanted > capacity ? best[capacity].count : 0;
+    W->numRebuilds++;
+    delete [] best;
+  }
+
+  // raised(W,w,h):
+  //
+  // Updates the leaders after the count of word `w` (with hash `h`)
+  // went up by one.
+  //
+  void raised(dict* W, std::string_view w, unsigned long long h) {
+    int i = findLeader(W,w,h);
+    if (i != -1) {
+      W->leaders[i].count++;
+      raise(W,i);
+      return;
+    }
+
+    //an outsider joins if there's room, or if it beats the last leader
+    leader candidate;
+    candidate.count = freq::getCount(W->counts,w);
+    candidate.word.assign(w.data(),w.size());
+    candidate.hash  = h;
+    if (W->numLeaders == 2*W->k) {
+      if (!ranksAbove(candidate,W->leaders[W->numLeaders-1])) {
+	if (candidate.count > W->outsideMax) {
+	  W->outsideMax = candidate.count;
+	}
+	return;
+      }
+      dropLast(W);
+    }
+    i = W->numLeaders++;
+    W->leaders[i].word.swap(candidate.word);
+    W->leaders[i].count = candidate.count;
+    W->leaders[i].hash  = h;
+    addIndex(W,i);
+    raise(W,i);
+  }
+
+  // lowered(W,w,h):
+  //
+  // Updates the leaders after the count of word `w` (with hash `h`)
+  // went down by one. A leader whose count reaches zero sinks to the
+  // end of the list and is taken off it.
+  //
+  void lowered(dict* W, std::string_view w, unsigned long long h) {
+    int i = findLeader(W,w,h);
+    if (i == -1) {
+      return;
+    }
+    W->leaders[i].count--;
+    i = lower(W,i);
+    if (W->leaders[i].count == 0) {
+      removeIndex(W,slotOf(W,i));
+      std::string().swap(W->leaders[i].word);
+      W->numLeaders--;
+    }
+  }
+
+} // end namespace window
+
+// * * * * * * * * * * * * * * * * * * * * * * *
+//
+// Operations on window::dict.
+//
+namespace window {
+
+  // build(size,k):
+  //
+  // Build an empty window of the last `size` words of a stream, which
+  // reports its top `k` words.
+  //
+  dict* build(int size, int k) {
+    dict* newW = new dict;
+    newW->counts      = freq::build(size < 16 ? 16 : size,2,freq::FLAT);
+    newW->size        = size < 1 ? 1 : size;
+    newW->ring        = new std::string[newW->size];
+    newW->numWords    = 0;
+    newW->next        = 0;
+    newW->k           = k < 1 ? 1 : k;
+    newW->leaders     = new leader[2*newW->k];
+    newW->numLeaders  = 0;
+    newW->indexSize   = powerOfTwoAtLeast(4*newW->k);
+    newW->index       = new int[newW->indexSize];
+    for (int s=0; s<newW->indexSize; s++) {
+      newW->index[s] = -1;
+    }
+    newW->outsideMax  = 0;
+    newW->numRebuilds = 0;
+    return newW;
+  }
+
+  // push(W,w):
+  //
+  // Adds the word `w` as the newest in the window. If the window was
+  // full, its oldest word leaves it. The new word is copied into the
+  // ring over the old one, whose storage is nearly always big enough,
+  // so that pushing a word doesn't usually allocate.
+  //
+  void push(dict* W, std::string_view w) {
+    std::string& slot = W->ring[W->next];
+    if (W->numWords == W->size) {
+      unsigned long long old = hash64(slot);
+      freq::decrement(W->counts,slot);
+      lowered(W,slot,old);
+    } else {
+      W->numWords++;
+    }
+    slot.assign(w.data(),w.size());
+    freq::increment(W->counts,slot);
+    raised(W,slot,hash64(slot));
+    W->next = (W->next+1) % W->size;
+  }
+
+  // numWords(W):
+  //
+  // Gives back the number of words in the window.
+  //
+  int numWords(dict* W) {
+    return W->numWords;
+  }
+
+  // numKeys(W):
+  //
+  // Gives back the number of distinct words in the window.
+  //
+  int numKeys(dict* W) {
+    return freq::numKeys(W->counts);
+  }
+
+  // getCount(W,w):
+  //
+  // Gets how many times `w` occurs in the window.
+  //
+  int getCount(dict* W, std::string_view w) {
+    return freq::getCount(W->counts,w);
+  }
+
+  // topK(W):
+  //
+  // Gives back a new array of the `k` most frequent words in the
+  // window (or all of them, if there are fewer), most frequent first.
+  // They are just the first of the leaders, unless some word outside
+  // the leaders could rank among them; then the leaders are rebuilt.
+  //
+  freq::entry* topK(dict* W) {
+    int n = numKeys(W) < W->k ? numKeys(W) : W->k;
+    bool complete = W->numLeaders == numKeys(W);
+    if (!complete && (W->numLeaders < n || W->leaders[n-1].count <= W->outsideMax)) {
+      rebuild(W);
+    }
+    freq::entry* result = new freq::entry[n];
+    for (int i=0; i<n; i++) {
+      result[i].word  = W->leaders[i].word;
+      result[i].count = W->leaders[i].count;
+    }
+    return result;
+  }
+
+  // destroy(W):
+  //
+  // Deletes all the heap-allocated components of `W`.
+  //
+  void destroy(dict* W) {
+    freq::destroy(W->counts);
+    delete [] W->ring;
+    delete [] W->leaders;
+    delete [] W->index;
+    delete W;
+  }
+
+} // end namespace window
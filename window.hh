@@ -0,0 +1,97 @@
+#ifndef _WINDOW_H
+#define _WINDOW_H
+
+// window.hh
+//
+// This defines `window::dict*`, which counts the words of a stream
+// that fall within its last `size` words, and can report the most
+// frequent of them at any point while the stream goes on.
+//
+// The counts live in a `freq::dict`. The words in the window are kept
+// in a ring, so that each new word pushes out the oldest one, whose
+// count is decremented.
+//
+// The leading words are kept up to date as the counts change, rather
+// than found by ranking the whole window for each report. A short
+// list of candidate "leaders", twice as many as will be reported, is
+// kept in rank order: a changed count only moves its word a few places
+// along the list. The list also keeps `outsideMax`, a bound on the
+// count of any word not on it. As long as the last reported leader
+// counts more than that, the report is exact; when it doesn't, the
+// list is rebuilt from the counts with `freq::topK`.
+//
+
+#include <string>
+#include <string_view>
+#include "freq.hh"
+
+namespace window {
+
+  // leader
+  //
+  // One of the words of the window that could be among its top words.
+  //
+  struct leader {
+
+    std::string word;          // The word,
+
+    unsigned long long count;  // its count within the window,
+
+    unsigned long long hash;   // and its full hash, for `index`.
+  };
+
+  // dict
+  //
+  // The counts of the most recent words of a stream.
+  //
+  struct dict {
+
+    freq::dict* counts;    // The count of each word in the window.
+
+    std::string* ring;     // The words in the window, oldest at `next`
+			   // once it is full.
+
+    int size;              // The most words the window holds.
+
+    int numWords;          // How many it holds so far.
+
+    int next;              // Where in `ring` the next word goes.
+
+    int k;                 // How many leaders are reported.
+
+    leader* leaders;       // Up to 2k words of the window, in rank order,
+			   // with their counts.
+
+    int numLeaders;        // How many leaders there are.
+
+    int* index;            // An open-addressing table from a leader's hash
+			   // to its place in `leaders`, or -1 if empty.
+
+    int indexSize;         // The length of `index`; a power of two.
+
+    unsigned long long outsideMax; // No word outside `leaders` has a higher count.
+
+    int numRebuilds;       // How many times `leaders` had to be rebuilt.
+  };
+
+  //
+  // The public interface to window::dict objects.
+  //
+  dict* build(int size, int k);                 // Constructs a window of the last `size` words that
+                                                // reports the top `k` of them.
+
+  void push(dict* W, std::string_view w);       // Adds the word `w` to `W`, pushing out the oldest
+                                                // word once the window is full.
+
+  int numWords(dict* W);                        // Returns how many words are in the window.
+  int numKeys(dict* W);                         // Returns how many distinct words are in the window.
+  int getCount(dict* W, std::string_view w);    // Returns the count of `w` within the window.
+
+  freq::entry* topK(dict* W);                   // Gives back a new array of the top `k` words of the
+                                                // window, or all of them if fewer, most frequent first.
+
+  void destroy(dict* W);                        // Returns the storage of `W` back to the heap.
+
+}
+
+#endif // _WINDOW_H